@@ -1,96 +1,200 @@
 #include "animationhost.h"
 
 
+Animation::Animation() {
+    _blendMode = FrameBuffer::Over;
+    _opacity = 1.0f;
+}
+
+Animation::~Animation() {
+}
+
+void Animation::renderFrame(QImage* image, const RenderData& data) {
+    Q_UNUSED(image);
+    Q_UNUSED(data);
+}
+
+void Animation::render(FrameBuffer& frame, const RenderData& data) {
+    if(_legacyImage.size() != frame.size()){
+        _legacyImage = QImage(frame.size(), QImage::Format_ARGB32_Premultiplied);
+    }
+
+    _legacyImage.fill(Qt::transparent);
+    renderFrame(&_legacyImage, data);
+
+    frame.fromImage(_legacyImage);
+}
+
+bool Animation::sample(const LedPositions& leds, FrameBuffer& frame, const RenderData& data) {
+    Q_UNUSED(leds);
+    Q_UNUSED(frame);
+    Q_UNUSED(data);
+
+    return false;
+}
+
+void Animation::setBlendMode(FrameBuffer::BlendMode mode) {
+    _blendMode = mode;
+}
+
+FrameBuffer::BlendMode Animation::blendMode() const {
+    return _blendMode;
+}
+
+void Animation::setOpacity(float opacity) {
+    _opacity = qBound(0.0f, opacity, 1.0f);
+}
+
+float Animation::opacity() const {
+    return _opacity;
+}
+
+
 BlobTracker::BlobTracker(QSharedPointer<RenderData> data) {
     _dataPtr = data;
     _maxAgeMs = 5000;
     _maxJoinRadius = 0.8;
+    _nextId = 0;
+
+    _buckets.resize(TRACKER_GRID_BUCKETS);
+    _nextInBucket.resize(_dataPtr->tracks.capacity());
+    _gridValid = false;
 }
 
 void BlobTracker::setMaxAgeMs(quint64 ms) {
     _maxAgeMs = ms;
 }
 
+void BlobTracker::setVelocitySmoothing(float alpha) {
+    _dataPtr->tracks.setVelocitySmoothing(alpha);
+}
+
 void BlobTracker::setMaxJoinRadius(qreal radius) {
     _maxJoinRadius = radius;
+    _gridValid = false;
 }
 
-void BlobTracker::insertBlob(BlobInfo* b){
-    int closestGroup = -1;
-    tfScalar closestDistance = 0.0f;
+int BlobTracker::cellOf(float value) const {
+    return (int) floorf(value / qMax((float)_maxJoinRadius, 0.001f));
+}
 
-    QMultiMap<int,BlobInfo*>::iterator currentIter = _dataPtr->blobs.begin();
+int BlobTracker::bucketOf(int cellX, int cellY) const {
+    unsigned int hash = ((unsigned int)cellX * 73856093u) ^ ((unsigned int)cellY * 19349663u);
+    return hash & (TRACKER_GRID_BUCKETS - 1);
+}
 
-    for(; currentIter != _dataPtr->blobs.end(); currentIter++){
-        tfScalar distance = currentIter.value()->centroid.distance( b->centroid );
+void BlobTracker::rebuildGrid() {
+    const TrackTable& tracks = _dataPtr->tracks;
 
-        if(closestGroup == -1 || closestDistance > distance) {
-            closestDistance = distance;
-            closestGroup = currentIter.key();
-        }
-    }
+    _buckets.fill(-1);
 
-    if(closestGroup != -1){
-        if(closestDistance > _maxJoinRadius) {
-            closestGroup = -1;
-        }
-    }
+    for(int track=0; track<tracks.count(); track++){
+        int head = tracks.sample(track, 0);
+        int bucket = bucketOf( cellOf(tracks.x()[head]), cellOf(tracks.y()[head]) );
 
-    if(closestGroup == -1){
-        if(_dataPtr->blobs.count() > 0) {
-            closestGroup = _dataPtr->blobs.keys().last() + 1;
-        }
-        else {
-            closestGroup = 0;
-        }
+        _nextInBucket[track] = _buckets[bucket];
+        _buckets[bucket] = track;
     }
 
-    _dataPtr->blobs.insert(closestGroup, b);
+    _gridValid = true;
 }
 
-void BlobTracker::updateBlobs(QList<BlobInfo*> blobs) {
-    if(_dataPtr->blobs.count() > 1){
-        std::cout << "Updating " << _dataPtr->blobs.count() << " blobs in "
-                  << _dataPtr->blobs.keys().count() << " clusters" <<  std::endl;
+void BlobTracker::insertBlob(const BlobInfo& b){
+    TrackTable& tracks = _dataPtr->tracks;
+
+    if(!_gridValid){
+        rebuildGrid();
     }
 
-    QMultiMap<int,BlobInfo*>::iterator currentIter = _dataPtr->blobs.begin();
-    while(currentIter != _dataPtr->blobs.end()){
-        ros::Duration age = _dataPtr->timestamp - currentIter.value()->timestamp;
-        if( (age.toSec() * 1000) > _maxAgeMs ) {
+    float bx = b.centroid.x();
+    float by = b.centroid.y();
+    float bz = b.centroid.z();
+
+    int closestTrack = -1;
+    float closestDistance2 = _maxJoinRadius * _maxJoinRadius;
+
+    int cellX = cellOf(bx);
+    int cellY = cellOf(by);
+
+    //Cells are join radius wide, any head within reach is in the 3x3 neighbourhood
+    for(int dy=-1; dy<=1; dy++){
+        for(int dx=-1; dx<=1; dx++){
+            int track = _buckets[ bucketOf(cellX + dx, cellY + dy) ];
+
+            for(; track != -1; track = _nextInBucket[track]){
+                int head = tracks.sample(track, 0);
 
-            std::cout << "Deleting blob, too old age=" << age.toSec() << " sec" << std::endl;
+                float ox = tracks.x()[head] - bx;
+                float oy = tracks.y()[head] - by;
+                float oz = tracks.z()[head] - bz;
+                float distance2 = (ox*ox) + (oy*oy) + (oz*oz);
 
-            delete currentIter.value();
-            currentIter = _dataPtr->blobs.erase(currentIter);
+                if(distance2 <= closestDistance2){
+                    closestDistance2 = distance2;
+                    closestTrack = track;
+                }
+            }
         }
-        else{
-            currentIter++;
+    }
+
+    int bucket = bucketOf(cellX, cellY);
+
+    if(closestTrack == -1){
+        closestTrack = tracks.insert(_nextId);
+
+        if(closestTrack == -1){
+            ROS_WARN_THROTTLE(5, "BlobTracker - All %d tracks in use, dropping blob", tracks.capacity());
+            return;
         }
+
+        _nextId++;
+
+        //New tracks are not in any chain yet, link the head in place
+        _nextInBucket[closestTrack] = _buckets[bucket];
+        _buckets[bucket] = closestTrack;
     }
+    else{
+        int head = tracks.sample(closestTrack, 0);
 
-    if(blobs.size() > 0){
-        std::cout << "Got " << blobs.size() << " new blobs" << std::endl;
+        //Chains are singly linked, rebuild only when the head leaves its bucket
+        if(bucketOf( cellOf(tracks.x()[head]), cellOf(tracks.y()[head]) ) != bucket){
+            _gridValid = false;
+        }
     }
 
-    for(int i=0; i < blobs.count(); i++){
-        insertBlob(blobs[i]);
+    tracks.append(closestTrack, b);
+}
+
+void BlobTracker::expireBlobs() {
+    TrackTable& tracks = _dataPtr->tracks;
+    int count = tracks.count();
+
+    tracks.expire( _dataPtr->timestamp - ros::Duration(_maxAgeMs / 1000.0) );
+
+    if(tracks.count() != count){
+        _gridValid = false;
     }
 }
 
 
-AnimationHost::AnimationHost(QString pixelMapPath, QSharedPointer<RenderData> data) {
+AnimationHost::AnimationHost(QString pixelMapPath, QSharedPointer<RenderData> data, OutputSink* sink) {
     _dataPtr = data;
+    _sparse = 0;
 
-    _olaManager = new OlaManager();
-    _olaManager->blackout();
+    _predictionHorizonMs = DEFAULT_PREDICTION_HORIZON_MS;
+    _predictionClamp = DEFAULT_PREDICTION_CLAMP;
+    _outputDelayMs = 0;
 
+    _olaManager = new OlaManager(sink);
     _pixelMapper = new PixelMapper(_olaManager);
 
+    //Keep running dark, a good map can be loaded without a restart
     if(!_pixelMapper->fromFile(pixelMapPath)){
-        ROS_ERROR("Failed to load pixel map, exiting!");
-        exit(-2);
+        ROS_ERROR("Failed to load pixel map %s, waiting for a new one", pixelMapPath.toStdString().c_str());
     }
+
+    //Universes only exist once a map allocated them, start every one of them dark
+    _olaManager->blackout();
 }
 
 AnimationHost::~AnimationHost() {
@@ -102,6 +206,10 @@ PixelMapper* AnimationHost::getPixelMapper() const {
     return _pixelMapper;
 }
 
+OlaManager* AnimationHost::getOlaManager() const {
+    return _olaManager;
+}
+
 Animation* AnimationHost::insertLayer(int layer, Animation* a) {
     Animation* current = getLayer(layer);
 
@@ -125,6 +233,16 @@ Animation* AnimationHost::getLayer(int layer) {
 }
 
 
+void AnimationHost::setSparseSampling(bool enable) {
+    _sparse.storeRelease(enable ? 1 : 0);
+}
+
+void AnimationHost::setPrediction(int horizonMs, float clamp, int outputDelayMs) {
+    _predictionHorizonMs = qMax(0, horizonMs);
+    _predictionClamp = qMax(0.0f, clamp);
+    _outputDelayMs = qMax(0, outputDelayMs);
+}
+
 void AnimationHost::transmit() {
     _pixelMapper->render();
 }
@@ -144,8 +262,26 @@ QImage* AnimationHost::renderLayer(int minLayer, int maxLayer) {
         maxLayer = minLayer;
     }
 
-    QImage* frame = _pixelMapper->getImage();
+    //A map loaded since the last frame takes effect here, never in the middle of one
+    _pixelMapper->applyPendingMap();
+
+    QImage* frame = _pixelMapper->beginFrame();
     RenderData* data = _dataPtr.data();
+
+    //Draw people where they will be when the lights change, not where the sensor saw them
+    data->outputTime = data->timestamp + ros::Duration(_outputDelayMs / 1000.0);
+    data->tracks.predict(data->outputTime, _predictionHorizonMs / 1000.0f, _predictionClamp);
+
+    if(_sparse.loadAcquire()){
+        renderLayersSparse(frame, minLayer, maxLayer);
+        _pixelMapper->publishFrame();
+        return frame;
+    }
+
+    _composite.resize(frame->width(), frame->height());
+    _layer.resize(frame->width(), frame->height());
+    _composite.clear();
+
     QMap<int,Animation*>::iterator layerIter = _animations.begin();
 
     for(; layerIter != _animations.end(); layerIter++) {
@@ -153,9 +289,54 @@ QImage* AnimationHost::renderLayer(int minLayer, int maxLayer) {
         int layer = layerIter.key();
         if(layer < minLayer || layer > maxLayer) { continue; }
 
-        layerIter.value()->renderFrame(frame, *data);
+        Animation* animation = layerIter.value();
+
+        //Each layer draws alone and is blended once
+        _layer.clear();
+        animation->render(_layer, *data);
+
+        _composite.composite(_layer, animation->blendMode(), animation->opacity());
     }
 
+    _composite.toImage(*frame);
+
+    //The frame stays untouched until the next renderLayer(), safe to read until then
+    _pixelMapper->publishFrame();
+
     return frame;
 }
 
+void AnimationHost::renderLayersSparse(QImage* frame, int minLayer, int maxLayer) {
+    const LedPositions& leds = _pixelMapper->ledPositions();
+    RenderData* data = _dataPtr.data();
+
+    _composite.resize(leds.count, 1);
+    _composite.clear();
+
+    QMap<int,Animation*>::iterator layerIter = _animations.begin();
+
+    for(; layerIter != _animations.end(); layerIter++) {
+
+        int layer = layerIter.key();
+        if(layer < minLayer || layer > maxLayer) { continue; }
+
+        Animation* animation = layerIter.value();
+
+        _layer.resize(leds.count, 1);
+        _layer.clear();
+
+        if(!animation->sample(leds, _layer, *data)){
+            _raster.resize(frame->width(), frame->height());
+            _raster.clear();
+            animation->render(_raster, *data);
+
+            _layer.gather(_raster, leds.columns, leds.rows);
+        }
+
+        _composite.composite(_layer, animation->blendMode(), animation->opacity());
+    }
+
+    //Pixels without an LED stay black
+    frame->fill(Qt::black);
+    _composite.scatter(*frame, leds.columns, leds.rows);
+}
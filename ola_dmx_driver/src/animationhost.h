@@ -8,37 +8,101 @@
 #include "utils.h"
 #include "olamanager.h"
 #include "pixelmapper.h"
+#include "framebuffer.h"
+#include "tracktable.h"
 
-struct BlobInfo {
-    tf::Vector3 centroid;
-    tf::Vector3 bounds;
-    tf::Vector3 realDimensions;
-    ros::Time timestamp;
-};
+#define DEFAULT_PREDICTION_HORIZON_MS (150)
+#define DEFAULT_PREDICTION_CLAMP      (4.0f)
 
 struct RenderData {
-    QMultiMap<int, BlobInfo*> blobs;
+    TrackTable tracks;
     ros::Time timestamp;
+    ros::Time outputTime;       //When the frame being rendered reaches the lights
+    ros::Time captureTime;      //Capture time of the newest sighting in tracks
 };
 
 class Animation {
     public:
-        virtual void renderFrame(QImage* image, const RenderData& data) = 0;
+        Animation();
+        virtual ~Animation();
+
+        /**
+         * @brief   Legacy QPainter interface, only called through the default render()
+         */
+        virtual void renderFrame(QImage* image, const RenderData& data);
+
+        /**
+         * @brief   Draw this layer in isolation into a cleared (transparent) frame. The
+         *          default implementation paints renderFrame() into a transparent
+         *          ARGB32_Premultiplied image and converts it.
+         */
+        virtual void render(FrameBuffer& frame, const RenderData& data);
+
+        /**
+         * @brief   Sparse variant of render(), evaluate the colour only at the LEDs. frame is
+         *          a cleared leds.count x 1 buffer whose stride matches the padded position
+         *          arrays, so implementations can work four LEDs at a time with SSE loads from
+         *          leds.x/y/z and stores into the frame planes.
+         * @return  False if not implemented, the layer is then rendered with render() and
+         *          sampled at the LED pixels
+         */
+        virtual bool sample(const LedPositions& leds, FrameBuffer& frame, const RenderData& data);
+
+        void setBlendMode(FrameBuffer::BlendMode mode);
+        FrameBuffer::BlendMode blendMode() const;
+
+        void setOpacity(float opacity);
+        float opacity() const;
+
+    private:
+        FrameBuffer::BlendMode _blendMode;
+        float _opacity;
+        QImage _legacyImage;
 };
 
+#define TRACKER_GRID_BUCKETS (256)
+
+/**
+ * @brief   Joins blob sightings into tracks. New sightings are matched against the newest
+ *          sample of each track through a uniform grid with cells the size of the join
+ *          radius, so only the 3x3 cells around a sighting are searched.
+ */
 class BlobTracker {
     public:
         BlobTracker(QSharedPointer<RenderData> data);
 
-        void insertBlob(BlobInfo* b);
+        /**
+         * @brief   Add a sighting to the track whose newest sample is nearest within the join
+         *          radius, or start a new track
+         */
+        void insertBlob(const BlobInfo& b);
         void setMaxAgeMs(quint64 ms);
         void setMaxJoinRadius(qreal radius);
-        void updateBlobs(QList<BlobInfo*> blobs);
+
+        /**
+         * @brief   See TrackTable::setVelocitySmoothing(), render thread only
+         */
+        void setVelocitySmoothing(float alpha);
+
+        /**
+         * @brief   Drop sightings older than the max age, call once per frame before inserting
+         */
+        void expireBlobs();
 
     private:
+        void rebuildGrid();
+        int cellOf(float value) const;
+        int bucketOf(int cellX, int cellY) const;
+
         QSharedPointer<RenderData> _dataPtr;
         quint64 _maxAgeMs;
         tfScalar _maxJoinRadius;
+        int _nextId;
+
+        //Grid over track heads, chained through _nextInBucket by track index
+        QVector<int> _buckets;
+        QVector<int> _nextInBucket;
+        bool _gridValid;
 };
 
 /*
@@ -61,10 +125,14 @@ class EffectEngine {
 
 class AnimationHost {
     public:
-        AnimationHost(QString pixelMapPath, QSharedPointer<RenderData> data);
+        /**
+         * @param sink  DMX output, owned by the host. NULL sends through a local olad.
+         */
+        AnimationHost(QString pixelMapPath, QSharedPointer<RenderData> data, OutputSink* sink = NULL);
         ~AnimationHost();
 
         PixelMapper* getPixelMapper() const;
+        OlaManager* getOlaManager() const;
 
         Animation* insertLayer(int layer, Animation* a);
         void removeLayer(int layer);
@@ -74,6 +142,22 @@ class AnimationHost {
         QImage* renderAll();
         QImage* renderLayer(int minLayer, int maxLayer=0);
 
+        /**
+         * @brief   Composite only the pixels that have an LED instead of the whole image.
+         *          Render thread only.
+         */
+        void setSparseSampling(bool enable);
+
+        /**
+         * @brief   Extrapolate tracks to the frame output time before rendering
+         * @param horizonMs     Longest extrapolation, 0 disables prediction
+         * @param clamp         Longest extrapolated step in pixels
+         * @param outputDelayMs Time from rendering a frame to the lights showing it
+         *
+         *          Read by renderLayer(), render thread only.
+         */
+        void setPrediction(int horizonMs, float clamp, int outputDelayMs);
+
     private:
         OlaManager* _olaManager;
         PixelMapper* _pixelMapper;
@@ -83,6 +167,17 @@ class AnimationHost {
         QMap<int, Animation*> _animations;
         QSharedPointer<RenderData> _dataPtr;
         int _frameCount;
+
+        void renderLayersSparse(QImage* frame, int minLayer, int maxLayer);
+
+        FrameBuffer _composite;     //Layers blended bottom up
+        FrameBuffer _layer;         //Scratch for the layer being rendered
+        FrameBuffer _raster;        //Full image of a layer without sample() in sparse mode
+        QAtomicInt _sparse;
+
+        int _predictionHorizonMs;
+        float _predictionClamp;
+        int _outputDelayMs;
 };
 
 #endif  //ANIMATION_HOST_H
@@ -1,22 +1,41 @@
 #include "animations.h"
 
+#include <algorithm>
+
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 FillFade::FillFade() {
     firstRender = ros::Time::now();
     duration = ros::Duration(5);
 }
 
-void FillFade::renderFrame(QImage* image, const RenderData& data) {
-    Q_ASSERT(image != NULL);
-    Q_ASSERT(image->width() > 0);
-    Q_ASSERT(image->height() > 0);
-
-    ros::Duration delta = data.timestamp - firstRender;
+QColor FillFade::colorAt(const ros::Time& time) const {
+    ros::Duration delta = time - firstRender;
 
     double durationDelta = (double) (delta.toNSec() % duration.toNSec());
     double position = durationDelta / (double) duration.toNSec();
 
-    QColor color = QColor::fromHsvF( qMin(1.0,position), 0.8, 0.3 );
-    image->fill(color);
+    return QColor::fromHsvF( qMin(1.0,position), 0.8, 0.3 );
+}
+
+void FillFade::render(FrameBuffer& frame, const RenderData& data) {
+    Q_ASSERT(frame.width() > 0);
+    Q_ASSERT(frame.height() > 0);
+
+    frame.fill( colorAt(data.timestamp) );
+}
+
+bool FillFade::sample(const LedPositions& leds, FrameBuffer& frame, const RenderData& data) {
+    Q_UNUSED(leds);
+
+    //Same colour everywhere, filling the padded sample frame covers every LED
+    frame.fill( colorAt(data.timestamp) );
+
+    return true;
 }
 
 
@@ -31,60 +50,295 @@ void StarPath::renderFrame(QImage* image, const RenderData& data) {
 
     QPainter painter( image );
 
-    foreach(BlobInfo* blob, data.blobs){
-        ros::Duration delta = data.timestamp - blob->timestamp;
+    const TrackTable& tracks = data.tracks;
 
-        double durationDelta = (double) (delta.toNSec() % duration.toNSec());
-        qreal position = durationDelta / (double) duration.toNSec();
+    for(int track=0; track<tracks.count(); track++){
+        for(int age=0; age<tracks.length(track); age++){
+            int blob = tracks.sample(track, age);
 
-        if(delta > duration){
-            continue;
-        }
+            ros::Duration delta = data.timestamp - tracks.stamps()[blob];
+
+            double durationDelta = (double) (delta.toNSec() % duration.toNSec());
+            qreal position = durationDelta / (double) duration.toNSec();
+
+            if(delta > duration){
+                continue;
+            }
+
+            double widthPx = tracks.width()[blob];
+            double depthPx = tracks.depth()[blob];
+
+            double centerXPx = tracks.x()[blob];
+            double centerYPx = tracks.y()[blob];
 
-        double widthPx = blob->bounds.x();
-        double depthPx = blob->bounds.y();
+            //Lead with the newest sighting moved forward to the output time
+            if(age == 0){
+                centerXPx = tracks.predictedX()[track];
+                centerYPx = tracks.predictedY()[track];
+            }
 
-        double centerXPx = blob->centroid.x();
-        double centerYPx = blob->centroid.y();
+            double radiusPx = qMax(widthPx, depthPx);
+            double radius = qMax(tracks.realWidth()[blob], tracks.realDepth()[blob]);
 
-        double radiusPx = qMax(widthPx, depthPx);
-        double radius = qMax(blob->realDimensions.x(), blob->realDimensions.y());
+            QRectF bounds(centerXPx - (widthPx/2.0f),
+                          centerYPx - (depthPx/2.0f),
+                          radiusPx,
+                          radiusPx);
+            QBrush fillBrush;
 
-        QRectF bounds(centerXPx - (widthPx/2.0f),
-                      centerYPx - (depthPx/2.0f),
-                      radiusPx,
-                      radiusPx);
-        QBrush fillBrush;
+            if(radius > 0.75f){
+                QConicalGradient conicalGrad(centerXPx,centerYPx, position*360.0f);
+                conicalGrad.setColorAt(0, Qt::red);
+                conicalGrad.setColorAt(90.0/360.0, Qt::green);
+                conicalGrad.setColorAt(180.0/360.0, Qt::blue);
+                conicalGrad.setColorAt(270.0/360.0, Qt::magenta);
+                conicalGrad.setColorAt(360.0/360.0, Qt::yellow);
 
-        if(radius > 0.75f){
-            QConicalGradient conicalGrad(centerXPx,centerYPx, position*360.0f);
-            conicalGrad.setColorAt(0, Qt::red);
-            conicalGrad.setColorAt(90.0/360.0, Qt::green);
-            conicalGrad.setColorAt(180.0/360.0, Qt::blue);
-            conicalGrad.setColorAt(270.0/360.0, Qt::magenta);
-            conicalGrad.setColorAt(360.0/360.0, Qt::yellow);
+                fillBrush = QBrush( conicalGrad );
 
-            fillBrush = QBrush( conicalGrad );
+            }
+            else {
+                QRadialGradient radialGrad(QPointF(centerXPx,centerYPx), radiusPx);
+                QColor white(Qt::white);
+                white.setHsvF(0, 0, 1.0-position);
 
+                QColor pink(Qt::magenta);
+                pink.setAlphaF(position);
+
+                radialGrad.setColorAt(0, white);
+                radialGrad.setColorAt(1.0f, pink);
+
+                fillBrush = QBrush( radialGrad );
+            }
+
+            QPainterPath fillPath;
+
+            fillPath.addEllipse(bounds);
+
+            painter.fillPath(fillPath, fillBrush);
         }
-        else {
-            QRadialGradient radialGrad(QPointF(centerXPx,centerYPx), radiusPx);
-            QColor white(Qt::white);
-            white.setHsvF(0, 0, 1.0-position);
+    }
+}
+
+//Stops of the conical gradient in renderFrame(), evenly spaced
+static const float CONICAL_STOPS[5][3] = {
+    { 1.0f, 0.0f, 0.0f },   //red
+    { 0.0f, 1.0f, 0.0f },   //green
+    { 0.0f, 0.0f, 1.0f },   //blue
+    { 1.0f, 0.0f, 1.0f },   //magenta
+    { 1.0f, 1.0f, 0.0f }    //yellow
+};
+
+/**
+ * @brief   Straight colour of a QConicalGradient starting at startDeg, (dx, dy) from its
+ *          centre in image pixels. Angles run counter-clockwise as seen on the image.
+ */
+static void conicalColor(float dx, float dy, double startDeg, float* rgba){
+    double angle = (atan2(-dy, dx) * 180.0 / M_PI) - startDeg;
+    double t = fmod(angle, 360.0) / 360.0;
+
+    if(t < 0.0){
+        t += 1.0;
+    }
+
+    double scaled = t * 4.0;
+    int stop = qMin((int)scaled, 3);
+    float blend = scaled - stop;
+
+    for(int c=0; c<3; c++){
+        rgba[c] = CONICAL_STOPS[stop][c] + ((CONICAL_STOPS[stop + 1][c] - CONICAL_STOPS[stop][c]) * blend);
+    }
+
+    rgba[3] = 1.0f;
+}
+
+/**
+ * @brief   Straight colour of the radial gradient in renderFrame(), white fading to
+ *          transparent magenta as position goes from 0 to 1
+ */
+static inline void radialColor(float distance, float radius, float position, float* rgba){
+    float t = qMin(1.0f, distance / radius);
+
+    const float inner[4] = { 1.0f - position, 1.0f - position, 1.0f - position, 1.0f };
+    const float outer[4] = { 1.0f, 0.0f, 1.0f, position };
 
-            QColor pink(Qt::magenta);
-            pink.setAlphaF(position);
+    for(int c=0; c<4; c++){
+        rgba[c] = inner[c] + ((outer[c] - inner[c]) * t);
+    }
+}
 
-            radialGrad.setColorAt(0, white);
-            radialGrad.setColorAt(1.0f, pink);
+/**
+ * @brief   One circle of renderFrame() with the radial gradient, in image pixels
+ */
+struct RadialCircle {
+    float circleX;
+    float circleY;
+    float circleRadius;
+    float centerX;
+    float centerY;
+    float radiusPx;
+    float position;
+};
 
-            fillBrush = QBrush( radialGrad );
+/**
+ * @brief   Source over blend of the radial gradient into the four LEDs starting at first,
+ *          which must be a multiple of four. LEDs outside the circle are left unchanged.
+ */
+static void blendRadialBlock(const LedPositions& leds, int first, const RadialCircle& circle,
+                             float* red, float* green, float* blue, float* alpha){
+#ifdef __SSE2__
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    __m128 x = _mm_div_ps( _mm_loadu_ps(leds.x.constData() + first), _mm_set1_ps(leds.spacingX) );
+    __m128 y = _mm_div_ps( _mm_loadu_ps(leds.y.constData() + first), _mm_set1_ps(leds.spacingY) );
+
+    __m128 cx = _mm_sub_ps( x, _mm_set1_ps(circle.circleX) );
+    __m128 cy = _mm_sub_ps( y, _mm_set1_ps(circle.circleY) );
+    __m128 inside = _mm_cmple_ps( _mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)),
+                                  _mm_set1_ps(circle.circleRadius * circle.circleRadius) );
+
+    __m128 dx = _mm_sub_ps( x, _mm_set1_ps(circle.centerX) );
+    __m128 dy = _mm_sub_ps( y, _mm_set1_ps(circle.centerY) );
+    __m128 distance = _mm_sqrt_ps( _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)) );
+    __m128 t = _mm_min_ps( one, _mm_div_ps(distance, _mm_set1_ps(circle.radiusPx)) );
+
+    //radialColor() four wide, white (1 - position) to magenta, opaque to position alpha
+    __m128 inner = _mm_set1_ps(1.0f - circle.position);
+    __m128 r = _mm_add_ps( inner, _mm_mul_ps(_mm_sub_ps(one, inner), t) );
+    __m128 g = _mm_sub_ps( inner, _mm_mul_ps(inner, t) );
+    __m128 a = _mm_add_ps( one, _mm_mul_ps(_mm_set1_ps(circle.position - 1.0f), t) );
+
+    //Zero alpha outside the circle, source over then keeps the destination
+    a = _mm_and_ps(a, inside);
+    __m128 inverse = _mm_sub_ps(one, a);
+
+    _mm_storeu_ps( red + first,   _mm_add_ps(_mm_mul_ps(r, a), _mm_mul_ps(_mm_loadu_ps(red + first), inverse)) );
+    _mm_storeu_ps( green + first, _mm_add_ps(_mm_mul_ps(g, a), _mm_mul_ps(_mm_loadu_ps(green + first), inverse)) );
+    _mm_storeu_ps( blue + first,  _mm_add_ps(_mm_mul_ps(r, a), _mm_mul_ps(_mm_loadu_ps(blue + first), inverse)) );
+    _mm_storeu_ps( alpha + first, _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(alpha + first), inverse)) );
+#else
+    for(int led=first; led<first + 4; led++){
+        float x = leds.x[led] / leds.spacingX;
+        float y = leds.y[led] / leds.spacingY;
+
+        float cx = x - circle.circleX;
+        float cy = y - circle.circleY;
+
+        if((cx*cx) + (cy*cy) > circle.circleRadius*circle.circleRadius){
+            continue;
         }
 
-        QPainterPath fillPath;
+        float dx = x - circle.centerX;
+        float dy = y - circle.centerY;
+        float rgba[4];
+
+        radialColor(sqrtf((dx*dx) + (dy*dy)), circle.radiusPx, circle.position, rgba);
 
-        fillPath.addEllipse(bounds);
+        float inverse = 1.0f - rgba[3];
 
-        painter.fillPath(fillPath, fillBrush);
+        red[led] = (rgba[0] * rgba[3]) + (red[led] * inverse);
+        green[led] = (rgba[1] * rgba[3]) + (green[led] * inverse);
+        blue[led] = (rgba[2] * rgba[3]) + (blue[led] * inverse);
+        alpha[led] = rgba[3] + (alpha[led] * inverse);
     }
+#endif
+}
+
+bool StarPath::sample(const LedPositions& leds, FrameBuffer& frame, const RenderData& data) {
+    const TrackTable& tracks = data.tracks;
+
+    float* red = frame.plane(FrameBuffer::Red);
+    float* green = frame.plane(FrameBuffer::Green);
+    float* blue = frame.plane(FrameBuffer::Blue);
+    float* alpha = frame.plane(FrameBuffer::Alpha);
+
+    for(int track=0; track<tracks.count(); track++){
+        for(int age=0; age<tracks.length(track); age++){
+            int blob = tracks.sample(track, age);
+
+            ros::Duration delta = data.timestamp - tracks.stamps()[blob];
+
+            if(delta > duration){
+                continue;
+            }
+
+            double durationDelta = (double) (delta.toNSec() % duration.toNSec());
+            float position = durationDelta / (double) duration.toNSec();
+
+            float widthPx = tracks.width()[blob];
+            float depthPx = tracks.depth()[blob];
+
+            float centerXPx = tracks.x()[blob];
+            float centerYPx = tracks.y()[blob];
+
+            if(age == 0){
+                centerXPx = tracks.predictedX()[track];
+                centerYPx = tracks.predictedY()[track];
+            }
+
+            float radiusPx = qMax(widthPx, depthPx);
+            float radius = qMax(tracks.realWidth()[blob], tracks.realDepth()[blob]);
+
+            if(radiusPx <= 0.0f){
+                continue;
+            }
+
+            //renderFrame() fills a circle of diameter radiusPx whose corner is half the blob size from the centre
+            float circleX = centerXPx - (widthPx/2.0f) + (radiusPx/2.0f);
+            float circleY = centerYPx - (depthPx/2.0f) + (radiusPx/2.0f);
+            float circleRadius = radiusPx/2.0f;
+
+            //The grid is in metres, search a circle covering the one in pixels
+            _nearby.clear();
+            leds.grid.query(circleX * leds.spacingX, circleY * leds.spacingY,
+                            circleRadius * qMax(leds.spacingX, leds.spacingY), _nearby);
+
+            //Radial circles are blended four LEDs at a time over every block the grid touched
+            if(radius <= 0.75f){
+                RadialCircle circle = { circleX, circleY, circleRadius, centerXPx, centerYPx, radiusPx, position };
+
+                for(int i=0; i<_nearby.size(); i++){
+                    _nearby[i] &= ~3;
+                }
+
+                std::sort(_nearby.begin(), _nearby.end());
+                QVector<int>::iterator end = std::unique(_nearby.begin(), _nearby.end());
+
+                for(QVector<int>::iterator block = _nearby.begin(); block != end; block++){
+                    blendRadialBlock(leds, *block, circle, red, green, blue, alpha);
+                }
+
+                continue;
+            }
+
+            for(int i=0; i<_nearby.size(); i++){
+                int led = _nearby[i];
+                float ledXPx = leds.x[led] / leds.spacingX;
+                float ledYPx = leds.y[led] / leds.spacingY;
+
+                float cx = ledXPx - circleX;
+                float cy = ledYPx - circleY;
+
+                if((cx*cx) + (cy*cy) > circleRadius*circleRadius){
+                    continue;
+                }
+
+                float dx = ledXPx - centerXPx;
+                float dy = ledYPx - centerYPx;
+                float rgba[4];
+
+                conicalColor(dx, dy, position*360.0f, rgba);
+
+                //Source over, as QPainter fills the path
+                float inverse = 1.0f - rgba[3];
+
+                red[led] = (rgba[0] * rgba[3]) + (red[led] * inverse);
+                green[led] = (rgba[1] * rgba[3]) + (green[led] * inverse);
+                blue[led] = (rgba[2] * rgba[3]) + (blue[led] * inverse);
+                alpha[led] = rgba[3] + (alpha[led] * inverse);
+            }
+        }
+    }
+
+    return true;
 }
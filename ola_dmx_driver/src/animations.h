@@ -7,7 +7,11 @@ class FillFade : public Animation {
     public:
         FillFade();
 
-        virtual void renderFrame(QImage* image, const RenderData& data);
+        virtual void render(FrameBuffer& frame, const RenderData& data);
+        virtual bool sample(const LedPositions& leds, FrameBuffer& frame, const RenderData& data);
+
+        QColor colorAt(const ros::Time& time) const;
+
         ros::Time firstRender;
         ros::Duration duration;
 };
@@ -18,8 +22,17 @@ class StarPath : public Animation {
         StarPath();
         virtual void renderFrame(QImage* image, const RenderData& data);
 
+        /**
+         * @brief   Same circles and gradients as renderFrame(), evaluated only at the LEDs
+         *          the LED grid finds under each circle. Radial gradients are blended with
+         *          SSE over the four LED blocks holding those LEDs.
+         */
+        virtual bool sample(const LedPositions& leds, FrameBuffer& frame, const RenderData& data);
+
         ros::Duration duration;
 
+    private:
+        QVector<int> _nearby;       //Reused by sample(), LED indices then block starts
 };
 
 
@@ -0,0 +1,281 @@
+#include "asyncsink.h"
+
+#include <string.h>
+
+#include "monotonicclock.h"
+
+#define SENDER_POLL_MS (100)
+
+AsyncSink::Frame::Frame(){
+    serial = 0;
+    renderNs = 0;
+    captureNs = 0;
+}
+
+
+AsyncSink::AsyncSink(OutputSink* sink) :
+    _thread(this)
+{
+    _sink = sink;
+    _running = 1;
+    _periodUs = 0;
+    _transmitted = NULL;
+    _transmitGroup = NULL;
+    _transmitMember = -1;
+    _pending.serial = 1;
+
+    _published = 0;
+    _sent = 0;
+    _dropped = 0;
+    _failures = 0;
+    _universesSent = 0;
+
+    _thread.start();
+}
+
+AsyncSink::~AsyncSink(){
+    stop();
+    delete _sink;
+}
+
+void AsyncSink::stop(){
+    if(!_thread.isRunning()){
+        return;
+    }
+
+    _running = 0;
+    _wake.release();
+    _thread.wait();
+}
+
+OutputSink* AsyncSink::sink() const {
+    return _sink;
+}
+
+void AsyncSink::setMaxRate(double fps){
+    _periodUs.storeRelease( (fps > 0.0) ? (int)(1000000.0 / fps) : 0 );
+}
+
+void AsyncSink::setTransmitFunction(TransmitFunction transmitted){
+    _transmitted = transmitted;
+}
+
+void AsyncSink::setTransmitGroup(TransmitGroup* group){
+    _transmitGroup = group;
+    _transmitMember = (group != NULL) ? group->attach() : -1;
+}
+
+void AsyncSink::setFrameStamps(qint64 renderNs, qint64 captureNs){
+    _pending.renderNs = renderNs;
+    _pending.captureNs = captureNs;
+}
+
+quint32 AsyncSink::published() const {
+    return _published.loadAcquire();
+}
+
+quint32 AsyncSink::sent() const {
+    return _sent.loadAcquire();
+}
+
+quint32 AsyncSink::dropped() const {
+    return _dropped.loadAcquire();
+}
+
+quint32 AsyncSink::failures() const {
+    return _failures.loadAcquire();
+}
+
+quint32 AsyncSink::universesSent() const {
+    return _universesSent.loadAcquire();
+}
+
+int AsyncSink::backlog() const {
+    //The counters are read one after the other, the sender may finish a frame in between
+    int backlog = (int)((quint32)_published.loadAcquire() - (quint32)_sent.loadAcquire() - (quint32)_dropped.loadAcquire());
+
+    return qMax(0, backlog);
+}
+
+bool AsyncSink::send(int universe, const uint8_t* channels){
+    QHash<int,int>::const_iterator iter = _slots.constFind(universe);
+    int slot;
+
+    if(iter != _slots.constEnd()){
+        slot = iter.value();
+    }
+    else{
+        slot = _pending.universes.size();
+        _slots.insert(universe, slot);
+
+        _pending.universes.append(universe);
+        _pending.changed.append(0);
+        _pending.channels.resize((slot + 1) * OUTPUT_SINK_SIZE);
+    }
+
+    memcpy(_pending.channels.data() + (slot * OUTPUT_SINK_SIZE), channels, OUTPUT_SINK_SIZE);
+    _pending.changed[slot] = _pending.serial;
+
+    return true;
+}
+
+bool AsyncSink::flush(){
+    if(_running.loadAcquire() == 0){
+        return false;
+    }
+
+    //Copy rather than assign, assignment would share the data and reallocate on the next send()
+    Frame& frame = _frames.back();
+    int count = _pending.universes.size();
+
+    frame.serial = _pending.serial;
+    frame.renderNs = _pending.renderNs;
+    frame.captureNs = _pending.captureNs;
+    frame.universes.resize(count);
+    frame.changed.resize(count);
+    frame.channels.resize(count * OUTPUT_SINK_SIZE);
+
+    memcpy(frame.universes.data(), _pending.universes.constData(), count * sizeof(int));
+    memcpy(frame.changed.data(), _pending.changed.constData(), count * sizeof(quint32));
+    memcpy(frame.channels.data(), _pending.channels.constData(), count * OUTPUT_SINK_SIZE);
+
+    _published.ref();
+
+    if(_frames.publish()){
+        _dropped.ref();
+    }
+
+    _pending.serial++;
+
+    //One outstanding wake up is enough, the sender always takes the latest frame
+    if(_wake.available() == 0){
+        _wake.release();
+    }
+
+    return true;
+}
+
+QString AsyncSink::name() const {
+    return QString("async:%1").arg(_sink->name());
+}
+
+void AsyncSink::drain(){
+    uint64_t nextNs = 0;
+
+    while(_running.loadAcquire() != 0){
+        if(!_wake.tryAcquire(1, SENDER_POLL_MS)){
+            continue;
+        }
+
+        //Paced, wait out the period and send whatever is latest by then
+        int periodUs = _periodUs.loadAcquire();
+
+        if(periodUs > 0){
+            uint64_t nowNs = monotonicNs();
+
+            if(nowNs < nextNs){
+                sleepUntilNs(nextNs);
+            }
+
+            nextNs = qMax(nowNs, nextNs) + (uint64_t)periodUs * 1000ULL;
+        }
+
+        if(!_frames.update()){
+            continue;
+        }
+
+        const Frame& frame = _frames.front();
+
+        if(_delivered.size() < frame.universes.size()){
+            _delivered.resize(frame.universes.size());
+        }
+
+        _flushed.clear();
+
+        for(int slot=0; slot<frame.universes.size(); slot++){
+            if(frame.changed[slot] <= _delivered[slot]){
+                continue;
+            }
+
+            if(_sink->send(frame.universes[slot], frame.channels.constData() + (slot * OUTPUT_SINK_SIZE))){
+                _flushed.append(slot);
+            }
+            else{
+                _failures.ref();        //Left undelivered, goes out again with the next frame
+            }
+        }
+
+        //Sinks such as E131Sink only queue in send(), nothing has gone out until flush() succeeds
+        if(_sink->flush()){
+            for(int i=0; i<_flushed.size(); i++){
+                _delivered[ _flushed[i] ] = frame.changed[ _flushed[i] ];
+            }
+
+            _universesSent.fetchAndAddOrdered(_flushed.size());
+
+            if(_transmitted != NULL){
+                _transmitted(frame.renderNs, frame.captureNs);
+            }
+
+            if(_transmitGroup != NULL){
+                _transmitGroup->flushed(_transmitMember, frame.renderNs, frame.captureNs);
+            }
+        }
+        else{
+            _failures.ref();
+        }
+
+        _sent.ref();
+    }
+}
+
+
+TransmitGroup::TransmitGroup(AsyncSink::TransmitFunction transmitted){
+    _transmitted = transmitted;
+    _reportedNs = 0;
+}
+
+int TransmitGroup::attach(){
+    QMutexLocker locker(&_lock);
+
+    _renderNs.append(0);
+    _captureNs.append(0);
+
+    return _renderNs.size() - 1;
+}
+
+void TransmitGroup::flushed(int member, qint64 renderNs, qint64 captureNs){
+    qint64 oldestRenderNs;
+    qint64 oldestCaptureNs;
+
+    {
+        QMutexLocker locker(&_lock);
+
+        if(member < 0 || member >= _renderNs.size()){
+            return;
+        }
+
+        _renderNs[member] = renderNs;
+        _captureNs[member] = captureNs;
+
+        //The member furthest behind holds the newest frame every member is done with
+        int oldest = 0;
+        for(int i=1; i<_renderNs.size(); i++){
+            if(_renderNs[i] < _renderNs[oldest]){
+                oldest = i;
+            }
+        }
+
+        if(_renderNs[oldest] <= _reportedNs){
+            return;
+        }
+
+        _reportedNs = _renderNs[oldest];
+        oldestRenderNs = _renderNs[oldest];
+        oldestCaptureNs = _captureNs[oldest];
+    }
+
+    if(_transmitted != NULL){
+        _transmitted(oldestRenderNs, oldestCaptureNs);
+    }
+}
@@ -0,0 +1,169 @@
+#ifndef ASYNCSINK_H
+#define ASYNCSINK_H
+
+#include <QtCore>
+
+#include <stdint.h>
+
+#include "outputsink.h"
+#include "triplebuffer.h"
+
+class TransmitGroup;
+
+/**
+ * @brief   Moves a sink onto its own sender thread so a slow or stalled output never
+ *          holds up the render loop
+ *
+ *          send() and flush() only copy the frame into a TripleBuffer and wake the sender,
+ *          they never block. The sender always takes the latest frame, frames it did not
+ *          get to are dropped and counted. Every frame carries all universes with the
+ *          serial of the frame that last changed them, so a universe that changed in a
+ *          dropped frame still goes out with the next one. A universe only counts as
+ *          delivered once the sink's flush() succeeded, universes that failed to send or
+ *          whose flush failed are retried with the next frame.
+ */
+class AsyncSink : public OutputSink
+{
+    public:
+        /**
+         * @brief   Called on the sender thread after a frame was flushed, with the stamps
+         *          setFrameStamps() gave that frame
+         */
+        typedef void (*TransmitFunction)(qint64 renderNs, qint64 captureNs);
+
+        /**
+         * @param sink  Output used from the sender thread only, owned by the AsyncSink
+         */
+        AsyncSink(OutputSink* sink);
+        virtual ~AsyncSink();
+
+        /**
+         * @brief   Stop and join the sender thread, later frames are discarded
+         */
+        void stop();
+
+        OutputSink* sink() const;
+
+        /**
+         * @brief   Send at most this many frames per second, frames in between are
+         *          dropped. 0 sends every frame the sender gets to.
+         */
+        void setMaxRate(double fps);
+
+        /**
+         * @brief   Set before the first flush(), NULL reports nothing
+         */
+        void setTransmitFunction(TransmitFunction transmitted);
+
+        /**
+         * @brief   Report flushed frames to a group shared with other AsyncSinks instead of
+         *          a transmit function. Set before the first flush(), not owned.
+         */
+        void setTransmitGroup(TransmitGroup* group);
+
+        /**
+         * @brief   Stamps handed to the transmit function once the next flush() has gone
+         *          out, render side
+         */
+        void setFrameStamps(qint64 renderNs, qint64 captureNs);
+
+        quint32 published() const;      //Frames handed over by flush()
+        quint32 sent() const;           //Frames the sender finished
+        quint32 dropped() const;        //Frames replaced before the sender took them
+        quint32 failures() const;       //Universes or flushes the sink reported as failed
+        quint32 universesSent() const;  //Universes the sink accepted
+
+        /**
+         * @brief   Frames published but not finished by the sender, including the one
+         *          being sent
+         */
+        int backlog() const;
+
+        virtual bool send(int universe, const uint8_t* channels);
+        virtual bool flush();
+        virtual QString name() const;
+
+    private:
+        struct Frame {
+            Frame();
+
+            quint32 serial;
+            qint64 renderNs;
+            qint64 captureNs;
+            QVector<int> universes;
+            QVector<quint32> changed;   //Serial of the frame each universe was last sent in
+            QVector<uint8_t> channels;  //OUTPUT_SINK_SIZE bytes per universe
+        };
+
+        class Sender : public QThread
+        {
+            public:
+                Sender(AsyncSink* owner) : _owner(owner) {}
+
+            protected:
+                virtual void run(){ _owner->drain(); }
+
+            private:
+                AsyncSink* _owner;
+        };
+
+        void drain();
+
+        OutputSink* _sink;
+        Sender _thread;
+        QSemaphore _wake;
+        QAtomicInt _running;
+        QAtomicInt _periodUs;
+        TransmitFunction _transmitted;
+        TransmitGroup* _transmitGroup;
+        int _transmitMember;
+
+        TripleBuffer<Frame> _frames;
+
+        //Render side, universes in the order they were first sent
+        QHash<int,int> _slots;
+        Frame _pending;
+
+        //Sender side, serial of the last successful send of each slot and the slots sent since the last flush
+        QVector<quint32> _delivered;
+        QVector<int> _flushed;
+
+        QAtomicInt _published;
+        QAtomicInt _sent;
+        QAtomicInt _dropped;
+        QAtomicInt _failures;
+        QAtomicInt _universesSent;
+};
+
+/**
+ * @brief   Calls a transmit function once per frame for AsyncSinks that each send part of
+ *          the same frames, once the last of them has flushed it
+ *
+ *          Members may drop frames independently, a frame counts as transmitted when every
+ *          member has flushed it or a later frame. Frames are told apart by their render
+ *          stamp, which must increase from frame to frame.
+ */
+class TransmitGroup
+{
+    public:
+        TransmitGroup(AsyncSink::TransmitFunction transmitted);
+
+        /**
+         * @return  Index the member reports its flushes with
+         */
+        int attach();
+
+        /**
+         * @brief   Member flushed the frame with these stamps, on its sender thread
+         */
+        void flushed(int member, qint64 renderNs, qint64 captureNs);
+
+    private:
+        QMutex _lock;
+        AsyncSink::TransmitFunction _transmitted;
+        QVector<qint64> _renderNs;          //Per member, newest frame flushed
+        QVector<qint64> _captureNs;
+        qint64 _reportedNs;                 //Render stamp of the last frame reported
+};
+
+#endif // ASYNCSINK_H
@@ -0,0 +1,138 @@
+/*
+ * Loopback receiver for checking E1.31 output without lights attached
+ *
+ *   e131_dump [--port N] [universe ...]
+ *
+ * Listens on the E1.31 port, joins the multicast group of every universe given and
+ * prints one line per data or sync packet: universe, sequence, sync address, the
+ * first channels and gaps in the sequence numbers.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <vector>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define E131_PORT (5568)
+
+using namespace std;
+
+static inline uint16_t get16(const uint8_t* src){
+    return (src[0] << 8) | src[1];
+}
+
+static inline uint32_t get32(const uint8_t* src){
+    return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | src[3];
+}
+
+int main(int argc, char** argv){
+    int port = E131_PORT;
+    std::vector<int> universes;
+
+    for(int i=1; i<argc; i++){
+        if(strcmp(argv[i], "--port") == 0 && i+1 < argc){
+            port = atoi(argv[++i]);
+        }
+        else{
+            universes.push_back( atoi(argv[i]) );
+        }
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock < 0){
+        cerr << "socket: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if(bind(sock, (sockaddr*) &address, sizeof(address)) != 0){
+        cerr << "bind: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    for(unsigned int i=0; i<universes.size(); i++){
+        ip_mreq group;
+        group.imr_multiaddr.s_addr = htonl( 0xefff0000 | (universes[i] & 0xffff) );
+        group.imr_interface.s_addr = htonl(INADDR_ANY);
+
+        if(setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) != 0){
+            cerr << "Failed to join group of universe " << universes[i] << ": " << strerror(errno) << endl;
+        }
+    }
+
+    cout << "Listening on port " << port << endl;
+
+    std::map<int,int> lastSequence;
+    uint8_t packet[1144];
+
+    while(true){
+        ssize_t length = recv(sock, packet, sizeof(packet), 0);
+
+        if(length < 0){
+            if(errno == EINTR){ continue; }
+
+            cerr << "recv: " << strerror(errno) << endl;
+            return 1;
+        }
+
+        if(length < 38 || memcmp(packet + 4, "ASC-E1.17", 9) != 0){
+            cout << "Not E1.31, " << length << " bytes" << endl;
+            continue;
+        }
+
+        uint32_t rootVector = get32(packet + 18);
+
+        if(rootVector == 0x00000008 && length >= 49){
+            cout << "sync    seq=" << setw(3) << (int)packet[44] << " universe=" << get16(packet + 45) << endl;
+            continue;
+        }
+
+        if(rootVector != 0x00000004 || length < 126){
+            cout << "Unknown root vector " << rootVector << endl;
+            continue;
+        }
+
+        int universe = get16(packet + 113);
+        int sequence = packet[111];
+        int slots = get16(packet + 123) - 1;
+
+        cout << "data    seq=" << setw(3) << sequence
+             << " universe=" << universe
+             << " sync=" << get16(packet + 109)
+             << " priority=" << (int)packet[108]
+             << " slots=" << slots << " [";
+
+        for(int i=0; i<9 && 126 + i < length; i++){
+            cout << (i ? " " : "") << (int)packet[126 + i];
+        }
+
+        cout << "]";
+
+        std::map<int,int>::iterator last = lastSequence.find(universe);
+        if(last != lastSequence.end() && ((last->second + 1) & 0xff) != sequence){
+            cout << " gap after " << last->second;
+        }
+
+        lastSequence[universe] = sequence;
+        cout << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,442 @@
+#include "e131sender.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#define VECTOR_ROOT_E131_DATA                   (0x00000004)
+#define VECTOR_ROOT_E131_EXTENDED               (0x00000008)
+#define VECTOR_E131_DATA_PACKET                 (0x00000002)
+#define VECTOR_E131_EXTENDED_SYNCHRONIZATION    (0x00000001)
+#define VECTOR_DMP_SET_PROPERTY                 (0x02)
+
+//Byte offsets within a data packet
+#define DATA_SYNC_ADDRESS_OFFSET    (109)
+#define DATA_SEQUENCE_OFFSET        (111)
+#define DATA_UNIVERSE_OFFSET        (113)
+#define DATA_SLOTS_OFFSET           (126)
+
+#define SYNC_SEQUENCE_OFFSET        (44)
+
+static const uint8_t ACN_PACKET_IDENTIFIER[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+
+static inline void put16(uint8_t* dst, uint16_t value){
+    dst[0] = value >> 8;
+    dst[1] = value & 0xff;
+}
+
+static inline void put32(uint8_t* dst, uint32_t value){
+    dst[0] = value >> 24;
+    dst[1] = (value >> 16) & 0xff;
+    dst[2] = (value >> 8) & 0xff;
+    dst[3] = value & 0xff;
+}
+
+/*
+ * Preamble, ACN identifier, root PDU header and CID, common to data and sync packets
+ */
+static void fillRootLayer(uint8_t* packet, int packetSize, uint32_t vector, const QByteArray& cid){
+    put16(packet + 0, 0x0010);
+    put16(packet + 2, 0x0000);
+    memcpy(packet + 4, ACN_PACKET_IDENTIFIER, sizeof(ACN_PACKET_IDENTIFIER));
+    put16(packet + 16, 0x7000 | (packetSize - 16));
+    put32(packet + 18, vector);
+    memcpy(packet + 22, cid.constData(), 16);
+}
+
+/*
+ * Universe sync packet, keeps the sequence number already in the packet
+ */
+static void fillSync(uint8_t* packet, const QByteArray& cid, int syncUniverse){
+    uint8_t sequence = packet[SYNC_SEQUENCE_OFFSET];
+
+    memset(packet, 0, E131_SYNC_PACKET_SIZE);
+
+    fillRootLayer(packet, E131_SYNC_PACKET_SIZE, VECTOR_ROOT_E131_EXTENDED, cid);
+
+    put16(packet + 38, 0x7000 | (E131_SYNC_PACKET_SIZE - 38));
+    put32(packet + 40, VECTOR_E131_EXTENDED_SYNCHRONIZATION);
+    packet[SYNC_SEQUENCE_OFFSET] = sequence;
+    put16(packet + 45, syncUniverse);
+}
+
+
+E131SyncSource::E131SyncSource(int syncUniverse){
+    _cid = QUuid::createUuid().toRfc4122();
+    _syncUniverse = qBound(1, syncUniverse, 63999);
+    _pending = 0;
+
+    memset(_syncPacket, 0, sizeof(_syncPacket));
+    fillSync(_syncPacket, _cid, _syncUniverse);
+
+    _socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if(_socket < 0){
+        qCritical() << "E131SyncSource - Failed to create socket: " << strerror(errno);
+        return;
+    }
+
+    int ttl = 1;
+    setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+}
+
+E131SyncSource::~E131SyncSource(){
+    if(_socket >= 0){
+        ::close(_socket);
+    }
+}
+
+QByteArray E131SyncSource::cid() const {
+    return _cid;
+}
+
+int E131SyncSource::syncUniverse() const {
+    return _syncUniverse;
+}
+
+int E131SyncSource::attach(const sockaddr_in& address){
+    QMutexLocker locker(&_lock);
+
+    bool known = false;
+
+    for(int i=0; i<_addresses.size(); i++){
+        if(_addresses[i].sin_addr.s_addr == address.sin_addr.s_addr && _addresses[i].sin_port == address.sin_port){
+            known = true;
+        }
+    }
+
+    //Multicast shards share one group, it gets one sync per frame
+    if(!known){
+        _addresses.append(address);
+    }
+
+    _flushed.append(false);
+    _pending++;
+
+    return _flushed.size() - 1;
+}
+
+bool E131SyncSource::flushed(int sender){
+    QMutexLocker locker(&_lock);
+
+    if(sender < 0 || sender >= _flushed.size() || _flushed[sender]){
+        return true;
+    }
+
+    _flushed[sender] = true;
+    _pending--;
+
+    if(_pending > 0){
+        return true;
+    }
+
+    //Every shard is out, latch them all
+    _flushed.fill(false);
+    _pending = _flushed.size();
+    _syncPacket[SYNC_SEQUENCE_OFFSET]++;
+
+    if(_socket < 0){
+        return false;
+    }
+
+    bool ok = true;
+
+    for(int i=0; i<_addresses.size(); i++){
+        ssize_t result;
+
+        do{
+            result = sendto(_socket, _syncPacket, E131_SYNC_PACKET_SIZE, 0, (const sockaddr*) &_addresses[i], sizeof(sockaddr_in));
+        } while(result < 0 && errno == EINTR);
+
+        if(result < 0){
+            qWarning() << "E131SyncSource::flushed() - sendto failed: " << strerror(errno);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+
+E131Sender::E131Sender(){
+    _socket = -1;
+    _unicast = INADDR_NONE;
+    _port = E131_PORT;
+    _priority = E131_DEFAULT_PRIORITY;
+    _syncUniverse = 0;
+    _syncSource = NULL;
+    _syncIndex = -1;
+    _queuedCount = 0;
+
+    _cid = QUuid::createUuid().toRfc4122();
+    setSourceName("waas pixel_map_node");
+
+    memset(_syncPacket, 0, sizeof(_syncPacket));
+    memset(&_syncAddress, 0, sizeof(_syncAddress));
+}
+
+E131Sender::~E131Sender(){
+    close();
+}
+
+bool E131Sender::open(const QString& destination, int port){
+    close();
+
+    _port = port;
+    _unicast = INADDR_NONE;
+
+    if(!destination.isEmpty()){
+        _unicast = inet_addr(destination.toLatin1().constData());
+
+        if(_unicast == INADDR_NONE){
+            qCritical() << "E131Sender::open() - Invalid destination address " << destination;
+            return false;
+        }
+    }
+
+    _socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if(_socket < 0){
+        qCritical() << "E131Sender::open() - Failed to create socket: " << strerror(errno);
+        return false;
+    }
+
+    //Multicast stays on the local segment, same as olad
+    int ttl = 1;
+    setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+    //Addresses depend on the destination, rebuild them
+    for(QMap<int,int>::const_iterator iter = _packetIndex.constBegin(); iter != _packetIndex.constEnd(); iter++){
+        _addresses[iter.value()] = addressFor(iter.key());
+    }
+
+    fillSyncPacket();
+
+    qDebug() << "E131Sender::open() - Sending to " << (destination.isEmpty() ? QString("multicast") : destination) << ":" << port;
+
+    return true;
+}
+
+void E131Sender::close(){
+    if(_socket >= 0){
+        ::close(_socket);
+        _socket = -1;
+    }
+}
+
+bool E131Sender::isOpen() const {
+    return _socket >= 0;
+}
+
+void E131Sender::setSourceName(const QString& name){
+    //Null terminated, 64 bytes on the wire
+    _sourceName = name.toUtf8().left(63);
+
+    for(QMap<int,int>::const_iterator iter = _packetIndex.constBegin(); iter != _packetIndex.constEnd(); iter++){
+        fillDataHeader(_packets.data() + (iter.value() * E131_DATA_PACKET_SIZE), iter.key());
+    }
+}
+
+void E131Sender::setPriority(int priority){
+    _priority = qBound(0, priority, 200);
+
+    for(QMap<int,int>::const_iterator iter = _packetIndex.constBegin(); iter != _packetIndex.constEnd(); iter++){
+        fillDataHeader(_packets.data() + (iter.value() * E131_DATA_PACKET_SIZE), iter.key());
+    }
+}
+
+void E131Sender::setSyncUniverse(int universe){
+    if(_syncSource != NULL){
+        return;
+    }
+
+    _syncUniverse = qBound(0, universe, 63999);
+
+    for(QMap<int,int>::const_iterator iter = _packetIndex.constBegin(); iter != _packetIndex.constEnd(); iter++){
+        put16(_packets.data() + (iter.value() * E131_DATA_PACKET_SIZE) + DATA_SYNC_ADDRESS_OFFSET, _syncUniverse);
+    }
+
+    fillSyncPacket();
+}
+
+void E131Sender::setSyncSource(E131SyncSource* source){
+    if(source == NULL || _syncSource != NULL){
+        return;
+    }
+
+    _cid = source->cid();
+    _syncUniverse = source->syncUniverse();
+
+    for(QMap<int,int>::const_iterator iter = _packetIndex.constBegin(); iter != _packetIndex.constEnd(); iter++){
+        fillDataHeader(_packets.data() + (iter.value() * E131_DATA_PACKET_SIZE), iter.key());
+    }
+
+    _syncSource = source;
+    _syncIndex = source->attach( addressFor(_syncUniverse) );
+}
+
+sockaddr_in E131Sender::addressFor(int universe) const {
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(_port);
+
+    if(_unicast != INADDR_NONE){
+        address.sin_addr.s_addr = _unicast;
+    }
+    else{
+        //239.255.<universe high byte>.<universe low byte>
+        address.sin_addr.s_addr = htonl( 0xefff0000 | (universe & 0xffff) );
+    }
+
+    return address;
+}
+
+void E131Sender::fillDataHeader(uint8_t* packet, int universe){
+    uint8_t sequence = packet[DATA_SEQUENCE_OFFSET];
+
+    memset(packet, 0, DATA_SLOTS_OFFSET);
+
+    fillRootLayer(packet, E131_DATA_PACKET_SIZE, VECTOR_ROOT_E131_DATA, _cid);
+
+    //Framing layer
+    put16(packet + 38, 0x7000 | (E131_DATA_PACKET_SIZE - 38));
+    put32(packet + 40, VECTOR_E131_DATA_PACKET);
+    memcpy(packet + 44, _sourceName.constData(), _sourceName.size());
+    packet[108] = _priority;
+    put16(packet + DATA_SYNC_ADDRESS_OFFSET, _syncUniverse);
+    packet[DATA_SEQUENCE_OFFSET] = sequence;
+    packet[112] = 0;
+    put16(packet + DATA_UNIVERSE_OFFSET, universe);
+
+    //DMP layer, start code plus 512 slots
+    put16(packet + 115, 0x7000 | (E131_DATA_PACKET_SIZE - 115));
+    packet[117] = VECTOR_DMP_SET_PROPERTY;
+    packet[118] = 0xa1;
+    put16(packet + 119, 0x0000);
+    put16(packet + 121, 0x0001);
+    put16(packet + 123, 513);
+    packet[125] = 0;
+}
+
+void E131Sender::fillSyncPacket(){
+    fillSync(_syncPacket, _cid, _syncUniverse);
+    _syncAddress = addressFor(_syncUniverse);
+}
+
+int E131Sender::packetIndex(int universe){
+    QMap<int,int>::const_iterator iter = _packetIndex.constFind(universe);
+
+    if(iter != _packetIndex.constEnd()){
+        return iter.value();
+    }
+
+    int index = _packetIndex.size();
+
+    _packets.resize((index + 1) * E131_DATA_PACKET_SIZE);
+    uint8_t* packet = _packets.data() + (index * E131_DATA_PACKET_SIZE);
+
+    memset(packet, 0, E131_DATA_PACKET_SIZE);
+    fillDataHeader(packet, universe);
+
+    _addresses.append( addressFor(universe) );
+    _packetIndex.insert(universe, index);
+
+    //One message per universe plus the sync packet, sized once
+    _messages.resize(index + 2);
+    _iovecs.resize(index + 2);
+    _queued.resize(index + 1);
+
+    return index;
+}
+
+void E131Sender::queue(int universe, const uint8_t* channels){
+    if(universe < 1 || universe > 63999){
+        return;
+    }
+
+    int index = packetIndex(universe);
+    uint8_t* packet = _packets.data() + (index * E131_DATA_PACKET_SIZE);
+
+    memcpy(packet + DATA_SLOTS_OFFSET, channels, 512);
+
+    //A universe queued twice is only sent once, with the latest channels
+    for(int i=0; i<_queuedCount; i++){
+        if(_queued[i] == index){
+            return;
+        }
+    }
+
+    packet[DATA_SEQUENCE_OFFSET]++;
+    _queued[_queuedCount++] = index;
+}
+
+int E131Sender::flush(){
+    if(_socket < 0){
+        _queuedCount = 0;
+        return 0;
+    }
+
+    //Idle shards still count towards the shared sync
+    if(_queuedCount == 0){
+        return (_syncSource == NULL || _syncSource->flushed(_syncIndex)) ? 0 : -1;
+    }
+
+    int count = 0;
+
+    for(int i=0; i<_queuedCount; i++){
+        int index = _queued[i];
+
+        _iovecs[count].iov_base = _packets.data() + (index * E131_DATA_PACKET_SIZE);
+        _iovecs[count].iov_len = E131_DATA_PACKET_SIZE;
+
+        memset(&_messages[count], 0, sizeof(struct mmsghdr));
+        _messages[count].msg_hdr.msg_name = &_addresses[index];
+        _messages[count].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        _messages[count].msg_hdr.msg_iov = &_iovecs[count];
+        _messages[count].msg_hdr.msg_iovlen = 1;
+        count++;
+    }
+
+    //Sync goes last so receivers latch the universes sent above
+    if(_syncUniverse > 0 && _syncSource == NULL){
+        _syncPacket[SYNC_SEQUENCE_OFFSET]++;
+
+        _iovecs[count].iov_base = _syncPacket;
+        _iovecs[count].iov_len = E131_SYNC_PACKET_SIZE;
+
+        memset(&_messages[count], 0, sizeof(struct mmsghdr));
+        _messages[count].msg_hdr.msg_name = &_syncAddress;
+        _messages[count].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        _messages[count].msg_hdr.msg_iov = &_iovecs[count];
+        _messages[count].msg_hdr.msg_iovlen = 1;
+        count++;
+    }
+
+    _queuedCount = 0;
+
+    int sent = 0;
+
+    while(sent < count){
+        int result = sendmmsg(_socket, _messages.data() + sent, count - sent, 0);
+
+        if(result < 0){
+            if(errno == EINTR){
+                continue;
+            }
+
+            qWarning() << "E131Sender::flush() - sendmmsg failed: " << strerror(errno);
+            return -1;
+        }
+
+        sent += result;
+    }
+
+    if(_syncSource != NULL && !_syncSource->flushed(_syncIndex)){
+        return -1;
+    }
+
+    return sent;
+}
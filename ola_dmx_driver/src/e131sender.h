@@ -0,0 +1,135 @@
+#ifndef E131SENDER_H
+#define E131SENDER_H
+
+#include <QtCore>
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define E131_PORT (5568)
+#define E131_DATA_PACKET_SIZE (638)
+#define E131_SYNC_PACKET_SIZE (49)
+#define E131_DEFAULT_PRIORITY (100)
+
+/**
+ * @brief   One E1.31 source spread over several E131Senders, for sharded output
+ *
+ *          Attached senders put its CID and sync universe in their data packets, so
+ *          receivers see a single source, and leave the sync packets to it. Once every
+ *          attached sender has flushed since the last sync, one sync packet with the
+ *          shared sequence number goes to each distinct sync address, so receivers latch
+ *          the universes of all shards together. Safe from any thread.
+ */
+class E131SyncSource
+{
+    public:
+        E131SyncSource(int syncUniverse);
+        ~E131SyncSource();
+
+        QByteArray cid() const;
+        int syncUniverse() const;
+
+        /**
+         * @brief   Add a sender whose receivers listen for sync at address
+         * @return  Index the sender reports its flushes with
+         */
+        int attach(const sockaddr_in& address);
+
+        /**
+         * @brief   Sender index finished a flush, sends sync if it was the last one
+         * @return  False if a sync packet could not be sent
+         */
+        bool flushed(int sender);
+
+    private:
+        QMutex _lock;
+        QByteArray _cid;
+        int _syncUniverse;
+        int _socket;
+
+        uint8_t _syncPacket[E131_SYNC_PACKET_SIZE];
+        QVector<sockaddr_in> _addresses;    //Distinct sync destinations
+        QVector<bool> _flushed;             //Per sender, flushed since the last sync
+        int _pending;                       //Senders yet to flush
+};
+
+/**
+ * @brief   Sends DMX universes as E1.31 (streaming ACN) data packets straight to the
+ *          network, without going through olad
+ *
+ *          One packet per universe is built once with its headers filled in, queue() only
+ *          copies the 512 channels and bumps the sequence number. flush() hands every queued
+ *          packet to the kernel in a single sendmmsg() call, followed by a universe sync
+ *          packet when a sync universe is set so receivers latch all universes together.
+ */
+class E131Sender
+{
+    public:
+        E131Sender();
+        ~E131Sender();
+
+        /**
+         * @param destination   Unicast receiver address, empty sends each universe to its
+         *                      239.255.x.y multicast group
+         */
+        bool open(const QString& destination=QString(), int port=E131_PORT);
+        void close();
+        bool isOpen() const;
+
+        void setSourceName(const QString& name);
+        void setPriority(int priority);
+
+        /**
+         * @brief   Universe to send sync packets on after every flush(), 0 disables sync
+         */
+        void setSyncUniverse(int universe);
+
+        /**
+         * @brief   Send as part of source instead of on its own, call after open(). The
+         *          source must outlive the sender.
+         */
+        void setSyncSource(E131SyncSource* source);
+
+        /**
+         * @brief   Add a universe to the next flush(), channels is 512 bytes
+         */
+        void queue(int universe, const uint8_t* channels);
+
+        /**
+         * @return  Number of packets the kernel accepted, -1 on error
+         */
+        int flush();
+
+    private:
+        int packetIndex(int universe);
+        void fillDataHeader(uint8_t* packet, int universe);
+        void fillSyncPacket();
+        sockaddr_in addressFor(int universe) const;
+
+        int _socket;
+        in_addr_t _unicast;         //INADDR_NONE for multicast
+        int _port;
+
+        QByteArray _cid;
+        QByteArray _sourceName;
+        int _priority;
+        int _syncUniverse;
+
+        E131SyncSource* _syncSource;        //NULL when sending sync itself
+        int _syncIndex;
+
+        QMap<int,int> _packetIndex;         //Universe to packet in _packets
+        QVector<uint8_t> _packets;          //E131_DATA_PACKET_SIZE bytes per universe
+        QVector<sockaddr_in> _addresses;    //Per packet
+
+        uint8_t _syncPacket[E131_SYNC_PACKET_SIZE];
+        sockaddr_in _syncAddress;
+
+        QVector<int> _queued;               //Packet indices, _queuedCount in use
+        int _queuedCount;
+        QVector<struct mmsghdr> _messages;
+        QVector<struct iovec> _iovecs;
+};
+
+#endif // E131SENDER_H
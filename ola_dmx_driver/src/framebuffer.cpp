@@ -0,0 +1,336 @@
+#include "framebuffer.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+FrameBuffer::FrameBuffer(){
+    _width = 0;
+    _height = 0;
+    _stride = 0;
+}
+
+FrameBuffer::FrameBuffer(int width, int height){
+    _width = 0;
+    _height = 0;
+    _stride = 0;
+
+    resize(width, height);
+}
+
+void FrameBuffer::resize(int width, int height){
+    if(width == _width && height == _height){
+        return;
+    }
+
+    _width = width;
+    _height = height;
+    _stride = (width + 3) & ~3;
+
+    for(int p=0; p<PlaneCount; p++){
+        _planes[p].fill(0.0f, _stride * _height);
+    }
+}
+
+int FrameBuffer::width() const {
+    return _width;
+}
+
+int FrameBuffer::height() const {
+    return _height;
+}
+
+QSize FrameBuffer::size() const {
+    return QSize(_width, _height);
+}
+
+int FrameBuffer::stride() const {
+    return _stride;
+}
+
+float* FrameBuffer::plane(Plane p){
+    return _planes[p].data();
+}
+
+const float* FrameBuffer::plane(Plane p) const {
+    return _planes[p].constData();
+}
+
+void FrameBuffer::fill(float r, float g, float b, float a){
+    float* red = plane(Red);
+    float* green = plane(Green);
+    float* blue = plane(Blue);
+    float* alpha = plane(Alpha);
+
+    int count = _stride * _height;
+
+    for(int i=0; i<count; i++){
+        red[i] = r * a;
+        green[i] = g * a;
+        blue[i] = b * a;
+        alpha[i] = a;
+    }
+}
+
+void FrameBuffer::fill(const QColor& color){
+    fill(color.redF(), color.greenF(), color.blueF(), color.alphaF());
+}
+
+void FrameBuffer::clear(){
+    for(int p=0; p<PlaneCount; p++){
+        _planes[p].fill(0.0f);
+    }
+}
+
+void FrameBuffer::setPixel(int x, int y, float r, float g, float b, float a){
+    if(x < 0 || y < 0 || x >= _width || y >= _height){
+        return;
+    }
+
+    int i = (y * _stride) + x;
+
+    _planes[Red][i] = r * a;
+    _planes[Green][i] = g * a;
+    _planes[Blue][i] = b * a;
+    _planes[Alpha][i] = a;
+}
+
+void FrameBuffer::fromImage(const QImage& image){
+    QImage premultiplied = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    resize(premultiplied.width(), premultiplied.height());
+
+    const float scale = 1.0f / 255.0f;
+
+    for(int y=0; y<_height; y++){
+        const QRgb* line = (const QRgb*) premultiplied.constScanLine(y);
+        int row = y * _stride;
+
+        for(int x=0; x<_width; x++){
+            QRgb pixel = line[x];
+
+            _planes[Red][row + x] = qRed(pixel) * scale;
+            _planes[Green][row + x] = qGreen(pixel) * scale;
+            _planes[Blue][row + x] = qBlue(pixel) * scale;
+            _planes[Alpha][row + x] = qAlpha(pixel) * scale;
+        }
+    }
+}
+
+static inline uint toByte(float value){
+    return (uint)(qBound(0.0f, value, 1.0f) * 255.0f + 0.5f);
+}
+
+void FrameBuffer::toImage(QImage& image) const {
+    Q_ASSERT(image.format() == QImage::Format_RGB32);
+    Q_ASSERT(image.width() == _width && image.height() == _height);
+
+    const float* red = plane(Red);
+    const float* green = plane(Green);
+    const float* blue = plane(Blue);
+
+    for(int y=0; y<_height; y++){
+        uint* line = (uint*) image.scanLine(y);
+        int row = y * _stride;
+        int x = 0;
+
+#ifdef __SSE2__
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(255.0f);
+        const __m128i opaque = _mm_set1_epi32(0xff000000);
+
+        for(; x + 4 <= _width; x += 4){
+            __m128i r = _mm_cvtps_epi32( _mm_mul_ps( _mm_min_ps(_mm_max_ps(_mm_loadu_ps(red + row + x), zero), one), scale ) );
+            __m128i g = _mm_cvtps_epi32( _mm_mul_ps( _mm_min_ps(_mm_max_ps(_mm_loadu_ps(green + row + x), zero), one), scale ) );
+            __m128i b = _mm_cvtps_epi32( _mm_mul_ps( _mm_min_ps(_mm_max_ps(_mm_loadu_ps(blue + row + x), zero), one), scale ) );
+
+            __m128i pixels = _mm_or_si128( opaque, _mm_slli_epi32(r, 16) );
+            pixels = _mm_or_si128( pixels, _mm_slli_epi32(g, 8) );
+            pixels = _mm_or_si128( pixels, b );
+
+            _mm_storeu_si128( (__m128i*)(line + x), pixels );
+        }
+#endif
+
+        for(; x<_width; x++){
+            line[x] = qRgb( toByte(red[row + x]), toByte(green[row + x]), toByte(blue[row + x]) );
+        }
+    }
+}
+
+void FrameBuffer::gather(const FrameBuffer& src, const QVector<int>& columns, const QVector<int>& rows){
+    Q_ASSERT(columns.size() == rows.size());
+
+    int count = columns.size();
+    resize(count, 1);
+
+    for(int p=0; p<PlaneCount; p++){
+        const float* source = src.plane((Plane)p);
+        float* dest = plane((Plane)p);
+
+        for(int i=0; i<count; i++){
+            int x = columns[i];
+            int y = rows[i];
+
+            if(x < 0 || y < 0 || x >= src.width() || y >= src.height()){
+                dest[i] = 0.0f;
+                continue;
+            }
+
+            dest[i] = source[(y * src.stride()) + x];
+        }
+    }
+}
+
+void FrameBuffer::scatter(QImage& image, const QVector<int>& columns, const QVector<int>& rows) const {
+    Q_ASSERT(image.format() == QImage::Format_RGB32);
+    Q_ASSERT(columns.size() <= _width);
+
+    const float* red = plane(Red);
+    const float* green = plane(Green);
+    const float* blue = plane(Blue);
+
+    for(int i=0; i<columns.size(); i++){
+        int x = columns[i];
+        int y = rows[i];
+
+        if(x < 0 || y < 0 || x >= image.width() || y >= image.height()){
+            continue;
+        }
+
+        ((uint*) image.scanLine(y))[x] = qRgb( toByte(red[i]), toByte(green[i]), toByte(blue[i]) );
+    }
+}
+
+
+/*
+ * Premultiplied blend of one colour channel, s and sa already scaled by the layer opacity
+ */
+template <int MODE>
+static inline float blendScalar(float s, float d, float sa, float da){
+    switch(MODE){
+        case FrameBuffer::Add:         return d + s;
+        case FrameBuffer::Multiply:    return (s * d) + (s * (1.0f - da)) + (d * (1.0f - sa));
+        case FrameBuffer::Screen:      return s + d - (s * d);
+        default:                       return s + (d * (1.0f - sa));
+    }
+}
+
+#ifdef __SSE2__
+template <int MODE>
+static inline __m128 blendVector(__m128 s, __m128 d, __m128 invSa, __m128 invDa){
+    switch(MODE){
+        case FrameBuffer::Add:
+            return _mm_add_ps(d, s);
+
+        case FrameBuffer::Multiply:
+            return _mm_add_ps( _mm_mul_ps(s, _mm_add_ps(d, invDa)), _mm_mul_ps(d, invSa) );
+
+        case FrameBuffer::Screen:
+            return _mm_sub_ps( _mm_add_ps(s, d), _mm_mul_ps(s, d) );
+
+        default:
+            return _mm_add_ps( s, _mm_mul_ps(d, invSa) );
+    }
+}
+#endif
+
+template <int MODE>
+static void compositeKernel(float* const dst[4], const float* const src[4], int count, float opacity){
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128 o = _mm_set1_ps(opacity);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    //count is a multiple of four, rows are padded
+    for(; i<count; i+=4){
+        __m128 sa = _mm_mul_ps( _mm_loadu_ps(src[3] + i), o );
+        __m128 da = _mm_loadu_ps(dst[3] + i);
+        __m128 invSa = _mm_sub_ps(one, sa);
+        __m128 invDa = _mm_sub_ps(one, da);
+
+        for(int c=0; c<3; c++){
+            __m128 s = _mm_mul_ps( _mm_loadu_ps(src[c] + i), o );
+            __m128 d = _mm_loadu_ps(dst[c] + i);
+
+            _mm_storeu_ps( dst[c] + i, blendVector<MODE>(s, d, invSa, invDa) );
+        }
+
+        //Alpha is the union of coverage for every mode
+        _mm_storeu_ps( dst[3] + i, _mm_add_ps(sa, _mm_mul_ps(da, invSa)) );
+    }
+#endif
+
+    for(; i<count; i++){
+        float sa = src[3][i] * opacity;
+        float da = dst[3][i];
+
+        for(int c=0; c<3; c++){
+            dst[c][i] = blendScalar<MODE>(src[c][i] * opacity, dst[c][i], sa, da);
+        }
+
+        dst[3][i] = sa + (da * (1.0f - sa));
+    }
+}
+
+void FrameBuffer::composite(const FrameBuffer& src, BlendMode mode, float opacity){
+    Q_ASSERT(src.size() == size());
+
+    if(src.size() != size() || opacity <= 0.0f){
+        return;
+    }
+
+    float* const dst[4] = { plane(Red), plane(Green), plane(Blue), plane(Alpha) };
+    const float* const source[4] = { src.plane(Red), src.plane(Green), src.plane(Blue), src.plane(Alpha) };
+
+    int count = _stride * _height;
+
+    switch(mode){
+        case Add:       compositeKernel<Add>(dst, source, count, opacity);         break;
+        case Multiply:  compositeKernel<Multiply>(dst, source, count, opacity);    break;
+        case Screen:    compositeKernel<Screen>(dst, source, count, opacity);      break;
+        default:        compositeKernel<Over>(dst, source, count, opacity);        break;
+    }
+}
+
+
+void packMirroredRgb8(const QImage& image, uint8_t* dst, int step){
+    Q_ASSERT(image.format() == QImage::Format_RGB32);
+
+    int width = image.width();
+
+    for(int y=0; y<image.height(); y++){
+        const uint* line = (const uint*) image.constScanLine(y);
+        uint8_t* out = dst + (y * step);
+        int x = 0;
+
+#ifdef __SSSE3__
+        //Four source pixels B,G,R,X in memory, last one first, to R,G,B triplets
+        const __m128i mirror = _mm_setr_epi8(14, 13, 12, 10, 9, 8, 6, 5, 4, 2, 1, 0, -1, -1, -1, -1);
+
+        for(; x + 4 <= width; x += 4, out += 12){
+            __m128i pixels = _mm_loadu_si128( (const __m128i*)(line + width - 4 - x) );
+            __m128i rgb = _mm_shuffle_epi8(pixels, mirror);
+
+            _mm_storel_epi64( (__m128i*) out, rgb );
+
+            int tail = _mm_cvtsi128_si32( _mm_srli_si128(rgb, 8) );
+            memcpy(out + 8, &tail, 4);
+        }
+#endif
+
+        for(; x<width; x++, out += 3){
+            uint pixel = line[width - 1 - x];
+
+            out[0] = qRed(pixel);
+            out[1] = qGreen(pixel);
+            out[2] = qBlue(pixel);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <QtCore>
+#include <QtGui>
+
+/**
+ * @brief   Floating point RGBA image stored as four separate planes (structure of arrays)
+ *
+ *          Colours are premultiplied by alpha and nominally in [0,1], values outside
+ *          that range are kept until the frame is converted for output so additive layers
+ *          do not clip early. Rows are padded to a multiple of four floats so every
+ *          kernel processes whole SSE vectors.
+ */
+class FrameBuffer
+{
+    public:
+        enum Plane { Red=0, Green, Blue, Alpha, PlaneCount };
+        enum BlendMode { Over=0, Add, Multiply, Screen };
+
+        FrameBuffer();
+        FrameBuffer(int width, int height);
+
+        void resize(int width, int height);
+
+        int width() const;
+        int height() const;
+        QSize size() const;
+
+        /**
+         * @brief   Floats between the start of consecutive rows
+         */
+        int stride() const;
+
+        float* plane(Plane p);
+        const float* plane(Plane p) const;
+
+        /**
+         * @brief   Fill with a straight (not premultiplied) colour
+         */
+        void fill(float r, float g, float b, float a=1.0f);
+        void fill(const QColor& color);
+
+        /**
+         * @brief   Transparent black
+         */
+        void clear();
+
+        void setPixel(int x, int y, float r, float g, float b, float a=1.0f);
+
+        /**
+         * @brief   Load from a QImage, any format, alpha is premultiplied on the way in
+         */
+        void fromImage(const QImage& image);
+
+        /**
+         * @brief   Write into a Format_RGB32 image of the same size, clamped to [0,1]. The
+         *          frame is flattened onto black.
+         */
+        void toImage(QImage& image) const;
+
+        /**
+         * @brief   Blend src onto this frame with its alpha scaled by opacity. Both frames
+         *          must be the same size.
+         */
+        void composite(const FrameBuffer& src, BlendMode mode, float opacity=1.0f);
+
+        /**
+         * @brief   Resize to count x 1 and copy the pixels of src at the given coordinates,
+         *          coordinates outside src are transparent
+         */
+        void gather(const FrameBuffer& src, const QVector<int>& columns, const QVector<int>& rows);
+
+        /**
+         * @brief   Write pixel i of this count x 1 frame to (columns[i], rows[i]) of a
+         *          Format_RGB32 image, flattened onto black and clamped to [0,1]
+         */
+        void scatter(QImage& image, const QVector<int>& columns, const QVector<int>& rows) const;
+
+    private:
+        int _width;
+        int _height;
+        int _stride;
+        QVector<float> _planes[PlaneCount];
+};
+
+/**
+ * @brief   Convert a Format_RGB32 image to packed RGB8 rows of step bytes with the x axis
+ *          mirrored, the layout of the animation preview image
+ */
+void packMirroredRgb8(const QImage& image, uint8_t* dst, int step);
+
+#endif // FRAMEBUFFER_H
@@ -0,0 +1,149 @@
+#include "globeprojection.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+GlobeAffine GlobeAffine::identity(){
+    GlobeAffine affine;
+
+    for(int row=0; row<3; row++){
+        for(int col=0; col<4; col++){
+            affine.m[row][col] = (row == col) ? 1.0f : 0.0f;
+        }
+    }
+
+    return affine;
+}
+
+void GlobeAffine::apply(float x, float y, float z, float& outX, float& outY, float& outZ) const {
+    outX = (m[0][0] * x) + (m[0][1] * y) + (m[0][2] * z) + m[0][3];
+    outY = (m[1][0] * x) + (m[1][1] * y) + (m[1][2] * z) + m[1][3];
+    outZ = (m[2][0] * x) + (m[2][1] * y) + (m[2][2] * z) + m[2][3];
+}
+
+void GlobeAffine::apply(float* x, float* y, float* z, int count) const {
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128 row[3][4];
+
+    for(int r=0; r<3; r++){
+        for(int c=0; c<4; c++){
+            row[r][c] = _mm_set1_ps(m[r][c]);
+        }
+    }
+
+    for(; i + 4 <= count; i += 4){
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+
+        __m128 out[3];
+
+        for(int r=0; r<3; r++){
+            out[r] = _mm_add_ps( _mm_add_ps( _mm_mul_ps(row[r][0], px), _mm_mul_ps(row[r][1], py) ),
+                                 _mm_add_ps( _mm_mul_ps(row[r][2], pz), row[r][3] ) );
+        }
+
+        _mm_storeu_ps(x + i, out[0]);
+        _mm_storeu_ps(y + i, out[1]);
+        _mm_storeu_ps(z + i, out[2]);
+    }
+#endif
+
+    for(; i<count; i++){
+        apply(x[i], y[i], z[i], x[i], y[i], z[i]);
+    }
+}
+
+
+GlobeProjection::GlobeProjection(tf::TransformListener* listener){
+    _listener = listener;
+    _baseToGlobes.setIdentity();
+    _scaleX = 1.0;
+    _scaleY = 1.0;
+    _refreshSec = DEFAULT_PROJECTION_REFRESH;
+}
+
+void GlobeProjection::setGlobes(const tf::Transform& globesInBase, double scaleX, double scaleY){
+    QMutexLocker locker(&_lock);
+
+    _baseToGlobes = globesInBase.inverse();
+    _scaleX = scaleX;
+    _scaleY = scaleY;
+
+    QHash<QString, Entry>::iterator iter = _frames.begin();
+
+    for(; iter != _frames.end(); iter++){
+        iter.value().affine = compose(iter.value().sensorInBase);
+    }
+}
+
+void GlobeProjection::setRefreshInterval(double seconds){
+    QMutexLocker locker(&_lock);
+    _refreshSec = qMax(0.0, seconds);
+}
+
+void GlobeProjection::invalidate(){
+    QMutexLocker locker(&_lock);
+    _frames.clear();
+}
+
+bool GlobeProjection::lookup(const std::string& frame, GlobeAffine& affine){
+    QString key = QString::fromStdString(frame);
+    ros::WallTime now = ros::WallTime::now();
+
+    {
+        QMutexLocker locker(&_lock);
+        QHash<QString, Entry>::const_iterator iter = _frames.constFind(key);
+
+        if(iter != _frames.constEnd() && (now - iter.value().lookedUp).toSec() < _refreshSec){
+            affine = iter.value().affine;
+            return true;
+        }
+    }
+
+    //TF is only asked outside the lock, other threads keep using the cached entries
+    tf::StampedTransform sensorInBase;
+
+    try{
+        _listener->lookupTransform("base_link", frame, ros::Time(), sensorInBase);
+    }
+    catch(tf::TransformException& ex){
+        ROS_WARN_THROTTLE(5, "GlobeProjection::lookup() - %s", ex.what());
+        return false;
+    }
+
+    QMutexLocker locker(&_lock);
+
+    Entry entry;
+    entry.sensorInBase = sensorInBase;
+    entry.lookedUp = now;
+    entry.affine = compose(sensorInBase);
+
+    _frames.insert(key, entry);
+    affine = entry.affine;
+
+    return true;
+}
+
+GlobeAffine GlobeProjection::compose(const tf::Transform& sensorInBase) const {
+    tf::Transform sensorToGlobes = _baseToGlobes * sensorInBase;
+
+    const tf::Matrix3x3& basis = sensorToGlobes.getBasis();
+    const tf::Vector3& origin = sensorToGlobes.getOrigin();
+    double scale[3] = { _scaleX, _scaleY, 1.0 };
+
+    GlobeAffine affine;
+
+    for(int row=0; row<3; row++){
+        for(int col=0; col<3; col++){
+            affine.m[row][col] = basis[row][col] * scale[row];
+        }
+
+        affine.m[row][3] = origin[row] * scale[row];
+    }
+
+    return affine;
+}
@@ -0,0 +1,86 @@
+#ifndef GLOBEPROJECTION_H
+#define GLOBEPROJECTION_H
+
+#include <ros/ros.h>
+#include <tf/tf.h>
+#include <tf/transform_listener.h>
+
+#include <QtCore>
+
+#include <string>
+
+#define DEFAULT_PROJECTION_REFRESH (1.0f)
+
+/**
+ * @brief   Affine map from a sensor frame to globe pixels, row major 3x4. x and y come out
+ *          in image pixels, z in metres along globes_link.
+ */
+struct GlobeAffine {
+    float m[3][4];
+
+    static GlobeAffine identity();
+
+    void apply(float x, float y, float z, float& outX, float& outY, float& outZ) const;
+
+    /**
+     * @brief   Transform count points in place, structure of arrays
+     */
+    void apply(float* x, float* y, float* z, int count) const;
+};
+
+/**
+ * @brief   Cached transform from sensor frames to globe pixels
+ *
+ *          The globes_link pose and scale come from the /waas/globes parameters and are
+ *          set directly, so only the sensor to base_link part goes through TF. That part
+ *          is looked up once per frame and again after the refresh interval, every
+ *          lookup() in between is a copy of the cached affine. Safe from any thread.
+ */
+class GlobeProjection
+{
+    public:
+        GlobeProjection(tf::TransformListener* listener);
+
+        /**
+         * @brief   Pose of globes_link in base_link and pixels per metre along its x and y.
+         *          Cached transforms are recomposed without asking TF again.
+         */
+        void setGlobes(const tf::Transform& globesInBase, double scaleX, double scaleY);
+
+        /**
+         * @brief   Seconds until a cached TF lookup is repeated, picks up a sensor that
+         *          was moved. 0 asks TF on every lookup()
+         */
+        void setRefreshInterval(double seconds);
+
+        /**
+         * @brief   Drop every cached TF lookup
+         */
+        void invalidate();
+
+        /**
+         * @brief   Transform from frame to globe pixels
+         * @return  False if TF can not transform frame into base_link yet
+         */
+        bool lookup(const std::string& frame, GlobeAffine& affine);
+
+    private:
+        struct Entry {
+            tf::Transform sensorInBase;
+            ros::WallTime lookedUp;
+            GlobeAffine affine;
+        };
+
+        GlobeAffine compose(const tf::Transform& sensorInBase) const;
+
+        tf::TransformListener* _listener;
+
+        QMutex _lock;
+        QHash<QString, Entry> _frames;
+        tf::Transform _baseToGlobes;
+        double _scaleX;
+        double _scaleY;
+        double _refreshSec;
+};
+
+#endif // GLOBEPROJECTION_H
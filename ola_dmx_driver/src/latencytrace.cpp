@@ -0,0 +1,67 @@
+#include "latencytrace.h"
+
+#include <sstream>
+
+const char* LatencyTrace::hopName(Hop hop){
+    switch(hop){
+        case CaptureToReceive:      return "capture to receive";
+        case ReceiveToRender:       return "receive to render";
+        case RenderToTransmit:      return "render to transmit";
+        case CaptureToTransmit:     return "capture to transmit";
+        default:                    return "unknown";
+    }
+}
+
+void LatencyTrace::record(Hop hop, double ms){
+    QMutexLocker locker(&_lock);
+
+    _hopMs[hop].insert(ms);
+}
+
+static void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, double value){
+    std::ostringstream stream;
+    stream << value;
+
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = stream.str();
+
+    status.values.push_back(kv);
+}
+
+diagnostic_msgs::DiagnosticStatus LatencyTrace::toDiagnostics(const std::string& name){
+    diagnostic_msgs::DiagnosticStatus status;
+
+    status.name = name;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = "OK";
+
+    //Copy and sort outside the lock so recording threads only wait for the copy
+    RollingHistogram hopMs[HopCount];
+
+    {
+        QMutexLocker locker(&_lock);
+
+        for(int i=0; i<HopCount; i++){
+            hopMs[i] = _hopMs[i];
+        }
+    }
+
+    for(int i=0; i<HopCount; i++){
+        double p50, p99, max;
+        hopMs[i].getStats(p50, p99, max);
+
+        std::string key = hopName((Hop)i);
+
+        addValue(status, key + " p50 ms", p50);
+        addValue(status, key + " p99 ms", p99);
+        addValue(status, key + " max ms", max);
+    }
+
+    if(hopMs[CaptureToTransmit].count() == 0){
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = "No blobs";
+    }
+
+    return status;
+}
@@ -0,0 +1,40 @@
+#ifndef LATENCYTRACE_H
+#define LATENCYTRACE_H
+
+#include <string>
+
+#include <QtCore>
+
+#include <diagnostic_msgs/DiagnosticStatus.h>
+
+#include "rollinghistogram.h"
+
+/**
+ * @brief   Latency of each hop from Kinect capture to DMX send, in milliseconds
+ *
+ *          Capture to perception done is reported by point_downsample as its sensor age,
+ *          the hops here start where pixel_map_node receives the markers. Transmit is when
+ *          the sink flushed the frame, recorded on the output threads when sending is
+ *          asynchronous, once per frame when sharded. record() only holds the lock for
+ *          the insert and toDiagnostics() sorts copies, so no sample is lost to contention.
+ */
+class LatencyTrace
+{
+    public:
+        enum Hop { CaptureToReceive=0, ReceiveToRender, RenderToTransmit, CaptureToTransmit, HopCount };
+
+        void record(Hop hop, double ms);
+
+        /**
+         * @brief   Percentiles of every hop over the recent window
+         */
+        diagnostic_msgs::DiagnosticStatus toDiagnostics(const std::string& name);
+
+        static const char* hopName(Hop hop);
+
+    private:
+        QMutex _lock;
+        RollingHistogram _hopMs[HopCount];
+};
+
+#endif // LATENCYTRACE_H
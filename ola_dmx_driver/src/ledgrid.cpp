@@ -0,0 +1,147 @@
+#include "ledgrid.h"
+
+#include <math.h>
+
+LedGrid::LedGrid(){
+    clear();
+}
+
+void LedGrid::clear(){
+    _minX = 0.0f;
+    _minY = 0.0f;
+    _cellSize = DEFAULT_LED_GRID_CELL;
+    _columns = 0;
+    _rows = 0;
+
+    _cellStart.clear();
+    _leds.clear();
+    _x.clear();
+    _y.clear();
+    _z.clear();
+}
+
+int LedGrid::count() const {
+    return _leds.size();
+}
+
+void LedGrid::build(const float* x, const float* y, const float* z, int count, float cellSize){
+    clear();
+
+    if(count <= 0){
+        return;
+    }
+
+    float minX = x[0], maxX = x[0];
+    float minY = y[0], maxY = y[0];
+
+    for(int i=1; i<count; i++){
+        minX = qMin(minX, x[i]);
+        maxX = qMax(maxX, x[i]);
+        minY = qMin(minY, y[i]);
+        maxY = qMax(maxY, y[i]);
+    }
+
+    _cellSize = (cellSize > 0.0f) ? cellSize : DEFAULT_LED_GRID_CELL;
+
+    //Sparse installations spread over a large area would allocate mostly empty cells
+    while( ((qint64)((maxX - minX) / _cellSize) + 1) * ((qint64)((maxY - minY) / _cellSize) + 1) > LED_GRID_MAX_CELLS ){
+        _cellSize *= 2.0f;
+    }
+
+    _minX = minX;
+    _minY = minY;
+    _columns = (int)((maxX - minX) / _cellSize) + 1;
+    _rows = (int)((maxY - minY) / _cellSize) + 1;
+
+    int cells = _columns * _rows;
+    QVector<int> cellOf(count);
+
+    //Counting sort by cell, _cellStart holds the counts first
+    _cellStart.fill(0, cells + 1);
+
+    for(int i=0; i<count; i++){
+        int column = qMin((int)((x[i] - _minX) / _cellSize), _columns - 1);
+        int row = qMin((int)((y[i] - _minY) / _cellSize), _rows - 1);
+
+        cellOf[i] = (row * _columns) + column;
+        _cellStart[ cellOf[i] + 1 ]++;
+    }
+
+    for(int cell=0; cell<cells; cell++){
+        _cellStart[cell + 1] += _cellStart[cell];
+    }
+
+    _leds.resize(count);
+    _x.resize(count);
+    _y.resize(count);
+    _z.resize(count);
+
+    QVector<int> next = _cellStart;
+
+    for(int i=0; i<count; i++){
+        int entry = next[ cellOf[i] ]++;
+
+        _leds[entry] = i;
+        _x[entry] = x[i];
+        _y[entry] = y[i];
+        _z[entry] = (z != NULL) ? z[i] : 0.0f;
+    }
+}
+
+int LedGrid::query(float x, float y, float radius, QVector<int>& out) const {
+    return search<false>(x, y, 0.0f, radius, out);
+}
+
+int LedGrid::query(float x, float y, float z, float radius, QVector<int>& out) const {
+    return search<true>(x, y, z, radius, out);
+}
+
+template <bool Sphere>
+int LedGrid::search(float x, float y, float z, float radius, QVector<int>& out) const {
+    if(_leds.isEmpty() || radius < 0.0f){
+        return 0;
+    }
+
+    int firstColumn = (int)floorf((x - radius - _minX) / _cellSize);
+    int lastColumn = (int)floorf((x + radius - _minX) / _cellSize);
+    int firstRow = (int)floorf((y - radius - _minY) / _cellSize);
+    int lastRow = (int)floorf((y + radius - _minY) / _cellSize);
+
+    if(lastColumn < 0 || lastRow < 0 || firstColumn >= _columns || firstRow >= _rows){
+        return 0;
+    }
+
+    firstColumn = qMax(firstColumn, 0);
+    firstRow = qMax(firstRow, 0);
+    lastColumn = qMin(lastColumn, _columns - 1);
+    lastRow = qMin(lastRow, _rows - 1);
+
+    float radius2 = radius * radius;
+    int found = 0;
+
+    for(int row=firstRow; row<=lastRow; row++){
+        int cell = (row * _columns) + firstColumn;
+
+        //Cells of a row are contiguous, walk the whole span in one go
+        int begin = _cellStart[cell];
+        int end = _cellStart[cell + (lastColumn - firstColumn) + 1];
+
+        for(int entry=begin; entry<end; entry++){
+            float dx = _x[entry] - x;
+            float dy = _y[entry] - y;
+            float distance2 = (dx*dx) + (dy*dy);
+
+            if(Sphere){
+                float dz = _z[entry] - z;
+                distance2 += dz*dz;
+            }
+
+            if(distance2 <= radius2){
+                out.append(_leds[entry]);
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,62 @@
+#ifndef LEDGRID_H
+#define LEDGRID_H
+
+#include <QtCore>
+
+#define DEFAULT_LED_GRID_CELL (0.5f)      //Metres, a few globes per cell
+#define LED_GRID_MAX_CELLS (1 << 20)
+
+/**
+ * @brief   Uniform grid over LED positions for radius queries
+ *
+ *          Cells cover the x/y plane. Each cell's LEDs are stored back to back with their
+ *          positions, so a query only touches the cells overlapping the search circle and
+ *          costs O(cells + k) rather than a scan over every LED. Built once per map, read
+ *          only afterwards.
+ */
+class LedGrid
+{
+    public:
+        LedGrid();
+
+        /**
+         * @brief   Index count LEDs. z may be NULL for a flat layout.
+         * @param cellSize  Cell edge in the units of x and y, grown if the grid would
+         *                  have more than LED_GRID_MAX_CELLS cells
+         */
+        void build(const float* x, const float* y, const float* z, int count, float cellSize=DEFAULT_LED_GRID_CELL);
+        void clear();
+
+        int count() const;
+
+        /**
+         * @brief   Append the LEDs within radius of (x, y) in the x/y plane to out, whatever
+         *          their height. Suits people standing under the LEDs.
+         * @return  Number of LEDs appended
+         */
+        int query(float x, float y, float radius, QVector<int>& out) const;
+
+        /**
+         * @brief   Append the LEDs within radius of (x, y, z) to out
+         * @return  Number of LEDs appended
+         */
+        int query(float x, float y, float z, float radius, QVector<int>& out) const;
+
+    private:
+        template <bool Sphere>
+        int search(float x, float y, float z, float radius, QVector<int>& out) const;
+
+        float _minX;
+        float _minY;
+        float _cellSize;
+        int _columns;
+        int _rows;
+
+        QVector<int> _cellStart;        //First entry of each cell, _columns * _rows + 1 entries
+        QVector<int> _leds;             //LED index of each entry, grouped by cell
+        QVector<float> _x;              //Position of each entry
+        QVector<float> _y;
+        QVector<float> _z;
+};
+
+#endif // LEDGRID_H
@@ -1,81 +1,126 @@
 #include "olamanager.h"
 
-#include <ola/DmxBuffer.h>
-#include <ola/Logging.h>
-#include <ola/StreamingClient.h>
-
-OlaManager::OlaManager(QObject *parent) :
+OlaManager::OlaManager(OutputSink* sink, QObject *parent) :
     QObject(parent)
 {
+    _keepaliveMs = DEFAULT_KEEPALIVE_MS;
+    _clock.start();
 
-    // turn on OLA logging
-    ola::InitLogging(ola::OLA_LOG_WARN, ola::OLA_LOG_STDERR);
+    _sink = (sink != NULL) ? sink : new OlaSink();
+}
 
-    _client = new ola::StreamingClient();
+OlaManager::~OlaManager(){
+    delete _sink;
+}
 
-    // Setup the client, this connects to the server
-    if (!_client->Setup()) {
-        qDebug() << "ERROR: OLA Setup failed" << endl;
+void OlaManager::setSink(OutputSink* sink){
+    if(sink == NULL || sink == _sink){
         return;
     }
 
-    for(int i=1; i<11; i++){
-        ola::DmxBuffer* buffer = new ola::DmxBuffer();
-        buffer->Blackout();
+    delete _sink;
+    _sink = sink;
 
-        _buffers.insert(i, buffer);
-    }
+    //Resend everything through the new output
+    _lastSentMs.fill(-1);
 }
 
+OutputSink* OlaManager::sink() const {
+    return _sink;
+}
 
 void OlaManager::sendBuffers(){
-    QList<int> universes = _buffers.keys();
+    qint64 nowMs = _clock.elapsed();
 
-    for(int i=0; i<universes.size(); i++){
+    const uint8_t* channels = _channels.constData();
+    uint8_t* sent = _sentChannels.data();
+    qint64* lastSentMs = _lastSentMs.data();
 
-        int universe = universes[i];
+    _flushed.clear();
+
+    for(int i=0; i<_universes.size(); i++, channels += DMX_UNIVERSE_SIZE, sent += DMX_UNIVERSE_SIZE){
+        bool changed = memcmp(channels, sent, DMX_UNIVERSE_SIZE) != 0;
+        bool expired = lastSentMs[i] < 0 || (nowMs - lastSentMs[i]) >= _keepaliveMs;
+
+        if(!changed && !expired){
+            continue;
+        }
+
+        //A failed universe stays unsent and is retried next frame
+        if(!_sink->send(_universes[i], channels)){
+            continue;
+        }
 
-        _client->SendDmx(universe, *_buffers[universe]);
+        memcpy(sent, channels, DMX_UNIVERSE_SIZE);
+        lastSentMs[i] = nowMs;
+        _flushed.append(i);
+    }
 
+    //End of frame, batching sinks send here and only then know if it worked
+    if(!_sink->flush()){
+        for(int i=0; i<_flushed.size(); i++){
+            lastSentMs[ _flushed[i] ] = -1;
+        }
     }
 }
 
-void OlaManager::blackout(){
-    QList<int> universes = _buffers.keys();
+void OlaManager::setKeepaliveMs(int ms){
+    _keepaliveMs = qMax(0, ms);
+}
 
-    for(int i=0; i<universes.size(); i++){
-        int universe = universes[i];
-        _buffers[universe]->Blackout();
-    }
+int OlaManager::keepaliveMs() const {
+    return _keepaliveMs;
 }
 
-void OlaManager::lightsOn(int value){
-    QList<int> universes = _buffers.keys();
+void OlaManager::blackout(){
+    _channels.fill(0);
+}
 
-    for(int i=0; i<universes.size(); i++){
-        int universe = universes[i];
-        _buffers[universe]->SetRangeToValue(0, value, 512);
-    }
+void OlaManager::lightsOn(int value){
+    _channels.fill((uint8_t) value);
 }
 
-ola::DmxBuffer* OlaManager::getBuffer(int universe){
-    if(_buffers.contains(universe)){
-        return _buffers[universe];
+int OlaManager::universeOffset(int universe){
+    QHash<int,int>::const_iterator iter = _slots.constFind(universe);
+
+    if(iter != _slots.constEnd()){
+        return iter.value() * DMX_UNIVERSE_SIZE;
     }
 
-    ola::DmxBuffer* buffer = new ola::DmxBuffer;
+    int slot = _universes.size();
+    int offset = slot * DMX_UNIVERSE_SIZE;
+
+    _channels.resize(offset + DMX_UNIVERSE_SIZE);
+    memset(_channels.data() + offset, 0, DMX_UNIVERSE_SIZE);
+
+    _sentChannels.resize(offset + DMX_UNIVERSE_SIZE);
+    memset(_sentChannels.data() + offset, 0, DMX_UNIVERSE_SIZE);
 
-    _buffers.insert(universe, buffer);
+    _universes.append(universe);
+    _lastSentMs.append(-1);
+    _slots.insert(universe, slot);
+
+    return offset;
+}
+
+const QVector<int>& OlaManager::universes() const {
+    return _universes;
+}
 
-    return buffer;
+uint8_t* OlaManager::channelData(){
+    return _channels.data();
 }
 
 void OlaManager::setPixel(DmxAddress address, QColor color){
-    ola::DmxBuffer* buffer = getBuffer(address.universe);
+    if(address.offset < 0 || address.offset + 3 > DMX_UNIVERSE_SIZE){
+        return;
+    }
 
-    uint8_t colorData[3] = {(uint8_t)color.red(), (uint8_t)color.green(), (uint8_t)color.blue()};
+    uint8_t* channels = _channels.data() + universeOffset(address.universe) + address.offset;
 
-    buffer->SetRange(address.offset, colorData, 3);
+    channels[0] = (uint8_t)color.red();
+    channels[1] = (uint8_t)color.green();
+    channels[2] = (uint8_t)color.blue();
 }
 
 
@@ -91,16 +136,9 @@ void OlaManager::updateBuffers(QMap<int,ola::DmxBuffer> data){
 
 
 void OlaManager::updateBuffer(int universe, ola::DmxBuffer& data){
-    ola::DmxBuffer* buffer = new ola::DmxBuffer(data);
-
-    if( !_buffers.contains(universe) ){
-        _buffers.insert( universe, buffer);
-        return;
-    }
+    int offset = universeOffset(universe);
+    unsigned int length = DMX_UNIVERSE_SIZE;
 
-    _buffers[universe] = buffer;
+    memset(_channels.data() + offset, 0, DMX_UNIVERSE_SIZE);
+    data.Get(_channels.data() + offset, &length);
 }
-
-
-
-
@@ -6,37 +6,86 @@
 #include <QObject>
 
 #include <ola/DmxBuffer.h>
-#include <ola/Logging.h>
-#include <ola/StreamingClient.h>
 
 #include "utils.h"
+#include "outputsink.h"
+
+#define DMX_UNIVERSE_SIZE (512)
+#define DEFAULT_KEEPALIVE_MS (1000)
 
 class OlaManager : public QObject
 {
     Q_OBJECT
     public:
-        explicit OlaManager(QObject *parent = 0);
+        /**
+         * @param sink  Where universes are sent, owned by the manager. NULL sends through
+         *              a local olad.
+         */
+        explicit OlaManager(OutputSink* sink = NULL, QObject *parent = 0);
+        ~OlaManager();
+
+        /**
+         * @brief   Replace the output, the old sink is deleted and every universe is resent
+         */
+        void setSink(OutputSink* sink);
+        OutputSink* sink() const;
 
         void updateBuffers(QMap<int,ola::DmxBuffer> data);
         void updateBuffer(int universe, ola::DmxBuffer& data);
 
         void setPixel(DmxAddress address, QColor color);
 
-        ola::DmxBuffer* getBuffer(int universe);
+        /**
+         * @brief   Byte offset of the universe within channelData(), the universe is
+         *          allocated (blacked out) on first use. Any number of universes can be
+         *          used, they are stored back to back in the order they were allocated.
+         */
+        int universeOffset(int universe);
+
+        /**
+         * @brief   Universes in allocation order, universe i is at offset i * DMX_UNIVERSE_SIZE
+         */
+        const QVector<int>& universes() const;
+
+        /**
+         * @brief   Channel values of every universe, DMX_UNIVERSE_SIZE bytes per universe
+         *          at the offset returned by universeOffset(). The pointer is invalidated
+         *          when a new universe is allocated.
+         */
+        uint8_t* channelData();
 
         void blackout();
         void lightsOn(int value);
-        
+
+        /**
+         * @brief   Universes are only sent when their channels change, unchanged universes
+         *          are resent at this interval so receivers do not time out. Zero sends
+         *          every universe on every call to sendBuffers(). Call from the thread
+         *          that calls sendBuffers().
+         */
+        void setKeepaliveMs(int ms);
+        int keepaliveMs() const;
+
     signals:
 
     public slots:
         void sendBuffers();
 
-        
+
 
     private:
-        ola::StreamingClient* _client;
-        QMap<int,ola::DmxBuffer*> _buffers;
+        OutputSink* _sink;
+
+        QHash<int,int> _slots;              //Universe to index in _universes
+        QVector<int> _universes;
+        QVector<uint8_t> _channels;
+
+        //Channels as last sent and when (-1 for never), same order as _universes
+        QVector<uint8_t> _sentChannels;
+        QVector<qint64> _lastSentMs;
+        QVector<int> _flushed;              //Slots sent since the last flush
+        QElapsedTimer _clock;
+        int _keepaliveMs;
 };
 
 #endif // OLAMANAGER_H
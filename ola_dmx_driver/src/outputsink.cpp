@@ -0,0 +1,415 @@
+#include "outputsink.h"
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ola/DmxBuffer.h>
+#include <ola/Logging.h>
+
+#include "monotonicclock.h"
+#include <ola/StreamingClient.h>
+
+OutputSink::~OutputSink(){
+}
+
+bool OutputSink::flush(){
+    return true;
+}
+
+
+OlaSink::OlaSink(){
+    // turn on OLA logging
+    ola::InitLogging(ola::OLA_LOG_WARN, ola::OLA_LOG_STDERR);
+
+    _client = new ola::StreamingClient();
+    _buffer = new ola::DmxBuffer();
+
+    // Setup the client, this connects to the server
+    _connected = _client->Setup();
+
+    if(!_connected){
+        qDebug() << "ERROR: OLA Setup failed" << endl;
+    }
+}
+
+OlaSink::~OlaSink(){
+    delete _client;
+    delete _buffer;
+}
+
+bool OlaSink::isConnected() const {
+    return _connected;
+}
+
+bool OlaSink::send(int universe, const uint8_t* channels){
+    if(!_connected){
+        return false;
+    }
+
+    _buffer->Set(channels, OUTPUT_SINK_SIZE);
+    return _client->SendDmx(universe, *_buffer);
+}
+
+QString OlaSink::name() const {
+    return "ola";
+}
+
+
+E131Sink::E131Sink(){
+}
+
+E131Sender& E131Sink::sender(){
+    return _sender;
+}
+
+bool E131Sink::send(int universe, const uint8_t* channels){
+    _sender.queue(universe, channels);
+    return true;
+}
+
+bool E131Sink::flush(){
+    return _sender.flush() >= 0;
+}
+
+QString E131Sink::name() const {
+    return "e131";
+}
+
+
+NullSink::NullSink(){
+    _universes = 0;
+    _frames = 0;
+}
+
+quint64 NullSink::universes() const {
+    return _universes;
+}
+
+quint64 NullSink::frames() const {
+    return _frames;
+}
+
+bool NullSink::send(int universe, const uint8_t* channels){
+    Q_UNUSED(universe);
+    Q_UNUSED(channels);
+
+    _universes++;
+    return true;
+}
+
+bool NullSink::flush(){
+    _frames++;
+    return true;
+}
+
+QString NullSink::name() const {
+    return "null";
+}
+
+FileSink::FileSink(const QString& path) :
+    _file(path)
+{
+    _frame = 0;
+    _clock.start();
+
+    if(!_file.open(QIODevice::WriteOnly | QIODevice::Append)){
+        qCritical() << "FileSink - Failed to open " << path << ": " << _file.errorString();
+    }
+}
+
+FileSink::~FileSink(){
+    _file.close();
+}
+
+bool FileSink::isOpen() const {
+    return _file.isOpen();
+}
+
+bool FileSink::send(int universe, const uint8_t* channels){
+    if(!_file.isOpen()){
+        return false;
+    }
+
+    uint8_t header[16];
+    quint64 stampNs = monotonicNs();
+
+    qToLittleEndian<quint64>(stampNs, header);
+    qToLittleEndian<quint32>(_frame, header + 8);
+    qToLittleEndian<quint16>(universe, header + 12);
+    qToLittleEndian<quint16>(OUTPUT_SINK_SIZE, header + 14);
+
+    bool ok = _file.write((const char*) header, sizeof(header)) == sizeof(header);
+    ok = ok && _file.write((const char*) channels, OUTPUT_SINK_SIZE) == OUTPUT_SINK_SIZE;
+
+    return ok;
+}
+
+bool FileSink::flush(){
+    _frame++;
+    return _file.flush();
+}
+
+QString FileSink::name() const {
+    return QString("file:%1").arg(_file.fileName());
+}
+
+
+ShmSink::ShmSink(const QString& name, int slotCount, int maxUniverses){
+    _name = name.startsWith('/') ? name : QString("/") + name;
+    _fd = -1;
+    _memory = NULL;
+    _header = NULL;
+    _pending = 0;
+    _overflowLogged = false;
+
+    slotCount = qMax(2, slotCount);
+    maxUniverses = qMax(1, maxUniverses);
+
+    size_t slotSize = sizeof(ShmSlot) + (maxUniverses * sizeof(quint16)) + (maxUniverses * OUTPUT_SINK_SIZE);
+    slotSize = (slotSize + 63) & ~((size_t)63);
+
+    _size = sizeof(ShmHeader) + (slotCount * slotSize);
+
+    _fd = shm_open(_name.toLatin1().constData(), O_CREAT | O_RDWR, 0644);
+
+    if(_fd < 0){
+        qCritical() << "ShmSink - shm_open " << _name << " failed: " << strerror(errno);
+        return;
+    }
+
+    if(ftruncate(_fd, _size) != 0){
+        qCritical() << "ShmSink - ftruncate " << _name << " failed: " << strerror(errno);
+        return;
+    }
+
+    void* memory = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+
+    if(memory == MAP_FAILED){
+        qCritical() << "ShmSink - mmap " << _name << " failed: " << strerror(errno);
+        return;
+    }
+
+    _memory = (uint8_t*) memory;
+    memset(_memory, 0, _size);
+
+    _header = (ShmHeader*) _memory;
+    memcpy(_header->magic, "WAASDMX1", 8);
+    _header->slotCount = slotCount;
+    _header->maxUniverses = maxUniverses;
+    _header->slotSize = slotSize;
+    _header->frames = 0;
+}
+
+ShmSink::~ShmSink(){
+    if(_memory != NULL){
+        munmap(_memory, _size);
+    }
+
+    if(_fd >= 0){
+        ::close(_fd);
+        shm_unlink(_name.toLatin1().constData());
+    }
+}
+
+bool ShmSink::isOpen() const {
+    return _header != NULL;
+}
+
+uint8_t* ShmSink::slot(quint64 frame) const {
+    return _memory + sizeof(ShmHeader) + ((frame % _header->slotCount) * _header->slotSize);
+}
+
+bool ShmSink::send(int universe, const uint8_t* channels){
+    if(_header == NULL){
+        return false;
+    }
+
+    if(_pending >= _header->maxUniverses){
+        if(!_overflowLogged){
+            qWarning() << "ShmSink - " << _name << " holds " << _header->maxUniverses
+                       << " universes per frame, dropping universe " << universe << " and any beyond it";
+            _overflowLogged = true;
+        }
+
+        return false;
+    }
+
+    uint8_t* current = slot(_header->frames);
+    ShmSlot* info = (ShmSlot*) current;
+
+    //First universe of the frame, mark the slot as being written
+    if(_pending == 0){
+        info->sequence++;
+        __sync_synchronize();
+    }
+
+    quint16* universes = (quint16*)(current + sizeof(ShmSlot));
+    uint8_t* data = current + sizeof(ShmSlot) + (_header->maxUniverses * sizeof(quint16));
+
+    universes[_pending] = universe;
+    memcpy(data + (_pending * OUTPUT_SINK_SIZE), channels, OUTPUT_SINK_SIZE);
+
+    _pending++;
+
+    return true;
+}
+
+bool ShmSink::flush(){
+    if(_header == NULL){
+        return false;
+    }
+
+    if(_pending == 0){
+        return true;
+    }
+
+    ShmSlot* info = (ShmSlot*) slot(_header->frames);
+
+    info->universeCount = _pending;
+    info->stampNs = monotonicNs();
+
+    __sync_synchronize();
+    info->sequence++;
+    _header->frames++;
+    __sync_synchronize();
+
+    _pending = 0;
+
+    return true;
+}
+
+QString ShmSink::name() const {
+    return QString("shm:%1").arg(_name);
+}
+
+
+FanoutSink::~FanoutSink(){
+    qDeleteAll(_sinks);
+}
+
+void FanoutSink::append(OutputSink* sink){
+    _sinks.append(sink);
+}
+
+int FanoutSink::count() const {
+    return _sinks.size();
+}
+
+bool FanoutSink::send(int universe, const uint8_t* channels){
+    bool ok = true;
+
+    for(int i=0; i<_sinks.size(); i++){
+        ok = _sinks[i]->send(universe, channels) && ok;
+    }
+
+    return ok;
+}
+
+bool FanoutSink::flush(){
+    bool ok = true;
+
+    for(int i=0; i<_sinks.size(); i++){
+        ok = _sinks[i]->flush() && ok;
+    }
+
+    return ok;
+}
+
+QString FanoutSink::name() const {
+    QStringList names;
+
+    for(int i=0; i<_sinks.size(); i++){
+        names.append( _sinks[i]->name() );
+    }
+
+    return names.join(",");
+}
+
+
+OutputSinkOptions::OutputSinkOptions(){
+    e131Port = E131_PORT;
+    e131SyncUniverse = 0;
+    e131Priority = E131_DEFAULT_PRIORITY;
+    e131SyncSource = NULL;
+}
+
+static OutputSink* createSingleSink(const QString& entry, const OutputSinkOptions& options){
+    QString type = entry.section(':', 0, 0).trimmed().toLower();
+    QString argument = entry.section(':', 1).trimmed();
+
+    if(type == "ola"){
+        return new OlaSink();
+    }
+    else if(type == "null"){
+        return new NullSink();
+    }
+    else if(type == "e131"){
+        E131Sink* sink = new E131Sink();
+        sink->sender().setPriority(options.e131Priority);
+        sink->sender().setSyncUniverse(options.e131SyncUniverse);
+
+        if(!sink->sender().open(argument, options.e131Port)){
+            delete sink;
+            return NULL;
+        }
+
+        sink->sender().setSyncSource(options.e131SyncSource);
+
+        return sink;
+    }
+    else if(type == "file"){
+        FileSink* sink = new FileSink(argument);
+
+        if(argument.isEmpty() || !sink->isOpen()){
+            delete sink;
+            return NULL;
+        }
+
+        return sink;
+    }
+    else if(type == "shm"){
+        ShmSink* sink = new ShmSink(argument.isEmpty() ? QString("waas_dmx") : argument);
+
+        if(!sink->isOpen()){
+            delete sink;
+            return NULL;
+        }
+
+        return sink;
+    }
+
+    qCritical() << "createOutputSink() - Unknown output " << entry;
+    return NULL;
+}
+
+OutputSink* createOutputSink(const QString& spec, const OutputSinkOptions& options){
+    QStringList entries = spec.split(',', QString::SkipEmptyParts);
+
+    if(entries.isEmpty()){
+        qCritical() << "createOutputSink() - Empty output spec";
+        return NULL;
+    }
+
+    if(entries.size() == 1){
+        return createSingleSink(entries.first(), options);
+    }
+
+    FanoutSink* fanout = new FanoutSink();
+
+    for(int i=0; i<entries.size(); i++){
+        OutputSink* sink = createSingleSink(entries[i], options);
+
+        if(sink == NULL){
+            delete fanout;
+            return NULL;
+        }
+
+        fanout->append(sink);
+    }
+
+    return fanout;
+}
@@ -0,0 +1,214 @@
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include <QtCore>
+
+#include <stdint.h>
+
+#include "e131sender.h"
+
+namespace ola {
+    class StreamingClient;
+    class DmxBuffer;
+}
+
+#define OUTPUT_SINK_SIZE (512)
+
+/**
+ * @brief   Destination for DMX universes. OlaManager calls send() for every universe
+ *          that needs to go out this frame and flush() once at the end of the frame.
+ *          channels is always OUTPUT_SINK_SIZE bytes and only valid during the call.
+ *          Both return false when the output failed.
+ */
+class OutputSink
+{
+    public:
+        virtual ~OutputSink();
+
+        virtual bool send(int universe, const uint8_t* channels) = 0;
+        virtual bool flush();
+
+        virtual QString name() const = 0;
+};
+
+/**
+ * @brief   Hands universes to a local olad through ola::StreamingClient
+ */
+class OlaSink : public OutputSink
+{
+    public:
+        OlaSink();
+        virtual ~OlaSink();
+
+        /**
+         * @brief   False if olad could not be reached, nothing is sent then
+         */
+        bool isConnected() const;
+
+        virtual bool send(int universe, const uint8_t* channels);
+        virtual QString name() const;
+
+    private:
+        ola::StreamingClient* _client;
+        ola::DmxBuffer* _buffer;
+        bool _connected;
+};
+
+/**
+ * @brief   E1.31 straight from this process, see E131Sender
+ */
+class E131Sink : public OutputSink
+{
+    public:
+        E131Sink();
+
+        E131Sender& sender();
+
+        virtual bool send(int universe, const uint8_t* channels);
+        virtual bool flush();
+        virtual QString name() const;
+
+    private:
+        E131Sender _sender;
+};
+
+/**
+ * @brief   Discards everything and counts it, for running and benchmarking headless
+ */
+class NullSink : public OutputSink
+{
+    public:
+        NullSink();
+
+        quint64 universes() const;
+        quint64 frames() const;
+
+        virtual bool send(int universe, const uint8_t* channels);
+        virtual bool flush();
+        virtual QString name() const;
+
+    private:
+        quint64 _universes;
+        quint64 _frames;
+};
+
+/**
+ * @brief   Appends every universe sent to a file. Each record is a 16 byte little endian
+ *          header {uint64 monotonic ns, uint32 frame, uint16 universe, uint16 length}
+ *          followed by the channels. OlaManager only sends changed universes and
+ *          keepalives, so a frame holds the universes that went out, not the whole rig.
+ */
+class FileSink : public OutputSink
+{
+    public:
+        FileSink(const QString& path);
+        virtual ~FileSink();
+
+        bool isOpen() const;
+
+        virtual bool send(int universe, const uint8_t* channels);
+        virtual bool flush();
+        virtual QString name() const;
+
+    private:
+        QFile _file;
+        quint32 _frame;
+        QElapsedTimer _clock;
+};
+
+/**
+ * @brief   Ring of recent frames in POSIX shared memory for viewers and test harnesses in
+ *          other processes
+ *
+ *          A slot holds the universes sent that frame. OlaManager only sends changed
+ *          universes and keepalives, so readers that want the state of every universe
+ *          keep the newest copy of each one they have seen. A frame with more than
+ *          maxUniverses universes is cut short, send() fails for the rest and a
+ *          warning is logged once.
+ *
+ *          The segment starts with a ShmHeader followed by slotCount slots. Each slot is a
+ *          ShmSlot followed by maxUniverses universe numbers (uint16) and maxUniverses
+ *          blocks of 512 channels. Slots are written seqlock style: sequence is odd while
+ *          the slot is being written, readers retry if it changed under them.
+ *          header.frames counts the completed frames, the newest is in slot
+ *          (frames - 1) % slotCount.
+ */
+class ShmSink : public OutputSink
+{
+    public:
+        struct ShmHeader {
+            char magic[8];                  //"WAASDMX1"
+            quint32 slotCount;
+            quint32 maxUniverses;
+            quint32 slotSize;               //Bytes per slot including the ShmSlot
+            quint32 reserved;
+            quint64 frames;
+        };
+
+        struct ShmSlot {
+            quint64 sequence;
+            quint64 stampNs;                //CLOCK_MONOTONIC
+            quint32 universeCount;
+            quint32 reserved;
+        };
+
+        ShmSink(const QString& name, int slotCount=8, int maxUniverses=64);
+        virtual ~ShmSink();
+
+        bool isOpen() const;
+
+        virtual bool send(int universe, const uint8_t* channels);
+        virtual bool flush();
+        virtual QString name() const;
+
+    private:
+        uint8_t* slot(quint64 frame) const;
+
+        QString _name;
+        int _fd;
+        size_t _size;
+        uint8_t* _memory;
+        ShmHeader* _header;
+        quint32 _pending;           //Universes written into the current slot
+        bool _overflowLogged;
+};
+
+/**
+ * @brief   Forwards to several sinks, which it owns
+ */
+class FanoutSink : public OutputSink
+{
+    public:
+        virtual ~FanoutSink();
+
+        void append(OutputSink* sink);
+        int count() const;
+
+        virtual bool send(int universe, const uint8_t* channels);
+        virtual bool flush();
+        virtual QString name() const;
+
+    private:
+        QList<OutputSink*> _sinks;
+};
+
+struct OutputSinkOptions {
+    OutputSinkOptions();
+
+    int e131Port;
+    int e131SyncUniverse;
+    int e131Priority;
+    E131SyncSource* e131SyncSource;     //Shared by every e131 output created, not owned
+};
+
+/**
+ * @brief   Build sinks from a comma separated list of type[:argument]
+ *
+ *          ola, null, e131[:unicast destination], file:<path>, shm:<name>. More than one
+ *          entry fans out to all of them.
+ *
+ * @return  NULL if an entry can not be created
+ */
+OutputSink* createOutputSink(const QString& spec, const OutputSinkOptions& options=OutputSinkOptions());
+
+#endif // OUTPUTSINK_H
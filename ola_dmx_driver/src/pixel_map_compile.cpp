@@ -0,0 +1,145 @@
+/*
+ * Compiles a JSON pixel map from waas_config into the binary .wpm format that
+ * pixel_map_node maps straight into memory
+ *
+ *   pixel_map_compile [--order rgb|rbg|grb|gbr|brg|bgr] [--spacing x[,y]] <pixel_map.json> <pixel_map.wpm>
+ *
+ * Led runs have no colour order, --order applies to every run LED (default rgb). Run LEDs
+ * are placed on a grid --spacing metres apart (default 0.2032), which also maps placed
+ * LEDs to image pixels.
+ */
+
+#include <iostream>
+
+#include <QtCore>
+
+#include "ledrun.h"
+#include "pixelmapfile.h"
+
+using namespace std;
+
+static int usage(){
+    cerr << "usage: pixel_map_compile [--order rgb|rbg|grb|gbr|brg|bgr] [--spacing x[,y]] <pixel_map.json> <pixel_map.wpm>" << endl;
+    return 1;
+}
+
+int main(int argc, char** argv){
+    QStringList paths;
+    int order = PIXEL_ORDER_RGB;
+    float spacingX = DEFAULT_PIXEL_MAP_SPACING;
+    float spacingY = DEFAULT_PIXEL_MAP_SPACING;
+
+    for(int i=1; i<argc; i++){
+        QString arg(argv[i]);
+
+        if(arg == "--order" && i+1 < argc){
+            order = pixelOrderFromName(argv[++i]);
+
+            if(order == PIXEL_ORDER_COUNT){
+                return usage();
+            }
+        }
+        else if(arg == "--spacing" && i+1 < argc){
+            QStringList values = QString(argv[++i]).split(",");
+            bool okX = false;
+            bool okY = true;
+
+            spacingX = values[0].toFloat(&okX);
+            spacingY = (values.size() > 1) ? values[1].toFloat(&okY) : spacingX;
+
+            if(!okX || !okY || values.size() > 2 || spacingX <= 0.0f || spacingY <= 0.0f){
+                return usage();
+            }
+        }
+        else{
+            paths.append(arg);
+        }
+    }
+
+    if(paths.size() != 2){
+        return usage();
+    }
+
+    QFile input(paths[0]);
+
+    if(!input.open(QIODevice::ReadOnly)){
+        cerr << "Failed to open " << paths[0].toStdString() << endl;
+        return 1;
+    }
+
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(input.readAll(), &error);
+
+    if(!doc.isArray()){
+        cerr << paths[0].toStdString() << ": " << error.errorString().toStdString() << endl;
+        return 1;
+    }
+
+    QMap<int, LedRun*> runs;
+    QVector<PixelMapLed> points;
+    QJsonArray ledRunArray = doc.array();
+
+    for(int i=0; i<ledRunArray.size(); i++){
+        QJsonObject itemObj = ledRunArray.at(i).toObject();
+
+        if(itemObj.contains("led")){
+            PixelMapLed led;
+            int col = itemObj.contains("col") ? itemObj.value("col").toVariant().toInt() : -1;
+            int row = itemObj.contains("row") ? itemObj.value("row").toVariant().toInt() : -1;
+
+            if(!ledFromJson(itemObj.value("led").toObject(), col, row, spacingX, spacingY, led)){
+                cerr << paths[0].toStdString() << ": Bad led at index " << i << endl;
+                return 1;
+            }
+
+            points.append(led);
+            continue;
+        }
+
+        QJsonObject runObj = itemObj.value("run").toObject();
+
+        LedRun* run = new LedRun();
+
+        if(itemObj.value("col").isUndefined() || !run->fromJson(runObj)){
+            cerr << paths[0].toStdString() << ": Bad led run at index " << i << endl;
+            return 1;
+        }
+
+        runs.insert(itemObj.value("col").toVariant().toInt(), run);
+    }
+
+    QVector<PixelMapLed> leds;
+    QVector<PixelMapUniverse> universes;
+
+    int clipped = flattenLedRuns(runs, points, order, spacingX, spacingY, leds, universes);
+
+    //Written without the cut-off pixels, the rest of the map still renders
+    if(clipped > 0){
+        cerr << paths[0].toStdString() << ": Warning, dropped " << clipped << " pixels that do not fit in their universe" << endl;
+    }
+
+    qDeleteAll(runs);
+
+    //A map without LEDs would have an empty image, which PixelMapFile::open() rejects
+    if(leds.isEmpty()){
+        cerr << paths[0].toStdString() << ": No LEDs to compile" << endl;
+        return 1;
+    }
+
+    int width = 0;
+    int height = 0;
+
+    for(int i=0; i<leds.size(); i++){
+        width = qMax(width, leds[i].column + 1);
+        height = qMax(height, leds[i].row + 1);
+    }
+
+    if(!PixelMapFile::write(paths[1], width, height, spacingX, spacingY, leds, universes)){
+        return 1;
+    }
+
+    cout << paths[1].toStdString() << ": " << leds.size() << " leds in " << universes.size()
+         << " universes, " << width << "x" << height << " image" << endl;
+
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include <tf/transform_listener.h>
 
 #include <std_msgs/Int32.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/PointCloud2.h>
@@ -23,6 +24,8 @@
 #include <iostream>
 #include <sstream>
 
+#include <boost/shared_ptr.hpp>
+
 #include <QtGui>
 #include <QtCore>
 
@@ -30,19 +33,29 @@
 #include "animationhost.h"
 #include "animations.h"
 #include "starfield.h"
+#include "renderthread.h"
+#include "spscqueue.h"
+#include "latencytrace.h"
+#include "asyncsink.h"
+#include "shardedsink.h"
+#include "globeprojection.h"
 
 #include "ola_dmx_driver/RefreshParams.h"
+#include "ola_dmx_driver/LoadPixelMap.h"
 //#include "starfield.h"
 
 using namespace std;
 using namespace ola_dmx_driver;
 
 #define DEFAULT_GLOBE_HEIGHT (3.0f)
+#define DEFAULT_RENDER_RATE  (30.0f)
+#define DEFAULT_PREVIEW_RATE (10.0f)
 
 ros::NodeHandlePtr _nhPtr;
 
 //Animation_host Publishers
 ros::Publisher _framePub;
+ros::Publisher _diagnosticsPub;
 
 
 //Animation host Subscribers
@@ -50,6 +63,7 @@ ros::Subscriber _blobSub;
 
 
 ros::ServiceServer _refreshParamServ;
+ros::ServiceServer _loadPixelMapServ;
 
 ros::Publisher _lightVizPub;
 tf::TransformListener* _tfListener = NULL;
@@ -57,26 +71,83 @@ tf::TransformBroadcaster* _tfBroadcaster = NULL;
 
 //Service callbackes
 bool refreshParams(RefreshParams::Request &request, RefreshParams::Response &response);
+bool loadPixelMap(LoadPixelMap::Request &request, LoadPixelMap::Response &response);
 
 double loadRosParam(std::string param, double value=0.0f);
 void reloadParameters();
+void applyRenderParams();
 
-void renderImage(const ros::TimerEvent& event);
+OutputSink* createDmxOutput();
+void renderImage();
+void recordTransmit(qint64 renderNs, qint64 captureNs);
+void publishPreview(const QImage& image);
 void publishGlobeTransform(const ros::TimerEvent& event);
 void publishGlobeMarkers();
+void publishDiagnostics(const ros::TimerEvent& event);
+void watchPixelMap(const ros::TimerEvent& event);
+diagnostic_msgs::DiagnosticStatus outputDiagnostics(const std::string& name, double intervalSec);
 
 //Members
-QList<BlobInfo*> _pendingBlobs;
+SpscQueue<BlobInfo> _pendingBlobs(256);     //blobCallback() to the render thread
 QSharedPointer<RenderData> _dataPtr;
 BlobTracker* _blobTracker;
 AnimationHost* _animationHost;
+LatencyTrace _latency;
+QList<AsyncSink*> _outputThreads;           //Owned by the OlaManager, empty when sending on the render thread
+
+sensor_msgs::Image _previewFrame;           //Reused by publishPreview(), render thread only
+ros::WallTime _lastPreview;
+QAtomicInt _previewIntervalMs;              //0 disables the preview
+
+
+/**
+ * @brief   Parameters read outside the ROS spinner thread
+ */
+struct RenderParams {
+    geometry_msgs::Point globesScale;   //Globe pixels per metre
+    bool sparseSampling;
+    int keepaliveMs;
+
+    //Track prediction
+    float velocitySmoothing;
+    int predictionHorizonMs;
+    float predictionClamp;
+    int outputDelayMs;
+};
+
+typedef boost::shared_ptr<const RenderParams> RenderParamsConstPtr;
+
+/*
+ * Current parameter snapshot. reloadParameters() builds a complete copy and swaps it in
+ * with boost::atomic_store(), the render thread takes one boost::atomic_load() per frame
+ * and applies it before rendering, so a frame never sees a half applied update.
+ */
+RenderParamsConstPtr _renderParamsPtr;
+RenderParamsConstPtr _appliedParamsPtr;     //Render thread only
 
-
-geometry_msgs::Point _globesScale;
 tf::Vector3 _globesOrigin;
 tf::Quaternion _globesOrientation;
 
-geometry_msgs::Point _globeSpacing;
+//Sensor frame to globe pixels, shared by everything that maps world positions onto the image
+GlobeProjection* _globeProjection = NULL;
+
+//Reused by blobCallback()
+QVector<int> _blobMarkers;
+QVector<float> _blobX;
+QVector<float> _blobY;
+QVector<float> _blobZ;
+
+//Globe markers, points are rebuilt when the pixel map changes and colours when the lights do
+visualization_msgs::Marker _globeMarker;
+int _globeMarkerSerial = -1;
+uint32_t _globeMarkerSubscribers = 0;
+QVector<QRgb> _globeColors;                 //Colours last published
+QVector<QRgb> _globeColorScratch;
+
+//Pixel map file being watched, modification time of the version in use and as of the last poll
+QString _pixelMapPath;
+QDateTime _pixelMapLoaded;
+QDateTime _pixelMapSeen;
 
 
 
@@ -95,7 +166,11 @@ int main(int argc, char** argv){
     _dataPtr = QSharedPointer<RenderData>( new RenderData );
     _dataPtr->timestamp = ros::Time::now();
     _blobTracker = new BlobTracker(_dataPtr);
-    _animationHost = new AnimationHost(QString(pixelMapPath.c_str()), _dataPtr);
+    _pixelMapPath = QString(pixelMapPath.c_str());
+    _pixelMapLoaded = QFileInfo(_pixelMapPath).lastModified();
+    _pixelMapSeen = _pixelMapLoaded;
+
+    _animationHost = new AnimationHost(_pixelMapPath, _dataPtr, createDmxOutput());
 
     Animation* fill = new FillFade();
     _animationHost->insertLayer(0, fill);
@@ -107,6 +182,7 @@ int main(int argc, char** argv){
     _animationHost->insertLayer(1, starPath);
 
     _tfListener = new tf::TransformListener();
+    _globeProjection = new GlobeProjection(_tfListener);
     tf::TransformBroadcaster _broadcaster;
     _tfBroadcaster = &_broadcaster;
 
@@ -117,11 +193,13 @@ int main(int argc, char** argv){
 
     _lightVizPub = _nhPtr->advertise<visualization_msgs::Marker> ("/pixel_map_node/globes/markers", 1);
     _framePub = _nhPtr->advertise<sensor_msgs::Image> ("/pixel_map_node/animation/image", 1);
+    _diagnosticsPub = _nhPtr->advertise<diagnostic_msgs::DiagnosticArray> ("/pixel_map_node/diagnostics", 1);
 
     _blobSub = _nhPtr->subscribe("/point_downsample/markers", 1, blobCallback);
 
     //Services
     _refreshParamServ = _nhPtr->advertiseService("/pixel_map_node/refresh_params", refreshParams);
+    _loadPixelMapServ = _nhPtr->advertiseService("/pixel_map_node/load_pixel_map", loadPixelMap);
 
 
     publishGlobeTransform(ros::TimerEvent());
@@ -129,23 +207,119 @@ int main(int argc, char** argv){
 
 
     ros::Timer transformTimer = _nhPtr->createTimer(ros::Duration(0.05), publishGlobeTransform);
-    ros::Timer renderTimer = _nhPtr->createTimer(ros::Duration(0.033), renderImage);    //30 FPS
+    ros::Timer diagnosticsTimer = _nhPtr->createTimer(ros::Duration(1.0), publishDiagnostics);
+
+    //Maps saved over the watched file are picked up without a restart
+    ros::Timer pixelMapTimer;
+    double watchInterval = loadRosParam("/waas/pixel_map/watch_interval", 1.0);
+
+    if(watchInterval > 0.0){
+        pixelMapTimer = _nhPtr->createTimer(ros::Duration(watchInterval), watchPixelMap);
+    }
+
+    //Rendering and DMX output run on their own thread so TF lookups in the callbacks can not delay a frame
+    if(loadRosParam("/waas/render/lock_memory", 0.0f) != 0.0f){
+        lockProcessMemory();
+    }
+
+    RenderThread renderThread(renderImage);
+    renderThread.setRate( loadRosParam("/waas/render/rate", DEFAULT_RENDER_RATE) );
+    renderThread.setPriority( loadRosParam("/waas/render/priority", 0) );
+    renderThread.setCpu( loadRosParam("/waas/render/cpu", -1) );
+    renderThread.start();
 
     ros::spin();
 
+    renderThread.stop();
+    renderThread.wait();
+
     delete _animationHost;
     delete _blobTracker;
+    delete _globeProjection;
 
 	return 0;
 }
 
 
-void renderImage(const ros::TimerEvent& event){
+OutputSink* createDmxOutput(){
+    std::string spec = "ola";
+    _nhPtr->param("/waas/dmx/output", spec, spec);
+
+    OutputSinkOptions options;
+    options.e131Port = loadRosParam("/waas/dmx/e131/port", E131_PORT);
+    options.e131SyncUniverse = loadRosParam("/waas/dmx/e131/sync_universe", 0);
+    options.e131Priority = loadRosParam("/waas/dmx/e131/priority", E131_DEFAULT_PRIORITY);
+
+    QString outputSpec(spec.c_str());
+    int shards = loadRosParam("/waas/dmx/shards", 1);
+    double maxRate = loadRosParam("/waas/dmx/max_rate", 0);
+
+    //Large rigs split their universes over several sender threads
+    if(shards > 1 || hasUniverseRanges(outputSpec)){
+        ShardedSink* sharded = createShardedSink(outputSpec, shards, options);
+
+        if(sharded != NULL){
+            sharded->setMaxRate(maxRate);
+
+            //Recorded once per frame when the last shard has sent it, not once per shard
+            sharded->setTransmitFunction(recordTransmit);
+
+            for(int i=0; i<sharded->count(); i++){
+                _outputThreads.append( sharded->shard(i) );
+            }
+
+            ROS_INFO("DMX output: %s", sharded->name().toStdString().c_str());
+
+            return sharded;
+        }
+
+        ROS_ERROR("Failed to create sharded DMX output '%s', falling back to olad", spec.c_str());
+    }
+
+    OutputSink* sink = hasUniverseRanges(outputSpec) ? NULL : createOutputSink(outputSpec, options);
+
+    if(sink == NULL){
+        ROS_ERROR("Failed to create DMX output '%s', falling back to olad", spec.c_str());
+        sink = new OlaSink();
+    }
+
+    //A stalled output should drop frames, not stall rendering
+    if(loadRosParam("/waas/dmx/async", 1) != 0){
+        AsyncSink* async = new AsyncSink(sink);
+        async->setMaxRate(maxRate);
+        async->setTransmitFunction(recordTransmit);
+
+        _outputThreads.append(async);
+        sink = async;
+    }
+
+    ROS_INFO("DMX output: %s", sink->name().toStdString().c_str());
+
+    return sink;
+}
+
+void renderImage(){
     //std::cout << "renderImage()" << std::endl;
-    _dataPtr->timestamp = ros::Time::now();
+    ros::Time renderStart = ros::Time::now();
+    _dataPtr->timestamp = renderStart;
 
-    _blobTracker->updateBlobs( _pendingBlobs );
-    _pendingBlobs.clear();
+    applyRenderParams();
+
+    _blobTracker->expireBlobs();
+
+    BlobInfo blob;
+    bool freshBlobs = false;
+
+    while(_pendingBlobs.pop(blob)){
+        _latency.record( LatencyTrace::ReceiveToRender, (renderStart - blob.received).toSec() * 1000.0 );
+
+        if(blob.timestamp > _dataPtr->captureTime){
+            _dataPtr->captureTime = blob.timestamp;
+        }
+
+        _blobTracker->insertBlob( blob );
+        freshBlobs = true;
+    }
 
     QImage* image = _animationHost->renderAll();
 
@@ -154,40 +328,173 @@ void renderImage(const ros::TimerEvent& event){
         return;
     }
 
+    //Only frames showing new sightings say anything about end-to-end latency
+    qint64 renderNs = renderStart.toNSec();
+    qint64 captureNs = (freshBlobs && !_dataPtr->captureTime.isZero()) ? _dataPtr->captureTime.toNSec() : 0;
+
+    //Output threads stamp the frame once their sink has flushed it
+    for(int i=0; i<_outputThreads.size(); i++){
+        _outputThreads[i]->setFrameStamps(renderNs, captureNs);
+    }
+
     //std::cout << "renderImage() - transmit" << std::endl;
     _animationHost->transmit();
 
-    sensor_msgs::Image frame;
+    if(_outputThreads.isEmpty()){
+        recordTransmit(renderNs, captureNs);
+    }
+
+    publishPreview( *image );
+    //std::cout << "renderImage() - done" << std::endl;
+}
+
+//Called once a frame has gone out, on the render thread or an output thread. captureNs is 0 without new sightings
+void recordTransmit(qint64 renderNs, qint64 captureNs){
+    qint64 nowNs = ros::Time::now().toNSec();
 
-    frame.width = image->width();
-    frame.height = image->height();
+    _latency.record( LatencyTrace::RenderToTransmit, (nowNs - renderNs) / 1.0e6 );
 
-    frame.header.frame_id = "base_link";
-    frame.header.stamp = ros::Time();
+    if(captureNs != 0){
+        _latency.record( LatencyTrace::CaptureToTransmit, (nowNs - captureNs) / 1.0e6 );
+    }
+}
 
-    frame.encoding = sensor_msgs::image_encodings::RGB8;
+void applyRenderParams(){
+    RenderParamsConstPtr params = boost::atomic_load(&_renderParamsPtr);
 
-    frame.data.clear();
-    frame.step = image->width() * 3;
+    if(params == NULL || params == _appliedParamsPtr){
+        return;
+    }
 
-    for(int j=0; j<image->height(); j++){
-        for(int i=image->width()-1; i >= 0; i--){
+    _animationHost->setSparseSampling( params->sparseSampling );
+    _animationHost->getOlaManager()->setKeepaliveMs( params->keepaliveMs );
 
-            QRgb pixel = QColor(Qt::black).rgb();
-            if(image->width() > i && image->height() > j) {
-                pixel = image->pixel(i, j);
-            }
+    _blobTracker->setVelocitySmoothing( params->velocitySmoothing );
+    _animationHost->setPrediction( params->predictionHorizonMs, params->predictionClamp, params->outputDelayMs );
+
+    _appliedParamsPtr = params;
+}
+
+void publishPreview(const QImage& image){
+    int intervalMs = _previewIntervalMs.loadAcquire();
+
+    //Nobody watches the preview in production, keep it off the render thread
+    if(intervalMs <= 0 || _framePub.getNumSubscribers() == 0){
+        return;
+    }
+
+    ros::WallTime now = ros::WallTime::now();
+    if((now - _lastPreview).toSec() * 1000.0 < intervalMs){
+        return;
+    }
+
+    _lastPreview = now;
+
+    if((int)_previewFrame.width != image.width() || (int)_previewFrame.height != image.height()){
+        _previewFrame.width = image.width();
+        _previewFrame.height = image.height();
+        _previewFrame.step = image.width() * 3;
+        _previewFrame.encoding = sensor_msgs::image_encodings::RGB8;
+        _previewFrame.header.frame_id = "base_link";
+        _previewFrame.data.resize(_previewFrame.step * _previewFrame.height);
+    }
+
+    //Stamped with the capture time of the data it shows
+    _previewFrame.header.stamp = _dataPtr->captureTime.isZero() ? _dataPtr->timestamp : _dataPtr->captureTime;
+
+    packMirroredRgb8(image, _previewFrame.data.data(), _previewFrame.step);
+
+    //Serialized before returning, so the buffer can be reused next frame
+    _framePub.publish( _previewFrame );
+}
 
+static void addDiagnosticValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, quint32 value){
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = QString::number(value).toStdString();
 
-            frame.data.push_back( qRed(pixel) );
-            frame.data.push_back( qGreen(pixel) );
-            frame.data.push_back( qBlue(pixel) );
+    status.values.push_back(kv);
+}
 
+diagnostic_msgs::DiagnosticStatus outputDiagnostics(const std::string& name, double intervalSec){
+    static quint32 lastDropped = 0;
+    static quint32 lastFailures = 0;
+    static quint32 lastUniverses = 0;
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = name;
+
+    quint32 published = 0;
+    quint32 sent = 0;
+    quint32 dropped = 0;
+    quint32 failures = 0;
+    quint32 universes = 0;
+    int backlog = 0;
+
+    for(int i=0; i<_outputThreads.size(); i++){
+        AsyncSink* output = _outputThreads[i];
+
+        published += output->published();
+        sent += output->sent();
+        dropped += output->dropped();
+        failures += output->failures();
+        universes += output->universesSent();
+        backlog = qMax(backlog, output->backlog());
+
+        if(_outputThreads.size() > 1){
+            addDiagnosticValue(status, QString("shard %1 dropped frames").arg(i).toStdString(), output->dropped());
+            addDiagnosticValue(status, QString("shard %1 backlog").arg(i).toStdString(), output->backlog());
         }
     }
 
-    _framePub.publish( frame );
-    //std::cout << "renderImage() - done" << std::endl;
+    addDiagnosticValue(status, "shards", _outputThreads.size());
+    addDiagnosticValue(status, "published frames", published);
+    addDiagnosticValue(status, "sent frames", sent);
+    addDiagnosticValue(status, "dropped frames", dropped);
+    addDiagnosticValue(status, "send failures", failures);
+    addDiagnosticValue(status, "max backlog", backlog);
+
+    //Aggregate throughput over all shards since the last update
+    if(intervalSec > 0.0){
+        double universesPerSec = (universes - lastUniverses) / intervalSec;
+
+        addDiagnosticValue(status, "universes per second", (quint32)(universesPerSec + 0.5));
+        addDiagnosticValue(status, "bytes per second", (quint32)((universesPerSec * OUTPUT_SINK_SIZE) + 0.5));
+    }
+
+    //Report on what happened since the last update, not since startup
+    if(failures != lastFailures){
+        status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+        status.message = "Send failures";
+    }
+    else if(dropped != lastDropped){
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = "Output slower than render";
+    }
+    else{
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.message = "OK";
+    }
+
+    lastDropped = dropped;
+    lastFailures = failures;
+    lastUniverses = universes;
+
+    return status;
+}
+
+void publishDiagnostics(const ros::TimerEvent& event){
+    diagnostic_msgs::DiagnosticArrayPtr diagnostics(new diagnostic_msgs::DiagnosticArray);
+
+    diagnostics->header.stamp = ros::Time::now();
+    diagnostics->status.push_back( _latency.toDiagnostics("pixel_map_node: latency") );
+
+    if(!_outputThreads.isEmpty()){
+        double intervalSec = event.last_real.isZero() ? 0.0 : (event.current_real - event.last_real).toSec();
+        diagnostics->status.push_back( outputDiagnostics("pixel_map_node: dmx output", intervalSec) );
+    }
+
+    _diagnosticsPub.publish(diagnostics);
 }
 
 void publishGlobeTransform(const ros::TimerEvent& event){
@@ -201,60 +508,78 @@ void publishGlobeTransform(const ros::TimerEvent& event){
     if(_lightVizPub.getNumSubscribers() > 0){
         publishGlobeMarkers();
     }
+    else{
+        _globeMarkerSubscribers = 0;
+    }
     //std::cout << "publishGlobeTransform() - done" << std::endl;
 }
 
 void publishGlobeMarkers(){
     //std::cout << "publishGlobeMarkers()" << std::endl;
+    PixelMapper* pixelMapper = _animationHost->getPixelMapper();
+
     //Collect pixel data
-    QMap<int, QPair<QPoint, QRgb> > pixelData = _animationHost->getPixelMapper()->getGlobeData();
-
-    visualization_msgs::Marker globeMarker;
-    globeMarker.header.frame_id = "/globes_link";
-    globeMarker.ns = "pixel_map_node";
-    globeMarker.id = 0;
-    globeMarker.type = visualization_msgs::Marker::POINTS;
-    globeMarker.action = visualization_msgs::Marker::ADD;
-    globeMarker.pose.position.x = 0;
-    globeMarker.pose.position.y = 0;
-    globeMarker.pose.position.z = 0;
-    globeMarker.pose.orientation.x = 0.0;
-    globeMarker.pose.orientation.y = 0.0;
-    globeMarker.pose.orientation.z = 0.0;
-    globeMarker.pose.orientation.w = 1.0;
-    globeMarker.scale.x = 0.05;
-    globeMarker.scale.y = 0.05;
-    globeMarker.scale.z = 0.05;
-    /*globeMarker.color.a = 1.0;
-    globeMarker.color.r = qRed(pixelIter.value().second);
-    globeMarker.color.g = qGreen(pixelIter.value().second);
-    globeMarker.color.b = qBlue(pixelIter.value().second);*/
-
-
-    QMap<int, QPair<QPoint, QRgb> >::iterator pixelIter = pixelData.begin();
-    for(; pixelIter != pixelData.end(); pixelIter++){
-        //Load position
-        geometry_msgs::Point pt;
-        pt.x = pixelIter.value().first.x() * _globeSpacing.x;
-        pt.y = pixelIter.value().first.y() * _globeSpacing.y;
-
-        globeMarker.points.push_back( pt );
-
-        //Load color
-        QColor qColor(pixelIter.value().second);
-        std_msgs::ColorRGBA c;
-        c.a = 1.0;
-        c.r = qColor.redF();
-        c.g = qColor.greenF();
-        c.b = qColor.blueF();
-
-        globeMarker.colors.push_back(c);
+    int serial = pixelMapper->getGlobeColors(_globeColorScratch);
+    uint32_t subscribers = _lightVizPub.getNumSubscribers();
+
+    //Points only change with the pixel map
+    if(serial != _globeMarkerSerial || _globeMarker.points.size() != (size_t)_globeColorScratch.size()){
+        QVector<QVector3D> positions;
+
+        if(pixelMapper->getGlobePositions(positions) != serial || positions.size() != _globeColorScratch.size()){
+            //Map swapped in between, catch up next time
+            return;
+        }
+
+        _globeMarker.header.frame_id = "/globes_link";
+        _globeMarker.ns = "pixel_map_node";
+        _globeMarker.id = 0;
+        _globeMarker.type = visualization_msgs::Marker::POINTS;
+        _globeMarker.action = visualization_msgs::Marker::ADD;
+        _globeMarker.pose.orientation.w = 1.0;
+        _globeMarker.scale.x = 0.05;
+        _globeMarker.scale.y = 0.05;
+        _globeMarker.scale.z = 0.05;
+
+        //Load position, already in metres
+        _globeMarker.points.resize(positions.size());
+        _globeMarker.colors.resize(positions.size());
+
+        for(int i=0; i<positions.size(); i++){
+            _globeMarker.points[i].x = positions[i].x();
+            _globeMarker.points[i].y = positions[i].y();
+            _globeMarker.points[i].z = positions[i].z();
+            _globeMarker.colors[i].a = 1.0;
+        }
+
+        _globeMarkerSerial = serial;
+        _globeColors.clear();
+    }
+    else if(_globeColorScratch == _globeColors && subscribers <= _globeMarkerSubscribers){
+        //RViz keeps the last marker, only a new subscriber needs it again
+        _globeMarkerSubscribers = subscribers;
+        return;
+    }
+
+    _globeMarkerSubscribers = subscribers;
+    _globeColors.swap(_globeColorScratch);
+
+    //Load color
+    const float scale = 1.0f / 255.0f;
+    const QRgb* colors = _globeColors.constData();
+
+    for(int i=0; i<_globeColors.size(); i++){
+        std_msgs::ColorRGBA& c = _globeMarker.colors[i];
+
+        c.r = qRed(colors[i]) * scale;
+        c.g = qGreen(colors[i]) * scale;
+        c.b = qBlue(colors[i]) * scale;
     }
 
     //Publish
     //visualization_msgs::MarkerArrayPtr markerArray(new visualization_msgs::MarkerArray);
     //markerArray->markers.push_back(globeMarker);
-    _lightVizPub.publish(globeMarker);
+    _lightVizPub.publish(_globeMarker);
     //std::cout << "publishGlobeMarkers() - done" << std::endl;
 }
 
@@ -262,57 +587,74 @@ void publishGlobeMarkers(){
 
 
 void blobCallback(const visualization_msgs::MarkerArrayPtr& markers) {
+    //std::cout << "blobCallback() with " << markers->markers.size() << std::endl;
 
-    try{
-        if(!_tfListener->canTransform("base_link", "globes_link", ros::Time())){
-            std::cout<<"blobCallback() - Can't transform"<<std::endl;
-            return;
+    ros::Time received = ros::Time::now();
+
+    //Centroids of the CUBE markers, transformed into globe pixels together
+    _blobMarkers.clear();
+    _blobX.clear();
+    _blobY.clear();
+    _blobZ.clear();
+
+    for(unsigned int i=0; i<markers->markers.size(); i++){
+        const visualization_msgs::Marker& marker = markers->markers.at(i);
+
+        if(marker.type == visualization_msgs::Marker::CUBE){
+            _blobMarkers.append(i);
+            _blobX.append(marker.pose.position.x);
+            _blobY.append(marker.pose.position.y);
+            _blobZ.append(marker.pose.position.z);
         }
     }
-    catch(...){
-        std::cout<<"blobCallback() - Caught transform exception"<<std::endl;
-        return;
-    }
 
-    //std::cout << "blobCallback() with " << markers->markers.size() << std::endl;
+    RenderParamsConstPtr params = boost::atomic_load(&_renderParamsPtr);
+    int first = 0;
 
+    //Markers normally share one frame, each run of the same frame is one batch
+    while(first < _blobMarkers.size()){
+        const std::string& frame = markers->markers.at(_blobMarkers[first]).header.frame_id;
+        int last = first + 1;
 
-    for(unsigned int i=0; i<markers->markers.size(); i++){
-        visualization_msgs::Marker& marker = markers->markers.at(i);
+        while(last < _blobMarkers.size() && markers->markers.at(_blobMarkers[last]).header.frame_id == frame){
+            last++;
+        }
 
-        geometry_msgs::PoseStamped poseInput;
-        poseInput.header = marker.header;
-        poseInput.pose = marker.pose;
+        GlobeAffine affine;
 
-        if(marker.type == visualization_msgs::Marker::CUBE){
+        //lookup() already warns, throttled
+        if(!_globeProjection->lookup(frame, affine)){
+            first = last;
+            continue;
+        }
 
-            geometry_msgs::PoseStamped globeLinkPose;
+        affine.apply(_blobX.data() + first, _blobY.data() + first, _blobZ.data() + first, last - first);
 
-            try {
-                _tfListener->transformPose("globes_link", poseInput, globeLinkPose);
-            }
-            catch(...){
-                std::cout << "TF Error" << std::endl;
-                continue;
-            }
+        for(int i=first; i<last; i++){
+            const visualization_msgs::Marker& marker = markers->markers.at(_blobMarkers[i]);
 
-            double deltaXPx = (marker.scale.x * _globesScale.x) / 1.75f; //1.75 is aestecic not real conversion
-            double deltaYPx = (marker.scale.y * _globesScale.y) / 1.75f;
-            double deltaZPx = (marker.scale.z * _globesScale.z) / 1.75f;
+            double deltaXPx = (marker.scale.x * params->globesScale.x) / 1.75f; //1.75 is aestecic not real conversion
+            double deltaYPx = (marker.scale.y * params->globesScale.y) / 1.75f;
+            double deltaZPx = (marker.scale.z * params->globesScale.z) / 1.75f;
 
+            BlobInfo blob;
 
-            double centerXPx = (globeLinkPose.pose.position.x * _globesScale.x);
-            double centerYPx = (globeLinkPose.pose.position.y * _globesScale.y);
+            blob.realDimensions.setValue( marker.scale.x, marker.scale.y, marker.scale.z );
+            blob.bounds.setValue( deltaXPx, deltaYPx, deltaZPx );
+            blob.centroid.setValue( _blobX[i], _blobY[i], _blobZ[i] );
+            blob.received = received;
 
-            BlobInfo* blob = new BlobInfo;
+            //Older point_downsample builds leave the marker stamp empty
+            blob.timestamp = marker.header.stamp.isZero() ? received : marker.header.stamp;
 
-            blob->realDimensions.setValue( marker.scale.x, marker.scale.y, marker.scale.z );
-            blob->bounds.setValue( deltaXPx, deltaYPx, deltaZPx );
-            blob->centroid.setValue( centerXPx, centerYPx, globeLinkPose.pose.position.z );
-            blob->timestamp = ros::Time::now();
+            _latency.record( LatencyTrace::CaptureToReceive, (received - blob.timestamp).toSec() * 1000.0 );
 
-            _pendingBlobs.push_back( blob );
+            if(!_pendingBlobs.push( blob )){
+                ROS_WARN_THROTTLE(5, "blobCallback() - Render thread is not keeping up, dropping blob");
+            }
         }
+
+        first = last;
     }
 }
 
@@ -334,6 +676,61 @@ bool refreshParams(RefreshParams::Request &request, RefreshParams::Response &res
     return true;
 }
 
+bool loadPixelMap(LoadPixelMap::Request &request, LoadPixelMap::Response &response){
+    QString path = request.path.empty() ? _pixelMapPath : QString(request.path.c_str());
+    QString error;
+
+    //Loaded and checked here, the render thread swaps it in before its next frame
+    response.success = _animationHost->getPixelMapper()->loadMap(path, &error);
+
+    if(response.success){
+        _pixelMapPath = path;
+        _pixelMapLoaded = QFileInfo(path).lastModified();
+        _pixelMapSeen = _pixelMapLoaded;
+
+        response.message = QString("Loaded %1").arg(path).toStdString();
+        ROS_INFO("%s", response.message.c_str());
+    }
+    else{
+        response.message = error.toStdString();
+        ROS_ERROR("Keeping the current pixel map: %s", response.message.c_str());
+    }
+
+    return true;
+}
+
+void watchPixelMap(const ros::TimerEvent& event){
+    QFileInfo info(_pixelMapPath);
+
+    if(!info.exists()){
+        return;
+    }
+
+    QDateTime modified = info.lastModified();
+
+    if(modified == _pixelMapLoaded){
+        return;
+    }
+
+    //Wait for the file to settle for a poll so a map still being written is not loaded
+    if(modified != _pixelMapSeen){
+        _pixelMapSeen = modified;
+        return;
+    }
+
+    //Tried once per version, a broken save waits for the next one
+    _pixelMapLoaded = modified;
+
+    QString error;
+
+    if(_animationHost->getPixelMapper()->loadMap(_pixelMapPath, &error)){
+        ROS_INFO("Reloaded pixel map %s", _pixelMapPath.toStdString().c_str());
+    }
+    else{
+        ROS_ERROR("Keeping the current pixel map: %s", error.toStdString().c_str());
+    }
+}
+
 
 void reloadParameters(){
     std::cout << "Reloading parameters ... ";
@@ -352,11 +749,39 @@ void reloadParameters(){
                                 deg2radCoef * loadRosParam("/waas/globes/orientation/yaw")
                               );
 
-    _globesScale.x = loadRosParam("/waas/globes/scale", 1.0f/0.2032f);
-    _globesScale.y = _globesScale.x;
+    boost::shared_ptr<RenderParams> params( new RenderParams() );
+
+    params->globesScale.x = loadRosParam("/waas/globes/scale", 1.0f/0.2032f);
+    params->globesScale.y = params->globesScale.x;
+
+    //Blobs are projected with the new pose straight away, TF catches up with the next broadcast
+    _globeProjection->setGlobes( tf::Transform(_globesOrientation, _globesOrigin), params->globesScale.x, params->globesScale.y );
+    _globeProjection->setRefreshInterval( loadRosParam("/waas/globes/tf_refresh_interval", DEFAULT_PROJECTION_REFRESH) );
+
+    double spacingX = loadRosParam("/waas/globes/spacing/x", 0.2032);    //Default to 8in
+    double spacingY = loadRosParam("/waas/globes/spacing/y", 0.2032);    //Default to 8in
+
+    //Places run LEDs in globes_link, reloads the pixel map when it changes
+    _animationHost->getPixelMapper()->setGridSpacing(spacingX, spacingY);
+
+    //Animation preview image, frames per second while subscribed
+    double previewRate = loadRosParam("/waas/render/preview_rate", DEFAULT_PREVIEW_RATE);
+    _previewIntervalMs.storeRelease( previewRate > 0.0 ? qMax(1, (int)(1000.0 / previewRate)) : 0 );
+
+    //Track prediction, compensates sensor to light latency
+    params->velocitySmoothing = loadRosParam("/waas/tracker/velocity_smoothing", DEFAULT_VELOCITY_SMOOTHING);
+    params->predictionHorizonMs = loadRosParam("/waas/tracker/prediction_horizon_ms", DEFAULT_PREDICTION_HORIZON_MS);
+    params->predictionClamp = loadRosParam("/waas/tracker/prediction_clamp", DEFAULT_PREDICTION_CLAMP);
+    params->outputDelayMs = loadRosParam("/waas/render/output_delay_ms", 0);
+
+    //Only evaluate animations at pixels that have an LED
+    params->sparseSampling = loadRosParam("/waas/render/sparse", 0.0f) != 0.0f;
+
+    //Unchanged universes are only resent this often
+    params->keepaliveMs = loadRosParam("/waas/dmx/keepalive_ms", DEFAULT_KEEPALIVE_MS);
 
-    _globeSpacing.x = loadRosParam("/waas/globes/spacing/x", 0.2032);    //Default to 8in
-    _globeSpacing.y = loadRosParam("/waas/globes/spacing/y", 0.2032);    //Default to 8in
+    //Picked up by the render thread before its next frame
+    boost::atomic_store(&_renderParamsPtr, RenderParamsConstPtr(params));
 
     std::cout << "done!" << std::endl;
 }
@@ -0,0 +1,416 @@
+#include "pixelmapfile.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DMX_CHANNELS (512)
+
+static const char* PIXEL_ORDER_NAMES[PIXEL_ORDER_COUNT] = { "rgb", "rbg", "grb", "gbr", "brg", "bgr" };
+
+void pixelOrderOffsets(int order, int& red, int& green, int& blue){
+    if(order < 0 || order >= PIXEL_ORDER_COUNT){
+        order = PIXEL_ORDER_RGB;
+    }
+
+    const char* name = PIXEL_ORDER_NAMES[order];
+
+    red = strchr(name, 'r') - name;
+    green = strchr(name, 'g') - name;
+    blue = strchr(name, 'b') - name;
+}
+
+int pixelOrderFromName(const QString& name){
+    QString lower = name.trimmed().toLower();
+
+    for(int i=0; i<PIXEL_ORDER_COUNT; i++){
+        if(lower == PIXEL_ORDER_NAMES[i]){
+            return i;
+        }
+    }
+
+    return PIXEL_ORDER_COUNT;
+}
+
+static bool ledLessThan(const PixelMapLed& a, const PixelMapLed& b){
+    if(a.universe != b.universe){
+        return a.universe < b.universe;
+    }
+
+    return a.channel < b.channel;
+}
+
+int flattenLedRuns(const QMap<int, LedRun*>& runs, const QVector<PixelMapLed>& points, int order,
+                    float spacingX, float spacingY, QVector<PixelMapLed>& leds, QVector<PixelMapUniverse>& universes){
+    leds.clear();
+    universes.clear();
+
+    int clipped = 0;
+
+    QMap<int, LedRun*>::const_iterator runIter = runs.constBegin();
+
+    for(; runIter != runs.constEnd(); runIter++){
+        int col = runIter.key();
+        LedRun* run = runIter.value();
+
+        DmxAddress addr = run->dmxStart;
+        DmxAddress lastAddr = run->dmxStart.add(-1);
+        int step = 3;
+
+        if(run->reverse){
+            addr = run->dmxEnd.add(-2);
+            step = -3;
+        }
+
+        int row = 0;
+
+        while(run->reverse ? addr.isAfter(lastAddr) : addr.isBefore(run->dmxEnd)){
+            //A pixel cut off at the end of its universe can not be written as a whole,
+            //it is dropped and the rest of the map kept
+            if(col < 0 || addr.universe < 0 || addr.offset < 0 || addr.offset + 3 > DMX_CHANNELS){
+                qWarning() << "flattenLedRuns() - Pixel (" << col << ", " << row << ") at " << addr.toString()
+                           << " does not fit in a universe";
+                clipped++;
+            }
+            else{
+                PixelMapLed led;
+                memset(&led, 0, sizeof(led));
+
+                led.column = col;
+                led.row = row;
+                led.universe = addr.universe;
+                led.channel = addr.offset;
+                led.order = order;
+                led.x = col * spacingX;
+                led.y = row * spacingY;
+                led.z = 0.0f;
+
+                leds.append(led);
+            }
+
+            row++;
+            addr = addr.add(step);
+        }
+    }
+
+    leds += points;
+
+    std::stable_sort(leds.begin(), leds.end(), ledLessThan);
+
+    for(int i=0; i<leds.size(); i++){
+        if(universes.isEmpty() || universes.last().universe != leds[i].universe){
+            PixelMapUniverse universe;
+            universe.universe = leds[i].universe;
+            universe.reserved = 0;
+            universe.firstLed = i;
+            universe.ledCount = 0;
+
+            universes.append(universe);
+        }
+
+        universes.last().ledCount++;
+    }
+
+    return clipped;
+}
+
+bool ledFromJson(const QJsonObject& obj, int column, int row, float spacingX, float spacingY, PixelMapLed& led){
+    memset(&led, 0, sizeof(led));
+
+    QJsonObject addressObj = obj.value("address").toObject();
+    QJsonObject positionObj = obj.value("position").toObject();
+
+    DmxAddress addr;
+
+    if(!addr.fromJson(addressObj) || positionObj.isEmpty()){
+        qCritical() << "ledFromJson() - Missing address or position";
+        return false;
+    }
+
+    if(addr.universe < 0 || addr.offset < 0 || addr.offset + 3 > DMX_CHANNELS){
+        qCritical() << "ledFromJson() - Address " << addr.universe << "." << addr.offset << " does not fit in a universe";
+        return false;
+    }
+
+    led.x = positionObj.value("x").toDouble();
+    led.y = positionObj.value("y").toDouble();
+    led.z = positionObj.value("z").toDouble();
+
+    if(column < 0){
+        column = (spacingX > 0.0f) ? qRound(led.x / spacingX) : 0;
+    }
+
+    if(row < 0){
+        row = (spacingY > 0.0f) ? qRound(led.y / spacingY) : 0;
+    }
+
+    if(column < 0 || row < 0 || column > 0xffff || row > 0xffff){
+        qCritical() << "ledFromJson() - LED at (" << led.x << ", " << led.y << ") is outside the image";
+        return false;
+    }
+
+    led.column = column;
+    led.row = row;
+    led.universe = addr.universe;
+    led.channel = addr.offset;
+    led.order = PIXEL_ORDER_RGB;
+
+    QJsonValue orderValue = obj.value("order");
+
+    if(!orderValue.isUndefined()){
+        int order = pixelOrderFromName(orderValue.toString());
+
+        if(order == PIXEL_ORDER_COUNT){
+            qCritical() << "ledFromJson() - Unknown colour order " << orderValue.toString();
+            return false;
+        }
+
+        led.order = order;
+    }
+
+    return true;
+}
+
+QJsonObject ledToJson(const PixelMapLed& led){
+    DmxAddress addr;
+    addr.universe = led.universe;
+    addr.offset = led.channel;
+
+    QJsonObject positionObj;
+    positionObj.insert("x", led.x);
+    positionObj.insert("y", led.y);
+    positionObj.insert("z", led.z);
+
+    QJsonObject obj;
+    obj.insert("address", addr.toJson());
+    obj.insert("position", positionObj);
+    obj.insert("order", QString(PIXEL_ORDER_NAMES[ led.order < PIXEL_ORDER_COUNT ? led.order : PIXEL_ORDER_RGB ]));
+
+    return obj;
+}
+
+
+PixelMapFile::PixelMapFile(){
+    _memory = NULL;
+    _size = 0;
+    _header = NULL;
+}
+
+PixelMapFile::~PixelMapFile(){
+    close();
+}
+
+bool checkLedTable(const PixelMapLed* leds, int ledCount, const PixelMapUniverse* universes, int universeCount,
+                   int width, int height, QString* error){
+    QString reason;
+    quint64 nextLed = 0;
+
+    for(int u=0; u<universeCount && reason.isEmpty(); u++){
+        const PixelMapUniverse& universe = universes[u];
+
+        if(universe.firstLed != nextLed || nextLed + universe.ledCount > (quint64)ledCount){
+            reason = QString("Universe table entry %1 does not follow the LED table").arg(u);
+            break;
+        }
+
+        if(u > 0 && universe.universe <= universes[u-1].universe){
+            reason = QString("Universe %1 is out of order").arg(universe.universe);
+            break;
+        }
+
+        for(quint32 i=universe.firstLed; i<universe.firstLed + universe.ledCount; i++){
+            const PixelMapLed& led = leds[i];
+
+            if(led.universe != universe.universe){
+                reason = QString("LED %1 is in universe %2 but listed under %3").arg(i).arg(led.universe).arg(universe.universe);
+                break;
+            }
+
+            if(led.channel + 3 > DMX_CHANNELS){
+                reason = QString("LED %1 at %2.%3 does not fit in its universe").arg(i).arg(led.universe).arg(led.channel);
+                break;
+            }
+
+            if(led.column >= width || led.row >= height){
+                reason = QString("LED %1 at pixel (%2, %3) is outside the %4x%5 image").arg(i).arg(led.column).arg(led.row).arg(width).arg(height);
+                break;
+            }
+
+            if(i > universe.firstLed && led.channel < leds[i-1].channel){
+                reason = QString("LED %1 at %2.%3 is out of order").arg(i).arg(led.universe).arg(led.channel);
+                break;
+            }
+        }
+
+        nextLed += universe.ledCount;
+    }
+
+    if(reason.isEmpty() && nextLed != (quint64)ledCount){
+        reason = QString("%1 LEDs are in no universe").arg(ledCount - nextLed);
+    }
+
+    if(reason.isEmpty()){
+        return true;
+    }
+
+    if(error != NULL){
+        *error = reason;
+    }
+
+    return false;
+}
+
+
+bool PixelMapFile::open(const QString& path){
+    close();
+
+    int fd = ::open(path.toLocal8Bit().constData(), O_RDONLY);
+
+    if(fd < 0){
+        qCritical() << "PixelMapFile::open() - Failed to open " << path << ": " << strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(PixelMapHeader)){
+        qCritical() << "PixelMapFile::open() - " << path << " is too short";
+        ::close(fd);
+        return false;
+    }
+
+    void* memory = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    ::close(fd);
+
+    if(memory == MAP_FAILED){
+        qCritical() << "PixelMapFile::open() - mmap " << path << " failed: " << strerror(errno);
+        return false;
+    }
+
+    _memory = (uint8_t*) memory;
+    _size = info.st_size;
+
+    const PixelMapHeader* header = (const PixelMapHeader*) _memory;
+
+    bool valid = memcmp(header->magic, PIXEL_MAP_MAGIC, 4) == 0 &&
+                 header->version == PIXEL_MAP_VERSION &&
+                 header->headerSize == sizeof(PixelMapHeader) &&
+                 (header->universeOffset % 4) == 0 && (header->ledOffset % 4) == 0 &&
+                 (quint64)header->universeOffset + ((quint64)header->universeCount * sizeof(PixelMapUniverse)) <= _size &&
+                 (quint64)header->ledOffset + ((quint64)header->ledCount * sizeof(PixelMapLed)) <= _size &&
+                 header->spacingX > 0.0f && header->spacingY > 0.0f &&
+                 header->width > 0 && header->width <= PIXEL_MAP_MAX_SIZE &&
+                 header->height > 0 && header->height <= PIXEL_MAP_MAX_SIZE;
+
+    if(!valid){
+        qCritical() << "PixelMapFile::open() - " << path << " is not a version " << PIXEL_MAP_VERSION << " pixel map";
+        close();
+        return false;
+    }
+
+    _header = header;
+
+    //Rendering trusts the tables, a bad entry would write past a universe every frame
+    QString error;
+
+    if(!checkLedTable(leds(), ledCount(), universes(), universeCount(), width(), height(), &error)){
+        qCritical() << "PixelMapFile::open() - " << path << ": " << error;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void PixelMapFile::close(){
+    if(_memory != NULL){
+        munmap(_memory, _size);
+    }
+
+    _memory = NULL;
+    _size = 0;
+    _header = NULL;
+}
+
+bool PixelMapFile::isOpen() const {
+    return _header != NULL;
+}
+
+int PixelMapFile::width() const {
+    return _header->width;
+}
+
+int PixelMapFile::height() const {
+    return _header->height;
+}
+
+float PixelMapFile::spacingX() const {
+    return _header->spacingX;
+}
+
+float PixelMapFile::spacingY() const {
+    return _header->spacingY;
+}
+
+int PixelMapFile::ledCount() const {
+    return _header->ledCount;
+}
+
+const PixelMapLed* PixelMapFile::leds() const {
+    return (const PixelMapLed*)(_memory + _header->ledOffset);
+}
+
+int PixelMapFile::universeCount() const {
+    return _header->universeCount;
+}
+
+const PixelMapUniverse* PixelMapFile::universes() const {
+    return (const PixelMapUniverse*)(_memory + _header->universeOffset);
+}
+
+bool PixelMapFile::write(const QString& path, int width, int height, float spacingX, float spacingY,
+                         const QVector<PixelMapLed>& leds, const QVector<PixelMapUniverse>& universes){
+    PixelMapHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, PIXEL_MAP_MAGIC, 4);
+    header.version = PIXEL_MAP_VERSION;
+    header.headerSize = sizeof(PixelMapHeader);
+    header.width = width;
+    header.height = height;
+    header.universeCount = universes.size();
+    header.universeOffset = sizeof(PixelMapHeader);
+    header.ledCount = leds.size();
+    header.ledOffset = header.universeOffset + (universes.size() * sizeof(PixelMapUniverse));
+    header.spacingX = spacingX;
+    header.spacingY = spacingY;
+
+    //Write next to the target and rename so a running node never maps a half written file
+    QString tempPath = path + ".tmp";
+    QFile file(tempPath);
+
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+        qCritical() << "PixelMapFile::write() - Failed to open " << tempPath << ": " << file.errorString();
+        return false;
+    }
+
+    bool ok = file.write((const char*) &header, sizeof(header)) == sizeof(header);
+    ok = ok && file.write((const char*) universes.constData(), universes.size() * sizeof(PixelMapUniverse)) == (qint64)(universes.size() * sizeof(PixelMapUniverse));
+    ok = ok && file.write((const char*) leds.constData(), leds.size() * sizeof(PixelMapLed)) == (qint64)(leds.size() * sizeof(PixelMapLed));
+
+    file.close();
+
+    if(!ok || ::rename(tempPath.toLocal8Bit().constData(), path.toLocal8Bit().constData()) != 0){
+        qCritical() << "PixelMapFile::write() - Failed to write " << path;
+        QFile::remove(tempPath);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,153 @@
+#ifndef PIXELMAPFILE_H
+#define PIXELMAPFILE_H
+
+#include <QtCore>
+
+#include <stdint.h>
+
+#include "ledrun.h"
+
+#define PIXEL_MAP_MAGIC "WPM1"
+#define PIXEL_MAP_VERSION (2)
+
+#define DEFAULT_PIXEL_MAP_SPACING (0.2032f)     //8in between globes
+#define PIXEL_MAP_MAX_SIZE (65536)              //Largest image width or height, columns and rows are 16 bit
+
+/**
+ * @brief   Channel order of an LED, the order its three channels expect red, green
+ *          and blue in
+ */
+enum PixelOrder { PIXEL_ORDER_RGB=0, PIXEL_ORDER_RBG, PIXEL_ORDER_GRB, PIXEL_ORDER_GBR, PIXEL_ORDER_BRG, PIXEL_ORDER_BGR, PIXEL_ORDER_COUNT };
+
+/**
+ * @brief   Offset of the red, green and blue channel from the first channel of an LED
+ */
+void pixelOrderOffsets(int order, int& red, int& green, int& blue);
+
+/**
+ * @return  PIXEL_ORDER_COUNT if name is not one of rgb, rbg, grb, gbr, brg, bgr
+ */
+int pixelOrderFromName(const QString& name);
+
+/**
+ * @brief   One LED, the image pixel it shows, the first of its three channels and where
+ *          it hangs
+ */
+struct PixelMapLed {
+    quint16 column;
+    quint16 row;
+    quint16 universe;
+    quint16 channel;            //0 based offset within the universe
+    quint8 order;               //PixelOrder
+    quint8 reserved[3];
+    float x;                    //Position in metres in globes_link
+    float y;
+    float z;
+};
+
+/**
+ * @brief   LEDs of one universe, ledCount entries of the LED table starting at firstLed
+ *          sorted by channel
+ */
+struct PixelMapUniverse {
+    quint16 universe;
+    quint16 reserved;
+    quint32 firstLed;
+    quint32 ledCount;
+};
+
+/**
+ * @brief   Compiled pixel map, the layout of a .wpm file. All fields are in host byte
+ *          order and every table is 4 byte aligned so the file can be used in place.
+ *
+ *          The header is followed by universeCount PixelMapUniverse entries at
+ *          universeOffset and ledCount PixelMapLed entries at ledOffset. LEDs are sorted
+ *          by universe and channel.
+ */
+struct PixelMapHeader {
+    char magic[4];              //PIXEL_MAP_MAGIC
+    quint32 version;            //PIXEL_MAP_VERSION
+    quint32 headerSize;         //sizeof(PixelMapHeader), catches a file from another ABI
+    quint32 width;              //Image size the map needs
+    quint32 height;
+    quint32 universeCount;
+    quint32 universeOffset;
+    quint32 ledCount;
+    quint32 ledOffset;
+    float spacingX;             //Metres between image pixels, maps LED positions to the image
+    float spacingY;
+};
+
+/**
+ * @brief   Flatten led runs keyed by image column into a sorted LED table and its
+ *          universe layout, walking each run the way the DMX addresses are assigned.
+ *          Run LEDs sit on a flat grid, spacingX and spacingY metres apart. LEDs whose
+ *          three channels do not all fit in their universe are logged and left out,
+ *          the rest of the map is still usable.
+ * @param points    LEDs placed one by one, merged into the table as they are
+ * @return  Number of run LEDs left out
+ */
+int flattenLedRuns(const QMap<int, LedRun*>& runs, const QVector<PixelMapLed>& points, int order,
+                    float spacingX, float spacingY, QVector<PixelMapLed>& leds, QVector<PixelMapUniverse>& universes);
+
+/**
+ * @brief   Check that an LED table can be rendered without writing outside a universe.
+ *          Every LED must fit its three channels in the universe, the universe entries
+ *          must cover the table back to back in increasing universe order, each entry's
+ *          LEDs must carry its universe and be sorted by channel. Every LED's column
+ *          and row must lie inside the width x height image.
+ * @param error Reason the table was rejected, may be NULL
+ */
+bool checkLedTable(const PixelMapLed* leds, int ledCount, const PixelMapUniverse* universes, int universeCount,
+                   int width, int height, QString* error);
+
+/**
+ * @brief   Parse a single placed LED,
+ *          {"address": {"universe", "offset"}, "position": {"x", "y", "z"}, "order"}
+ *          with the position in metres. The image pixel is the nearest grid point unless
+ *          col and row are given.
+ */
+bool ledFromJson(const QJsonObject& obj, int column, int row, float spacingX, float spacingY, PixelMapLed& led);
+QJsonObject ledToJson(const PixelMapLed& led);
+
+/**
+ * @brief   Read only mapping of a compiled pixel map
+ */
+class PixelMapFile
+{
+    public:
+        PixelMapFile();
+        ~PixelMapFile();
+
+        /**
+         * @brief   Map and validate the file, replaces any file already open
+         */
+        bool open(const QString& path);
+        void close();
+        bool isOpen() const;
+
+        int width() const;
+        int height() const;
+
+        float spacingX() const;
+        float spacingY() const;
+
+        int ledCount() const;
+        const PixelMapLed* leds() const;
+
+        int universeCount() const;
+        const PixelMapUniverse* universes() const;
+
+        /**
+         * @brief   Write a compiled map, leds and universes as returned by flattenLedRuns()
+         */
+        static bool write(const QString& path, int width, int height, float spacingX, float spacingY,
+                          const QVector<PixelMapLed>& leds, const QVector<PixelMapUniverse>& universes);
+
+    private:
+        uint8_t* _memory;
+        size_t _size;
+        const PixelMapHeader* _header;
+};
+
+#endif // PIXELMAPFILE_H
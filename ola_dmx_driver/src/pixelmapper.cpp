@@ -4,65 +4,62 @@ PixelMapper::PixelMapper(OlaManager* ola, QObject *parent) :
     QObject(parent)
 {
     _ola = ola;
-    _image = NULL;
+    _map = QSharedPointer<PixelMap>( new PixelMap() );
+    _mapSerial = 0;
+    _spacingX = DEFAULT_PIXEL_MAP_SPACING;
+    _spacingY = DEFAULT_PIXEL_MAP_SPACING;
+    _spansValid = false;
+    _ledsValid = false;
+    _imageDirty = 0;
+    _backgroundColor = QColor(Qt::black);
     setSize(32,32);
 }
 
 void PixelMapper::clearImage(QColor color){
-    QPainter painter(_image);
-    QRect bounds(0, 0, _image->width()-1, _image->height()-1);
-    QBrush fillBrush( color );
-
-    painter.fillRect(bounds, fillBrush);
-    _imageDirty = true;
-
-    _backgroundColor = QColor(Qt::black);
+    _frames.back().fill(color);
+    publishFrame();
 }
 
 
 void PixelMapper::setSize(int width, int height){
-    _imageLock.lock();
-    if(_image != NULL){
-        delete _image;
+    for(int i=0; i<3; i++){
+        _frames.buffer(i) = QImage(width, height, QImage::Format_RGB32);
+        _frames.buffer(i).fill(Qt::black);
     }
-    _image = new QImage(width, height, QImage::Format_RGB32);
-    qDebug() << "PixelMapper::setSize() - Image dimensions (" << width << ", " << height << ")";
-    _imageLock.unlock();
 
-    clearImage();
+    QMutexLocker locker(&_snapshotLock);
+    _imageSize = QSize(width, height);
+    _snapshot = QImage(width, height, QImage::Format_RGB32);
+    _snapshot.fill(Qt::black);
+
+    qDebug() << "PixelMapper::setSize() - Image dimensions (" << width << ", " << height << ")";
 }
 
 bool PixelMapper::isDirty() const {
-    return _imageDirty;
+    return _imageDirty.loadAcquire() != 0;
 }
 
 int PixelMapper::width() const {
-    return _image->width();
+    QMutexLocker locker(&_snapshotLock);
+    return _imageSize.width();
 }
 
 int PixelMapper::height() const {
-    return _image->height();
+    QMutexLocker locker(&_snapshotLock);
+    return _imageSize.height();
 }
 
 void PixelMapper::updateImage(const QImage &image){
-    _imageLock.lock();
-
-    if(_image != NULL){
-        delete _image;
-    }
-
-    _image = new QImage(image);
-
-    _imageDirty = true;
-    _imageLock.unlock();
+    _frames.back() = image.convertToFormat(QImage::Format_RGB32);
+    publishFrame();
 }
 
 void PixelMapper::updateImage(const sensor_msgs::ImagePtr& rosImage){
     int step = rosImage->step;
 
-    _imageLock.lock();
+    QImage& image = _frames.back();
 
-    _image->fill(_backgroundColor);
+    image.fill(_backgroundColor);
 
     for(unsigned int y=0; y < rosImage->height; y++){
         for(unsigned int x=0; x < rosImage->width; x++){
@@ -72,107 +69,531 @@ void PixelMapper::updateImage(const sensor_msgs::ImagePtr& rosImage){
                         rosImage->data[idx+1],
                         rosImage->data[idx+2]);
 
-            QRgb oldColor = _image->pixel(x,y);
+            QRgb oldColor = image.pixel(x,y);
 
             c.setRed( (qRed(oldColor) + c.red()) / 2 );
             c.setGreen( (qGreen(oldColor) + c.green()) / 2 );
             c.setBlue( (qBlue(oldColor) + c.blue()) / 2 );
 
-            _image->setPixel(x, y, c.rgb());
+            image.setPixel(x, y, c.rgb());
         }
     }
 
-    _imageDirty = true;
-    _imageLock.unlock();
+    publishFrame();
+}
+
+QImage* PixelMapper::beginFrame() {
+    return &_frames.back();
 }
 
-QImage* PixelMapper::getImage() {
-    //NOTE, TODO: Not thread safe at all!
-    return _image;
+void PixelMapper::publishFrame() {
+    _frames.publish();
+    _imageDirty.storeRelease(1);
 }
 
-QMap<int, QPair<QPoint, QRgb> > PixelMapper::getGlobeData() const {
-    QMap<int, QPair<QPoint, QRgb> > globeData;
+int PixelMapper::getGlobePositions(QVector<QVector3D>& positions) const {
+    QMutexLocker locker(&_snapshotLock);
 
-    QMap<int, LedRun*>::const_iterator runIter =  _colToLedRun.begin();
+    const PixelMapLed* leds = _map->leds();
 
-    for(; runIter != _colToLedRun.end(); runIter++){
-        LedRun* run = runIter.value();
+    positions.resize(_map->ledCount());
 
-        int x = runIter.key();
-        int startY = 0;
-        int endY = run->length();
+    for(int i=0; i<_map->ledCount(); i++){
+        positions[i] = QVector3D(leds[i].x, leds[i].y, leds[i].z);
+    }
 
-        for(int i=startY; i<endY; i++){
-            int id = x + (i*width());
-            QPoint pt(x, i);
+    return _mapSerial;
+}
 
-            globeData.insert(id, qMakePair(pt, _image->pixel(pt)));
-        }
+int PixelMapper::getGlobeColors(QVector<QRgb>& colors) const {
+    //Snapshot of the last transmitted frame, render() skips refreshing it while held
+    QMutexLocker locker(&_snapshotLock);
+
+    const PixelMapLed* leds = _map->leds();
+    const QRgb* pixels = (const QRgb*) _snapshot.constBits();
+    int width = _snapshot.width();
+    int height = _snapshot.height();
+
+    colors.resize(_map->ledCount());
+
+    for(int i=0; i<_map->ledCount(); i++){
+        const PixelMapLed& led = leds[i];
+
+        colors[i] = (led.column < width && led.row < height) ? pixels[(led.row * width) + led.column] : qRgb(0, 0, 0);
     }
 
-    return globeData;
+    return _mapSerial;
 }
 
 
 
 void PixelMapper::insertRun(int column, LedRun* run){
-    _colToLedRun.insert(column, run);
+    _map->insertRun(column, run);
+    applyMap(_map);
 }
 
+bool PixelMapper::loadMap(const QString& filePath, QString* error){
+    QSharedPointer<PixelMap> map( new PixelMap() );
 
+    {
+        QMutexLocker locker(&_pendingLock);
+        map->setGridSpacing(_spacingX, _spacingY);
+    }
 
-void PixelMapper::render(){
-    QList<int> columns = _colToLedRun.keys();
+    if(!map->fromFile(filePath)){
+        if(error != NULL){
+            *error = QString("Failed to load %1").arg(filePath);
+        }
+        return false;
+    }
 
-    _imageLock.lock();
+    if(!map->validate(error)){
+        return false;
+    }
 
-    for(int i=0; i<columns.size(); i++){
-        int col = columns[i];
-        LedRun* run = _colToLedRun[col];
+    QMutexLocker locker(&_pendingLock);
+    _pendingMap = map;
+    _mapPath = filePath;
+
+    return true;
+}
+
+bool PixelMapper::applyPendingMap(){
+    QSharedPointer<PixelMap> map;
+
+    //Never wait on a loader, pick the map up next frame instead
+    if(!_pendingLock.tryLock()){
+        return false;
+    }
+
+    map = _pendingMap;
+    _pendingMap.clear();
+    _pendingLock.unlock();
+
+    if(map.isNull()){
+        return false;
+    }
+
+    applyMap(map);
+
+    qDebug() << "PixelMapper::applyPendingMap() - Now using " << map->path();
+
+    return true;
+}
+
+QString PixelMapper::mapPath() const {
+    QMutexLocker locker(&_pendingLock);
+    return _mapPath;
+}
+
+void PixelMapper::setGridSpacing(float x, float y){
+    QString path;
+
+    {
+        QMutexLocker locker(&_pendingLock);
+
+        if(x == _spacingX && y == _spacingY){
+            return;
+        }
+
+        _spacingX = x;
+        _spacingY = y;
+        path = _mapPath;
+    }
+
+    //Run LEDs were placed with the old spacing
+    if(!path.isEmpty()){
+        loadMap(path);
+    }
+}
+
+void PixelMapper::applyMap(const QSharedPointer<PixelMap>& map){
+    QSize size = map->size();
+
+    if(size.width() > width() || size.height() > height()){
+        setSize( qMax(size.width(), width()), qMax(size.height(), height()) );
+    }
 
-        DmxAddress addr = run->dmxStart;
+    //Channels the new map no longer drives go dark, render() fills in the rest
+    _ola->blackout();
 
-        int row = 0;
+    //Allocate the universes up front so every mapped universe is blacked out and kept alive
+    const PixelMapUniverse* universes = map->universes();
 
-        if(!run->reverse){
-            while(addr.isBefore(run->dmxEnd)){
-                //Get pixel data
+    for(int i=0; i<map->universeCount(); i++){
+        _ola->universeOffset(universes[i].universe);
+    }
+
+    {
+        QMutexLocker locker(&_snapshotLock);
+
+        //The old map is released here unless someone else still holds it
+        _map = map;
+        _mapSerial++;
+    }
+
+    _spansValid = false;
+    _ledsValid = false;
+}
+
+const LedPositions& PixelMapper::ledPositions(){
+    if(!_ledsValid || _ledsImageSize != _imageSize){
+        compileLedPositions();
+    }
 
-                QRgb pixelData = QColor(Qt::black).rgb();
-                if(_image->width() > col && _image->height() > row) {
-                    pixelData = _image->pixel(col, row);
-                }
+    return _leds;
+}
+
+void PixelMapper::compileLedPositions(){
+    _leds.count = 0;
+    _leds.x.clear();
+    _leds.y.clear();
+    _leds.z.clear();
+    _leds.columns.clear();
+    _leds.rows.clear();
+
+    const PixelMapLed* ledTable = _map->leds();
+
+    _leds.spacingX = _map->spacingX();
+    _leds.spacingY = _map->spacingY();
 
-                _ola->setPixel(addr, QColor(pixelData));
+    for(int i=0; i<_map->ledCount(); i++){
+        const PixelMapLed& led = ledTable[i];
+
+        if(led.column >= _imageSize.width() || led.row >= _imageSize.height()){
+            continue;
+        }
+
+        _leds.x.append(led.x);
+        _leds.y.append(led.y);
+        _leds.z.append(led.z);
+        _leds.columns.append(led.column);
+        _leds.rows.append(led.row);
+    }
 
-                row++;
-                addr = addr.add(3);
+    _leds.count = _leds.columns.size();
+    _leds.grid.build(_leds.x.constData(), _leds.y.constData(), _leds.z.constData(), _leds.count);
+
+    while(_leds.count > 0 && (_leds.x.size() % 4) != 0){
+        _leds.x.append(_leds.x.last());
+        _leds.y.append(_leds.y.last());
+        _leds.z.append(_leds.z.last());
+    }
+
+    _ledsImageSize = _imageSize;
+    _ledsValid = true;
+
+    qDebug() << "PixelMapper::compileLedPositions() - " << _leds.count << " leds in a "
+             << _imageSize.width() << "x" << _imageSize.height() << " image";
+}
+
+
+
+static void appendPixel(QVector<PixelSpan>& spans, int src, int dst, int red, int green, int blue){
+    if(!spans.isEmpty()){
+        PixelSpan& last = spans.last();
+        bool sameKind = ((src < 0) == (last.src < 0)) && last.red == red && last.green == green && last.blue == blue;
+
+        //The second pixel of a span sets its strides
+        if(sameKind && last.count == 1 && dst != last.dst){
+            last.srcStride = (src < 0) ? 0 : src - last.src;
+            last.dstStride = dst - last.dst;
+            last.count++;
+            return;
+        }
+
+        //Extend the previous span when this pixel continues it
+        if(sameKind && last.count > 1 && last.dst + (last.count * last.dstStride) == dst &&
+           (src < 0 || last.src + (last.count * last.srcStride) == src)){
+            last.count++;
+            return;
+        }
+    }
+
+    PixelSpan span;
+    span.src = src;
+    span.srcStride = 0;
+    span.dst = dst;
+    span.dstStride = 0;
+    span.count = 1;
+    span.red = red;
+    span.green = green;
+    span.blue = blue;
+
+    spans.append(span);
+}
+
+void PixelMapper::compileMap(const QSize& imageSize){
+    _spans.clear();
+
+    int width = imageSize.width();
+    int height = imageSize.height();
+
+    const PixelMapLed* ledTable = _map->leds();
+    const PixelMapUniverse* universeTable = _map->universes();
+
+    //LEDs are sorted by universe and channel, runs come out as consecutive channels
+    for(int u=0; u<_map->universeCount(); u++){
+        const PixelMapUniverse& universe = universeTable[u];
+        int base = _ola->universeOffset(universe.universe);
+
+        const PixelMapLed* led = ledTable + universe.firstLed;
+        const PixelMapLed* ledEnd = led + universe.ledCount;
+
+        for(; led != ledEnd; led++){
+            int src = -1;
+            if(width > led->column && height > led->row) {
+                src = (led->row * width) + led->column;
             }
+
+            int red, green, blue;
+            pixelOrderOffsets(led->order, red, green, blue);
+
+            appendPixel(_spans, src, base + led->channel, red, green, blue);
         }
-        else{
-            addr = run->dmxEnd.add(-2);
-            DmxAddress lastAddr = run->dmxStart.add(-1);
-            while(addr.isAfter(lastAddr)){
-                //Get pixel data
-                QRgb pixelData = _image->pixel(col, row);
+    }
+
+    _spansImageSize = imageSize;
+    _spansValid = true;
+
+    qDebug() << "PixelMapper::compileMap() - " << _map->ledCount() << " leds compiled to " << _spans.size() << " spans";
+}
+
+void PixelMapper::render(){
+    _frames.update();
 
-                _ola->setPixel(addr, QColor(pixelData));
+    const QImage& frame = _frames.front();
 
+    if(!_spansValid || _spansImageSize != frame.size()){
+        compileMap(frame.size());
+    }
+
+    //Format_RGB32 scanlines are exactly width * 4 bytes, no padding
+    const QRgb* pixels = (const QRgb*) frame.constBits();
+    uint8_t* channels = _ola->channelData();
+
+    const PixelSpan* span = _spans.constData();
+    const PixelSpan* spanEnd = span + _spans.size();
+
+    for(; span != spanEnd; span++){
+        uint8_t* dst = channels + span->dst;
 
-                row++;
-                addr = addr.add(-3);
+        if(span->src < 0){
+            for(int i=0; i<span->count; i++, dst += span->dstStride){
+                dst[0] = 0;
+                dst[1] = 0;
+                dst[2] = 0;
             }
+            continue;
+        }
+
+        const QRgb* src = pixels + span->src;
+
+        for(int i=0; i<span->count; i++, src += span->srcStride, dst += span->dstStride){
+            QRgb pixel = *src;
+
+            dst[span->red] = qRed(pixel);
+            dst[span->green] = qGreen(pixel);
+            dst[span->blue] = qBlue(pixel);
         }
     }
 
     _ola->sendBuffers();
-    _imageDirty = false;
-    _imageLock.unlock();
+    _imageDirty.storeRelease(0);
+
+    //Refresh the marker snapshot unless getGlobeColors() is reading it, never wait
+    if(_snapshotLock.tryLock()){
+        if(_snapshot.size() == frame.size()){
+            memcpy(_snapshot.bits(), frame.constBits(), frame.byteCount());
+        }
+        else{
+            _snapshot = frame.copy();
+        }
+
+        _snapshotLock.unlock();
+    }
 }
 
 
 QJsonDocument PixelMapper::toJson(){
+    return _map->toJson();
+}
+
+bool PixelMapper::fromFile(QString filePath){
+    /*if(filePath.isEmpty()){
+        filePath = QDir::homePath();
+        filePath.append("/.waas/pixel_map.json");
+    }*/
+
+    QSharedPointer<PixelMap> map( new PixelMap() );
+
+    {
+        QMutexLocker locker(&_pendingLock);
+        map->setGridSpacing(_spacingX, _spacingY);
+    }
+
+    if(!map->fromFile(filePath) || !map->validate()){
+        return false;
+    }
+
+    {
+        QMutexLocker locker(&_pendingLock);
+        _mapPath = filePath;
+    }
+
+    applyMap(map);
+
+    qDebug() << "PixelMapper::fromFile() - Image dimensions (" << width() << ", " << height() << ")";
+
+    return true;
+}
+
+bool PixelMapper::fromJson(QJsonDocument &doc){
+    QSharedPointer<PixelMap> map( new PixelMap() );
+
+    {
+        QMutexLocker locker(&_pendingLock);
+        map->setGridSpacing(_spacingX, _spacingY);
+    }
+
+    if(!map->fromJson(doc) || !map->validate()){
+        return false;
+    }
+
+    applyMap(map);
+
+    return true;
+}
+
+
+PixelMap::PixelMap(){
+    _spacingX = DEFAULT_PIXEL_MAP_SPACING;
+    _spacingY = DEFAULT_PIXEL_MAP_SPACING;
+    _leds = NULL;
+    _ledCount = 0;
+    _universes = NULL;
+    _universeCount = 0;
+}
+
+PixelMap::~PixelMap(){
+    qDeleteAll(_colToLedRun);
+}
+
+void PixelMap::setGridSpacing(float x, float y){
+    _spacingX = x;
+    _spacingY = y;
+}
+
+float PixelMap::spacingX() const {
+    return _spacingX;
+}
+
+float PixelMap::spacingY() const {
+    return _spacingY;
+}
+
+QString PixelMap::path() const {
+    return _path;
+}
+
+QSize PixelMap::size() const {
+    return _size;
+}
+
+int PixelMap::ledCount() const {
+    return _ledCount;
+}
+
+const PixelMapLed* PixelMap::leds() const {
+    return _leds;
+}
+
+int PixelMap::universeCount() const {
+    return _universeCount;
+}
+
+const PixelMapUniverse* PixelMap::universes() const {
+    return _universes;
+}
+
+void PixelMap::insertRun(int column, LedRun* run){
+    LedRun* previous = _colToLedRun.value(column, NULL);
+
+    if(previous != run){
+        delete previous;
+    }
+
+    _colToLedRun.insert(column, run);
+    _size = _size.expandedTo( QSize(column, run->length()) );
+
+    updateLedTable();
+}
+
+void PixelMap::updateLedTable(){
+    _file.close();
+
+    int clipped = flattenLedRuns(_colToLedRun, _points, PIXEL_ORDER_RGB, _spacingX, _spacingY, _runLeds, _runUniverses);
+
+    if(clipped > 0){
+        qWarning() << "PixelMap::updateLedTable() - Dropped" << clipped << "pixels that do not fit in their universe";
+    }
+
+    _leds = _runLeds.constData();
+    _ledCount = _runLeds.size();
+    _universes = _runUniverses.constData();
+    _universeCount = _runUniverses.size();
+}
+
+bool PixelMap::validate(QString* error) const {
+    QString reason;
+
+    if(_ledCount == 0){
+        reason = "Pixel map has no LEDs";
+    }
+
+    //Compiled maps are checked when opened, run tables are built by flattenLedRuns(), check both anyway.
+    //Run tables carry no image size, LEDs outside the image are skipped when rendering.
+    if(reason.isEmpty()){
+        int width = _file.isOpen() ? _file.width() : PIXEL_MAP_MAX_SIZE;
+        int height = _file.isOpen() ? _file.height() : PIXEL_MAP_MAX_SIZE;
+
+        checkLedTable(_leds, _ledCount, _universes, _universeCount, width, height, &reason);
+    }
+
+    for(int i=0; i<_ledCount && reason.isEmpty(); i++){
+        const PixelMapLed& led = _leds[i];
+
+        if(!qIsFinite(led.x) || !qIsFinite(led.y) || !qIsFinite(led.z)){
+            reason = QString("Pixel (%1, %2) has no position").arg(led.column).arg(led.row);
+        }
+    }
+
+    //checkLedTable() made sure the table is sorted by universe and channel, an overlap is always between neighbours
+    for(int i=1; i<_ledCount && reason.isEmpty(); i++){
+        const PixelMapLed& previous = _leds[i-1];
+        const PixelMapLed& led = _leds[i];
+
+        if(led.universe == previous.universe && led.channel < previous.channel + 3){
+            reason = QString("Pixels (%1, %2) and (%3, %4) share DMX channels at %5.%6")
+                        .arg(previous.column).arg(previous.row).arg(led.column).arg(led.row)
+                        .arg(led.universe).arg(led.channel);
+        }
+    }
+
+    if(reason.isEmpty()){
+        return true;
+    }
+
+    qCritical() << "PixelMap::validate() - " << _path << ": " << reason;
+
+    if(error != NULL){
+        *error = reason;
+    }
+
+    return false;
+}
+
+QJsonDocument PixelMap::toJson() const {
     QJsonDocument jsonDoc;
 
     QJsonArray ledRunArray;
@@ -192,21 +613,30 @@ QJsonDocument PixelMapper::toJson(){
         ledRunArray.push_back( obj );
     }
 
+    for(int i=0; i<_points.size(); i++){
+        QJsonObject obj;
+
+        obj.insert("col", QJsonValue(_points[i].column));
+        obj.insert("row", QJsonValue(_points[i].row));
+        obj.insert("led", QJsonValue(ledToJson(_points[i])));
+
+        ledRunArray.push_back( obj );
+    }
+
     jsonDoc.setArray(ledRunArray);
 
     return jsonDoc;
 }
 
-bool PixelMapper::fromFile(QString filePath){
-    /*if(filePath.isEmpty()){
-        filePath = QDir::homePath();
-        filePath.append("/.waas/pixel_map.json");
-    }*/
+bool PixelMap::fromFile(const QString& filePath){
+    if(filePath.endsWith(".wpm")){
+        return fromCompiled(filePath);
+    }
 
     QFile pixelMapFile(filePath);
 
     if(!pixelMapFile.open(QIODevice::ReadOnly)){
-        qCritical() << "PixelMapper::fromFile - Failed to load pixel map from file: " << filePath;
+        qCritical() << "PixelMap::fromFile - Failed to load pixel map from file: " << filePath;
         return false;
     }
 
@@ -220,12 +650,44 @@ bool PixelMapper::fromFile(QString filePath){
 
     pixelMapFile.close();
 
+    _path = filePath;
+
     return success;
 }
 
-bool PixelMapper::fromJson(QJsonDocument &doc){
+bool PixelMap::fromCompiled(const QString& filePath){
+    QElapsedTimer timer;
+    timer.start();
+
+    if(!_file.open(filePath)){
+        return false;
+    }
+
+    qDeleteAll(_colToLedRun);
+    _colToLedRun.clear();
+    _points.clear();
+    _runLeds.clear();
+    _runUniverses.clear();
+
+    _leds = _file.leds();
+    _ledCount = _file.ledCount();
+    _universes = _file.universes();
+    _universeCount = _file.universeCount();
+
+    _size = QSize(_file.width(), _file.height());
+    _spacingX = _file.spacingX();
+    _spacingY = _file.spacingY();
+    _path = filePath;
+
+    qDebug() << "PixelMap::fromCompiled() - " << _ledCount << " leds in " << _universeCount
+             << " universes from " << filePath << " in " << timer.nsecsElapsed() / 1000 << " us";
+
+    return true;
+}
+
+bool PixelMap::fromJson(QJsonDocument &doc){
     if(!doc.isArray()){
-        qWarning() << "PixelMapper::fromJson() - Document does not contain led run array";
+        qWarning() << "PixelMap::fromJson() - Document does not contain led run array";
         //return false;
     }
 
@@ -238,22 +700,40 @@ bool PixelMapper::fromJson(QJsonDocument &doc){
         QJsonValue itemValue = ledRunArray.at(i);
 
         if(!itemValue.isObject()){
-            qCritical() << "PixelMapper::fromJson() - Item at index " << i << " is not an object!";
+            qCritical() << "PixelMap::fromJson() - Item at index " << i << " is not an object!";
             return false;
         }
 
         QJsonObject itemObj = itemValue.toObject();
 
+        //A single LED placed by position, col and row are optional
+        if(itemObj.contains("led")){
+            PixelMapLed led;
+            int column = itemObj.contains("col") ? itemObj.value("col").toVariant().toInt() : -1;
+            int row = itemObj.contains("row") ? itemObj.value("row").toVariant().toInt() : -1;
+
+            if(!ledFromJson(itemObj.value("led").toObject(), column, row, _spacingX, _spacingY, led)){
+                qCritical() << "PixelMap::fromJson() - Bad led at index " << i;
+                return false;
+            }
+
+            minWidth = qMax(minWidth, led.column + 1);
+            minHeight = qMax(minHeight, led.row + 1);
+
+            _points.append(led);
+            continue;
+        }
+
         QJsonValue colValue = itemObj.value("col");
         QJsonValue runValue = itemObj.value("run");
 
         if(colValue.isUndefined()){
-            qCritical() << "PixelMapper::fromJson() - Undefined column";
+            qCritical() << "PixelMap::fromJson() - Undefined column";
             return false;
         }
 
         if(runValue.isUndefined()){
-            qCritical() << "PixelMapper::fromJson() - Undefined led run";
+            qCritical() << "PixelMap::fromJson() - Undefined led run";
             return false;
         }
 
@@ -261,13 +741,14 @@ bool PixelMapper::fromJson(QJsonDocument &doc){
         QJsonObject runObj = runValue.toObject();
 
         if( !ledRun->fromJson(runObj) ){
+            delete ledRun;
             return false;
         }
 
         int column = colValue.toVariant().toInt();
         int length = ledRun->length();
 
-        qDebug() << "PixelMapper::fromJson() - Column " << column << " has " << length << " globes";
+        qDebug() << "PixelMap::fromJson() - Column " << column << " has " << length << " globes";
 
         //Update image dimensions
         if(column > minWidth){
@@ -278,17 +759,15 @@ bool PixelMapper::fromJson(QJsonDocument &doc){
             minHeight = length;
         }
 
-
-
+        delete _colToLedRun.value(column, NULL);
         _colToLedRun.insert(column, ledRun);
     }
 
-    qDebug() << "PixelMapper::fromJson() - Loaded " << ledRunArray.size() << " items";
+    updateLedTable();
 
-    //Update image size
-    setSize( qMax(minWidth, width()), qMax(minHeight,height()) );
+    _size = QSize(minWidth, minHeight);
 
-    qDebug() << "PixelMapper::fromJson() - Image dimensions (" << width() << ", " << height() << ")";
+    qDebug() << "PixelMap::fromJson() - Loaded " << ledRunArray.size() << " items";
 
     return true;
 }
@@ -13,6 +13,137 @@
 #include "utils.h"
 #include "ledrun.h"
 #include "olamanager.h"
+#include "triplebuffer.h"
+#include "pixelmapfile.h"
+#include "ledgrid.h"
+
+/**
+ * @brief   A straight run of LEDs in one universe, count pixels are read starting at
+ *          image index src stepping srcStride and written as channel triplets starting at
+ *          channel dst stepping dstStride. red, green and blue are the offsets of each
+ *          colour within the triplet. A src of -1 writes black.
+ */
+struct PixelSpan {
+    int src;
+    int srcStride;
+    int dst;
+    int dstStride;
+    int count;
+    int red;
+    int green;
+    int blue;
+};
+
+/**
+ * @brief   Position of every LED, structure of arrays. x, y and z are in metres in
+ *          globes_link, they are padded with copies of the last LED to a multiple of four so
+ *          batch evaluation can always load whole SSE vectors, count is the real number of
+ *          LEDs. Image pixel (column, row) is at (column * spacingX, row * spacingY), LEDs on
+ *          the grid sit exactly on their pixel, placed LEDs anywhere.
+ */
+struct LedPositions {
+    int count;
+    QVector<float> x;
+    QVector<float> y;
+    QVector<float> z;
+
+    //Metres between image pixels
+    float spacingX;
+    float spacingY;
+
+    //Image pixel each LED shows, count entries
+    QVector<int> columns;
+    QVector<int> rows;
+
+    //Index over x, y and z in metres, query() returns indices into the arrays above
+    LedGrid grid;
+};
+
+/**
+ * @brief   A loaded pixel map, the led runs it came from if any and the LED table sorted by
+ *          universe and channel. Loaded and validated on any thread, then handed to a
+ *          PixelMapper whole.
+ */
+class PixelMap
+{
+    public:
+        PixelMap();
+        ~PixelMap();
+
+        /**
+         * @brief   Metres between image pixels, places run LEDs and maps placed LEDs to
+         *          pixels. Set before loading, a compiled map brings its own.
+         */
+        void setGridSpacing(float x, float y);
+        float spacingX() const;
+        float spacingY() const;
+
+        /**
+         * @brief   Load a JSON map, or a compiled map if the path ends in .wpm
+         */
+        bool fromFile(const QString& filePath);
+        bool fromJson(QJsonDocument& doc);
+
+        /**
+         * @brief   Map a pixel map compiled by pixel_map_compile, the LED table is used in
+         *          place and nothing is parsed
+         */
+        bool fromCompiled(const QString& filePath);
+
+        void insertRun(int column, LedRun* run);
+
+        /**
+         * @brief   The led runs and placed LEDs as JSON, empty for a compiled map
+         */
+        QJsonDocument toJson() const;
+
+        /**
+         * @brief   Reject maps that light nothing, drive a channel from two LEDs, have an
+         *          LED that does not fit in its universe, an LED table checkLedTable()
+         *          refuses or place an LED nowhere
+         * @param error     Set to the reason when the map is rejected
+         */
+        bool validate(QString* error=NULL) const;
+
+        QString path() const;
+
+        /**
+         * @brief   Image size the map needs
+         */
+        QSize size() const;
+
+        int ledCount() const;
+        const PixelMapLed* leds() const;
+
+        int universeCount() const;
+        const PixelMapUniverse* universes() const;
+
+    private:
+        Q_DISABLE_COPY(PixelMap)
+
+        /**
+         * @brief   Flatten the led runs and placed LEDs into _runLeds and point the LED
+         *          table at it
+         */
+        void updateLedTable();
+
+        QString _path;
+        QSize _size;
+        float _spacingX;
+        float _spacingY;
+
+        QMap<int, LedRun*> _colToLedRun;   //Map image columns to LedRun
+        QVector<PixelMapLed> _points;       //LEDs placed one by one
+        QVector<PixelMapLed> _runLeds;
+        QVector<PixelMapUniverse> _runUniverses;
+        PixelMapFile _file;
+
+        //From the led runs or the compiled file
+        const PixelMapLed* _leds;
+        int _ledCount;
+        const PixelMapUniverse* _universes;
+        int _universeCount;
+};
 
 class PixelMapper : public QObject
 {
@@ -22,22 +153,73 @@ class PixelMapper : public QObject
         
         void updateImage(const QImage& image);
         void updateImage(const sensor_msgs::ImagePtr& rosImage);
-        QImage* getImage();
 
+        /**
+         * @brief   Image to draw the next frame into, owned by the rendering thread until
+         *          publishFrame(). It holds an older frame and must be redrawn completely.
+         */
+        QImage* beginFrame();
+
+        /**
+         * @brief   Hand the frame from beginFrame() to render() without blocking either side
+         */
+        void publishFrame();
+
+        /**
+         * @brief   Add a run to the current map, not safe while frames are being rendered
+         */
         void insertRun(int column, LedRun* run);
 
+        /**
+         * @brief   The led runs as JSON, empty when the map was loaded from a compiled file
+         */
         QJsonDocument toJson();
+
+        /**
+         * @brief   Replace the map right away, not safe while frames are being rendered.
+         *          The current map is kept if the new one fails to load.
+         */
         bool fromJson(QJsonDocument& doc);
 
         /**
-         * @brief   Read the pixel map from the specified file. If file path is empty
-         *          defaults to "~/.waas/pixel_map.json"
+         * @brief   Read the pixel map from the specified file and use it right away, not
+         *          safe while frames are being rendered. Files ending in .wpm are compiled
+         *          maps. The current map is kept if the new one fails to load.
          * @param filePath
          * @return
          */
         bool fromFile(QString filePath=QString());
 
+        /**
+         * @brief   Load and validate a map on the calling thread and queue it for the
+         *          render thread, which swaps it in before its next frame. Safe from any
+         *          thread, the current map stays if loading fails.
+         * @param error     Set to the reason when the map is rejected
+         */
+        bool loadMap(const QString& filePath, QString* error=NULL);
+
+        /**
+         * @brief   Render thread, swap in the map queued by loadMap() between frames
+         * @return  True if the map changed
+         */
+        bool applyPendingMap();
+
+        /**
+         * @brief   Path of the map in use or queued, empty if it did not come from a file
+         */
+        QString mapPath() const;
+
+        /**
+         * @brief   Metres between globes for maps loaded from now on. A change reloads
+         *          the current map through loadMap().
+         */
+        void setGridSpacing(float x, float y);
+
         void clearImage(QColor color=QColor());
+
+        /**
+         * @brief   Reallocates every frame buffer, not safe while frames are being rendered
+         */
         void setSize(int width, int height);
 
         /**
@@ -46,33 +228,84 @@ class PixelMapper : public QObject
          */
         bool isDirty() const;
 
+        /**
+         * @brief   Image size, safe from any thread
+         */
         int width() const;
         int height() const;
 
         /**
-         * @brief   Creates a mapping of globe positions and values
-         * @return
+         * @brief   Position of every globe in metres, in LED table order. Only changes
+         *          when a new map is applied.
+         * @return  Serial of the map, as returned by getGlobeColors()
+         */
+        int getGlobePositions(QVector<QVector3D>& positions) const;
+
+        /**
+         * @brief   Colour of every globe in the last transmitted frame, in the same order
+         *          as getGlobePositions()
+         * @return  Serial of the map the colours belong to
+         */
+        int getGlobeColors(QVector<QRgb>& colors) const;
+
+        /**
+         * @brief   Every LED that has a pixel in the image, for sparse rendering. Rendering
+         *          thread only.
          */
-        QMap<int, QPair<QPoint, QRgb> > getGlobeData() const;
+        const LedPositions& ledPositions();
 
     signals:
         
 
     public slots:
         /**
-         * @brief Send image to OLA pixel display
+         * @brief Send the latest published frame to OLA pixel display
          */
         void render();
 
 
     private:
-        QMutex _imageLock;
-        QImage* _image;
-        bool _imageDirty;
+        /**
+         * @brief   Make map the current one, called between frames
+         */
+        void applyMap(const QSharedPointer<PixelMap>& map);
+
+        /**
+         * @brief   Merge the LED table into _spans for the current image size
+         */
+        void compileMap(const QSize& imageSize);
+
+        void compileLedPositions();
+
+        //Swapped under _snapshotLock, getGlobeColors() reads it from other threads
+        QSharedPointer<PixelMap> _map;
+        int _mapSerial;
+
+        //Loaded by loadMap(), waiting for the render thread
+        mutable QMutex _pendingLock;
+        QSharedPointer<PixelMap> _pendingMap;
+        QString _mapPath;
+        float _spacingX;
+        float _spacingY;
+
+        LedPositions _leds;
+        QSize _ledsImageSize;
+        bool _ledsValid;
+
+        QVector<PixelSpan> _spans;
+        QSize _spansImageSize;          //Image size _spans was compiled for
+        bool _spansValid;
+
+        TripleBuffer<QImage> _frames;
+        QSize _imageSize;               //Written under _snapshotLock, read without it on the render thread
+        QAtomicInt _imageDirty;
+
+        //Copy of the last transmitted frame for getGlobeColors()
+        mutable QMutex _snapshotLock;
+        QImage _snapshot;
 
         QColor _backgroundColor;
 
-        QMap<int, LedRun*> _colToLedRun;   //Map image columns to LedRun
         OlaManager* _ola;
 };
 
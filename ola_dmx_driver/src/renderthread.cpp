@@ -0,0 +1,138 @@
+#include "renderthread.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <ros/ros.h>
+#include <ros/console.h>
+
+#include "monotonicclock.h"
+
+
+RenderThread::RenderThread(FrameFunction frame, QObject *parent) :
+    QThread(parent)
+{
+    _frame = frame;
+    _periodNs = 33333333ULL;
+    _priority = 0;
+    _cpu = -1;
+    _reportNs = 10000000000ULL;
+    _running = 1;
+
+    _frames = 0;
+    _missed = 0;
+    _lastReportNs = 0;
+    _lastReportFrames = 0;
+}
+
+void RenderThread::setRate(double fps){
+    if(fps > 0.0){
+        _periodNs = (uint64_t)(1.0e9 / fps);
+    }
+}
+
+void RenderThread::setPriority(int priority){
+    _priority = priority;
+}
+
+void RenderThread::setCpu(int cpu){
+    _cpu = cpu;
+}
+
+void RenderThread::setReportInterval(double reportSec){
+    _reportNs = (uint64_t)(reportSec * 1.0e9);
+}
+
+void RenderThread::stop(){
+    _running.storeRelease(0);
+}
+
+void RenderThread::applyScheduling(){
+    if(_cpu >= 0){
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(_cpu, &cpus);
+
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if(error != 0){
+            ROS_WARN("RenderThread - Failed to pin to cpu %d: %s", _cpu, strerror(error));
+        }
+    }
+
+    if(_priority > 0){
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = _priority;
+
+        int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(error != 0){
+            ROS_WARN("RenderThread - Failed to set SCHED_FIFO priority %d: %s", _priority, strerror(error));
+        }
+    }
+}
+
+void RenderThread::run(){
+    applyScheduling();
+
+    uint64_t deadlineNs = monotonicNs() + _periodNs;
+    _lastReportNs = monotonicNs();
+
+    while(_running.loadAcquire()){
+        sleepUntilNs(deadlineNs);
+
+        uint64_t wakeNs = monotonicNs();
+        _latenessUs.insert( (wakeNs - deadlineNs) / 1.0e3 );
+
+        _frame();
+
+        uint64_t doneNs = monotonicNs();
+        _frameMs.insert( (doneNs - wakeNs) / 1.0e6 );
+        _frames++;
+
+        deadlineNs += _periodNs;
+
+        //Drop deadlines that already passed instead of bursting to catch up
+        if(doneNs > deadlineNs){
+            uint64_t missed = (doneNs - deadlineNs) / _periodNs + 1;
+
+            _missed += missed;
+            deadlineNs += missed * _periodNs;
+        }
+
+        if(_reportNs > 0 && doneNs - _lastReportNs >= _reportNs){
+            report();
+        }
+    }
+}
+
+void RenderThread::report(){
+    uint64_t nowNs = monotonicNs();
+    double fps = (_frames - _lastReportFrames) / ((nowNs - _lastReportNs) / 1.0e9);
+
+    double lateP50, lateP99, lateMax;
+    double frameP50, frameP99, frameMax;
+
+    _latenessUs.getStats(lateP50, lateP99, lateMax);
+    _frameMs.getStats(frameP50, frameP99, frameMax);
+
+    ROS_INFO("RenderThread - %.1f fps, wake late p50/p99/max %.0f/%.0f/%.0f us, frame p50/p99/max %.2f/%.2f/%.2f ms, %lu missed",
+             fps, lateP50, lateP99, lateMax, frameP50, frameP99, frameMax, (unsigned long)_missed);
+
+    _lastReportNs = nowNs;
+    _lastReportFrames = _frames;
+}
+
+
+bool lockProcessMemory(){
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+        ROS_WARN("lockProcessMemory() - mlockall failed: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <QtCore>
+
+#include <stdint.h>
+
+#include "rollinghistogram.h"
+
+/**
+ * @brief   Runs a frame function on its own thread at a fixed rate
+ *
+ *          Frames are paced against absolute CLOCK_MONOTONIC deadlines so timing error
+ *          does not accumulate and is independent of whatever else the ROS spinner is
+ *          doing. When a frame overruns, the missed deadlines are skipped rather than
+ *          rendered back to back.
+ */
+class RenderThread : public QThread
+{
+    Q_OBJECT
+    public:
+        typedef void (*FrameFunction)();
+
+        explicit RenderThread(FrameFunction frame, QObject *parent = 0);
+
+        void setRate(double fps);
+
+        /**
+         * @brief   SCHED_FIFO priority (1-99) applied when the thread starts, 0 keeps the
+         *          default scheduler. Needs CAP_SYS_NICE or an rtprio limit.
+         */
+        void setPriority(int priority);
+
+        /**
+         * @brief   Pin the thread to a single CPU when it starts, -1 for no affinity
+         */
+        void setCpu(int cpu);
+
+        void stop();
+
+        /**
+         * @brief   Log wake-up lateness and frame duration percentiles, called from the
+         *          render thread every reportSec seconds
+         */
+        void setReportInterval(double reportSec);
+
+    protected:
+        virtual void run();
+
+    private:
+        void applyScheduling();
+        void report();
+
+        FrameFunction _frame;
+        uint64_t _periodNs;
+        int _priority;
+        int _cpu;
+        uint64_t _reportNs;
+        QAtomicInt _running;
+
+        //Only touched by the render thread
+        RollingHistogram _latenessUs;
+        RollingHistogram _frameMs;
+        uint64_t _frames;
+        uint64_t _missed;
+        uint64_t _lastReportNs;
+        uint64_t _lastReportFrames;
+};
+
+/**
+ * @brief   Lock all current and future pages of the process into RAM
+ */
+bool lockProcessMemory();
+
+#endif // RENDERTHREAD_H
@@ -0,0 +1,34 @@
+#include "rollinghistogram.h"
+
+#include <algorithm>
+
+RollingHistogram::RollingHistogram(int capacity){
+    _samples.resize(capacity);
+    _next = 0;
+    _count = 0;
+}
+
+void RollingHistogram::insert(double value){
+    _samples[_next] = value;
+    _next = (_next + 1) % _samples.size();
+    _count = qMin(_count + 1, _samples.size());
+}
+
+int RollingHistogram::count() const {
+    return _count;
+}
+
+void RollingHistogram::getStats(double& p50, double& p99, double& max) const {
+    p50 = p99 = max = 0.0;
+
+    if(_count == 0){
+        return;
+    }
+
+    QVector<double> sorted = _samples.mid(0, _count);
+    std::sort(sorted.begin(), sorted.end());
+
+    p50 = sorted[ (_count - 1) / 2 ];
+    p99 = sorted[ ((_count - 1) * 99) / 100 ];
+    max = sorted.last();
+}
@@ -0,0 +1,28 @@
+#ifndef ROLLINGHISTOGRAM_H
+#define ROLLINGHISTOGRAM_H
+
+#include <QtCore>
+
+/**
+ * @brief   Fixed size window over the most recent samples, not thread safe
+ */
+class RollingHistogram
+{
+    public:
+        RollingHistogram(int capacity=512);
+
+        void insert(double value);
+        int count() const;
+
+        /**
+         * @brief   Percentiles over the current window, all zero when empty
+         */
+        void getStats(double& p50, double& p99, double& max) const;
+
+    private:
+        QVector<double> _samples;
+        int _next;
+        int _count;
+};
+
+#endif // ROLLINGHISTOGRAM_H
@@ -0,0 +1,242 @@
+#include "shardedsink.h"
+
+ShardedSink::ShardedSink(){
+    _syncSource = NULL;
+    _transmitGroup = NULL;
+}
+
+ShardedSink::~ShardedSink(){
+    for(int i=0; i<_shards.size(); i++){
+        delete _shards[i].sink;
+    }
+
+    //Senders are gone, nothing reports flushes any more
+    delete _syncSource;
+    delete _transmitGroup;
+}
+
+AsyncSink* ShardedSink::appendShard(OutputSink* sink, int firstUniverse, int lastUniverse){
+    Shard shard;
+    shard.sink = new AsyncSink(sink);
+    shard.firstUniverse = firstUniverse;
+    shard.lastUniverse = lastUniverse;
+    shard.universes = 0;
+
+    _shards.append(shard);
+
+    //Ranges changed, route everything again
+    _routes.clear();
+
+    for(int i=0; i<_shards.size(); i++){
+        _shards[i].universes = 0;
+    }
+
+    return shard.sink;
+}
+
+int ShardedSink::count() const {
+    return _shards.size();
+}
+
+AsyncSink* ShardedSink::shard(int index) const {
+    return _shards[index].sink;
+}
+
+void ShardedSink::setMaxRate(double fps){
+    for(int i=0; i<_shards.size(); i++){
+        _shards[i].sink->setMaxRate(fps);
+    }
+}
+
+void ShardedSink::setSyncSource(E131SyncSource* source){
+    if(source != _syncSource){
+        delete _syncSource;
+        _syncSource = source;
+    }
+}
+
+void ShardedSink::setTransmitFunction(AsyncSink::TransmitFunction transmitted){
+    delete _transmitGroup;
+    _transmitGroup = new TransmitGroup(transmitted);
+
+    for(int i=0; i<_shards.size(); i++){
+        _shards[i].sink->setTransmitGroup(_transmitGroup);
+    }
+}
+
+int ShardedSink::route(int universe){
+    QHash<int,int>::const_iterator iter = _routes.constFind(universe);
+
+    if(iter != _routes.constEnd()){
+        return iter.value();
+    }
+
+    int best = -1;
+
+    for(int i=0; i<_shards.size(); i++){
+        const Shard& shard = _shards[i];
+
+        if(universe < shard.firstUniverse || universe > shard.lastUniverse){
+            continue;
+        }
+
+        if(best < 0 || shard.universes < _shards[best].universes){
+            best = i;
+        }
+    }
+
+    if(best >= 0){
+        _shards[best].universes++;
+    }
+    else{
+        qWarning() << "ShardedSink - No output for universe " << universe;
+    }
+
+    _routes.insert(universe, best);
+
+    return best;
+}
+
+bool ShardedSink::send(int universe, const uint8_t* channels){
+    int index = route(universe);
+
+    if(index < 0){
+        return false;
+    }
+
+    return _shards[index].sink->send(universe, channels);
+}
+
+bool ShardedSink::flush(){
+    bool ok = true;
+
+    //Every shard gets the frame boundary, idle shards still pace their keepalives
+    for(int i=0; i<_shards.size(); i++){
+        ok = _shards[i].sink->flush() && ok;
+    }
+
+    return ok;
+}
+
+QString ShardedSink::name() const {
+    QStringList names;
+
+    for(int i=0; i<_shards.size(); i++){
+        const Shard& shard = _shards[i];
+
+        if(shard.lastUniverse == INT_MAX){
+            names.append( QString("%1@%2-").arg(shard.sink->name()).arg(shard.firstUniverse) );
+        }
+        else{
+            names.append( QString("%1@%2-%3").arg(shard.sink->name()).arg(shard.firstUniverse).arg(shard.lastUniverse) );
+        }
+    }
+
+    return names.join(",");
+}
+
+
+/*
+ * Split an entry into its output and a trailing @first-last range, range is empty
+ * when the entry has none
+ */
+static void splitUniverseRange(const QString& entry, QString& output, QString& range){
+    QRegExp suffix("@\\s*(\\d+\\s*(-\\s*\\d*)?)\\s*$");
+    int at = suffix.indexIn(entry);
+
+    if(at < 0){
+        output = entry;
+        range.clear();
+        return;
+    }
+
+    output = entry.left(at);
+    range = suffix.cap(1).remove(' ');
+}
+
+bool hasUniverseRanges(const QString& spec){
+    QStringList entries = spec.split(',', QString::SkipEmptyParts);
+
+    for(int i=0; i<entries.size(); i++){
+        QString output;
+        QString range;
+
+        splitUniverseRange(entries[i], output, range);
+
+        if(!range.isEmpty()){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+ShardedSink* createShardedSink(const QString& spec, int shards, const OutputSinkOptions& baseOptions){
+    ShardedSink* sharded = new ShardedSink();
+    OutputSinkOptions options = baseOptions;
+
+    //Receivers can only latch the shards together if they are one E1.31 source
+    if(options.e131SyncUniverse > 0 && options.e131SyncSource == NULL){
+        options.e131SyncSource = new E131SyncSource(options.e131SyncUniverse);
+        sharded->setSyncSource(options.e131SyncSource);
+    }
+
+    if(!hasUniverseRanges(spec)){
+        for(int i=0; i<qMax(1, shards); i++){
+            OutputSink* sink = createOutputSink(spec, options);
+
+            if(sink == NULL){
+                delete sharded;
+                return NULL;
+            }
+
+            sharded->appendShard(sink);
+        }
+
+        return sharded;
+    }
+
+    QStringList entries = spec.split(',', QString::SkipEmptyParts);
+
+    for(int i=0; i<entries.size(); i++){
+        QString output;
+        QString range;
+
+        splitUniverseRange(entries[i], output, range);
+
+        int firstUniverse = 1;
+        int lastUniverse = INT_MAX;
+
+        if(!range.isEmpty()){
+            bool firstOk = true;
+            bool lastOk = true;
+
+            firstUniverse = range.section('-', 0, 0).toInt(&firstOk);
+
+            if(range.contains('-')){
+                QString last = range.section('-', 1).trimmed();
+                lastUniverse = last.isEmpty() ? INT_MAX : last.toInt(&lastOk);
+            }
+            else{
+                lastUniverse = firstUniverse;
+            }
+
+            if(!firstOk || !lastOk || lastUniverse < firstUniverse){
+                qCritical() << "createShardedSink() - Bad universe range " << entries[i];
+                delete sharded;
+                return NULL;
+            }
+        }
+
+        OutputSink* sink = createOutputSink(output, options);
+
+        if(sink == NULL){
+            delete sharded;
+            return NULL;
+        }
+
+        sharded->appendShard(sink, firstUniverse, lastUniverse);
+    }
+
+    return sharded;
+}
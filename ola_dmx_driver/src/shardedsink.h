@@ -0,0 +1,94 @@
+#ifndef SHARDEDSINK_H
+#define SHARDEDSINK_H
+
+#include <QtCore>
+
+#include <limits.h>
+#include <stdint.h>
+
+#include "outputsink.h"
+#include "asyncsink.h"
+
+/**
+ * @brief   Splits the universes of a frame across several outputs, each sending from its
+ *          own AsyncSink thread with its own pacing
+ *
+ *          Every shard takes a range of universes. A universe is routed the first time it
+ *          is sent, to the shard covering it that has the fewest universes so far, so
+ *          shards with overlapping ranges share the load evenly. Universes no shard
+ *          covers are dropped. E1.31 shards built by createShardedSink() share one
+ *          E131SyncSource, so receivers latch the universes of all shards together.
+ */
+class ShardedSink : public OutputSink
+{
+    public:
+        ShardedSink();
+        virtual ~ShardedSink();
+
+        /**
+         * @brief   Add a shard sending universes first to last through sink, which is
+         *          wrapped in an AsyncSink and owned by the ShardedSink
+         */
+        AsyncSink* appendShard(OutputSink* sink, int firstUniverse=1, int lastUniverse=INT_MAX);
+
+        int count() const;
+        AsyncSink* shard(int index) const;
+
+        /**
+         * @brief   Pace every shard to at most this many frames per second, see
+         *          AsyncSink::setMaxRate()
+         */
+        void setMaxRate(double fps);
+
+        /**
+         * @brief   Sync source of the E1.31 shards, owned by the ShardedSink and deleted
+         *          after them
+         */
+        void setSyncSource(E131SyncSource* source);
+
+        /**
+         * @brief   Called once per frame after the last shard has flushed it, see
+         *          TransmitGroup. Set once, after the shards were appended and
+         *          before the first flush().
+         */
+        void setTransmitFunction(AsyncSink::TransmitFunction transmitted);
+
+        virtual bool send(int universe, const uint8_t* channels);
+        virtual bool flush();
+        virtual QString name() const;
+
+    private:
+        struct Shard {
+            AsyncSink* sink;
+            int firstUniverse;
+            int lastUniverse;
+            int universes;              //Universes routed here so far
+        };
+
+        int route(int universe);
+
+        QVector<Shard> _shards;
+        QHash<int,int> _routes;         //Universe to shard, -1 when no shard covers it
+        E131SyncSource* _syncSource;
+        TransmitGroup* _transmitGroup;
+};
+
+/**
+ * @brief   Build a ShardedSink from an output spec
+ *
+ *          Entries of the spec may end in @first-last to send only that universe range,
+ *          each entry is then its own shard instead of fanning out. Only a trailing
+ *          @first-last counts, an @ anywhere else belongs to the output. Without ranges the
+ *          whole spec is created shards times and universes are spread evenly over the
+ *          copies.
+ *
+ * @return  NULL if an entry can not be created
+ */
+ShardedSink* createShardedSink(const QString& spec, int shards, const OutputSinkOptions& baseOptions=OutputSinkOptions());
+
+/**
+ * @brief   True if any entry of the spec ends in a universe range
+ */
+bool hasUniverseRanges(const QString& spec);
+
+#endif // SHARDEDSINK_H
@@ -0,0 +1,76 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QtCore>
+
+/**
+ * @brief   Bounded lock-free queue for exactly one producer thread and one consumer
+ *          thread. Neither side ever blocks, push() fails when the queue is full.
+ */
+template <typename T>
+class SpscQueue
+{
+    public:
+        /**
+         * @param capacity  Rounded up to a power of two
+         */
+        explicit SpscQueue(int capacity=256){
+            int size = 1;
+            while(size < capacity){
+                size <<= 1;
+            }
+
+            _items.resize(size);
+            _mask = size - 1;
+        }
+
+        /**
+         * @brief   Producer side
+         * @return  False if the queue is full
+         */
+        bool push(const T& item){
+            unsigned int head = _head.load();
+            unsigned int tail = _tail.loadAcquire();
+
+            //Unsigned so the counters may wrap
+            if(head - tail > _mask){
+                return false;
+            }
+
+            _items[head & _mask] = item;
+            _head.storeRelease(head + 1);
+
+            return true;
+        }
+
+        /**
+         * @brief   Consumer side
+         * @return  False if the queue is empty
+         */
+        bool pop(T& item){
+            unsigned int tail = _tail.load();
+            unsigned int head = _head.loadAcquire();
+
+            if(head == tail){
+                return false;
+            }
+
+            item = _items[tail & _mask];
+            _tail.storeRelease(tail + 1);
+
+            return true;
+        }
+
+        int capacity() const {
+            return (int)_mask + 1;
+        }
+
+    private:
+        QVector<T> _items;
+        unsigned int _mask;
+
+        QAtomicInt _head;   //Written by the producer only
+        QAtomicInt _tail;   //Written by the consumer only
+};
+
+#endif // SPSCQUEUE_H
@@ -19,8 +19,8 @@ StarInfo::StarInfo(ObjectType t, PositionMethod m) {
     }
 }
 
-StarInfo::StarInfo(int id, BlobInfo* blob, ObjectType t, PositionMethod m) {
-    position = blob->centroid;
+StarInfo::StarInfo(int id, const BlobInfo& blob, ObjectType t, PositionMethod m) {
+    position = blob.centroid;
     velocity.setValue(0,0,0);
     force.setValue(0,0,0);
     mass = 1.0f;
@@ -130,16 +130,16 @@ void Starfield::update(const RenderData& blobs) {
         StarInfo* star = sensorStars.value();
         int sensorId = star->trackedBlobId;
 
-        QMultiMap<int, BlobInfo*>::const_iterator blobIter = blobs.blobs.find(sensorId);
+        int track = blobs.tracks.find(sensorId);
 
-        if(blobIter == blobs.blobs.end()){
+        if(track == -1){
             //Delete star
             sensorStars = _starsByMethod.erase(sensorStars);
             removeLater.push_back(star);
             continue;
         }
 
-        star->position = blobIter.value()->centroid;
+        star->position.setValue( blobs.tracks.predictedX()[track], blobs.tracks.predictedY()[track], blobs.tracks.predictedZ()[track] );
         sensorStars++;
     }
     removeStars(removeLater);
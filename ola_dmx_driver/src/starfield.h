@@ -15,7 +15,7 @@ struct StarInfo {
     enum ObjectType { Star=1, Emitter=2, Attractor=3, Repulsor=4};
 
     StarInfo(ObjectType t=Star, PositionMethod m = Physics);
-    StarInfo(int id, BlobInfo* blob, ObjectType t=Star, PositionMethod m=Sensor);
+    StarInfo(int id, const BlobInfo& blob, ObjectType t=Star, PositionMethod m=Sensor);
     void updatePosition();
 
     tf::Vector3 position;
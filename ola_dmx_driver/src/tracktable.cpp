@@ -0,0 +1,255 @@
+#include "tracktable.h"
+
+#include <math.h>
+
+TrackTable::TrackTable(int capacity){
+    _capacity = qMax(1, capacity);
+    _count = 0;
+    _smoothing = DEFAULT_VELOCITY_SMOOTHING;
+
+    _ids.resize(_capacity);
+    _heads.resize(_capacity);
+    _lengths.resize(_capacity);
+    _vx.resize(_capacity);
+    _vy.resize(_capacity);
+    _vz.resize(_capacity);
+    _px.resize(_capacity);
+    _py.resize(_capacity);
+    _pz.resize(_capacity);
+
+    int samples = _capacity * HISTORY;
+
+    _x.resize(samples);
+    _y.resize(samples);
+    _z.resize(samples);
+    _width.resize(samples);
+    _depth.resize(samples);
+    _realWidth.resize(samples);
+    _realDepth.resize(samples);
+    _stamps.resize(samples);
+}
+
+int TrackTable::capacity() const {
+    return _capacity;
+}
+
+int TrackTable::count() const {
+    return _count;
+}
+
+int TrackTable::find(int id) const {
+    const int* ids = _ids.constData();
+
+    for(int track=0; track<_count; track++){
+        if(ids[track] == id){
+            return track;
+        }
+    }
+
+    return -1;
+}
+
+int TrackTable::id(int track) const {
+    return _ids[track];
+}
+
+int TrackTable::length(int track) const {
+    return _lengths[track];
+}
+
+int TrackTable::sample(int track, int age) const {
+    int slot = (_heads[track] - age) & (HISTORY - 1);
+    return (track * HISTORY) + slot;
+}
+
+const float* TrackTable::x() const {
+    return _x.constData();
+}
+
+const float* TrackTable::y() const {
+    return _y.constData();
+}
+
+const float* TrackTable::z() const {
+    return _z.constData();
+}
+
+const float* TrackTable::width() const {
+    return _width.constData();
+}
+
+const float* TrackTable::depth() const {
+    return _depth.constData();
+}
+
+const float* TrackTable::realWidth() const {
+    return _realWidth.constData();
+}
+
+const float* TrackTable::realDepth() const {
+    return _realDepth.constData();
+}
+
+const ros::Time* TrackTable::stamps() const {
+    return _stamps.constData();
+}
+
+const float* TrackTable::velocityX() const {
+    return _vx.constData();
+}
+
+const float* TrackTable::velocityY() const {
+    return _vy.constData();
+}
+
+const float* TrackTable::velocityZ() const {
+    return _vz.constData();
+}
+
+const float* TrackTable::predictedX() const {
+    return _px.constData();
+}
+
+const float* TrackTable::predictedY() const {
+    return _py.constData();
+}
+
+const float* TrackTable::predictedZ() const {
+    return _pz.constData();
+}
+
+void TrackTable::setVelocitySmoothing(float alpha){
+    _smoothing = qBound(0.0f, alpha, 1.0f);
+}
+
+void TrackTable::predict(const ros::Time& outputTime, float horizonSec, float maxDistance){
+    for(int track=0; track<_count; track++){
+        int head = sample(track, 0);
+
+        float dt = qBound(0.0f, (float)(outputTime - _stamps[head]).toSec(), qMax(0.0f, horizonSec));
+
+        float dx = _vx[track] * dt;
+        float dy = _vy[track] * dt;
+        float dz = _vz[track] * dt;
+
+        float distance2 = (dx*dx) + (dy*dy) + (dz*dz);
+
+        //Fast or noisy tracks would overshoot, keep the step short
+        if(distance2 > (maxDistance * maxDistance)){
+            float scale = maxDistance / sqrtf(distance2);
+
+            dx *= scale;
+            dy *= scale;
+            dz *= scale;
+        }
+
+        _px[track] = _x[head] + dx;
+        _py[track] = _y[head] + dy;
+        _pz[track] = _z[head] + dz;
+    }
+}
+
+int TrackTable::insert(int id){
+    if(_count >= _capacity){
+        return -1;
+    }
+
+    int track = _count++;
+
+    _ids[track] = id;
+    _heads[track] = HISTORY - 1;
+    _lengths[track] = 0;
+    _vx[track] = 0.0f;
+    _vy[track] = 0.0f;
+    _vz[track] = 0.0f;
+
+    return track;
+}
+
+void TrackTable::append(int track, const BlobInfo& blob){
+    if(_lengths[track] > 0){
+        int previous = sample(track, 0);
+        float dt = (blob.timestamp - _stamps[previous]).toSec();
+
+        //Sightings from the same cloud share a stamp and say nothing about motion
+        if(dt > 0.001f){
+            float vx = (blob.centroid.x() - _x[previous]) / dt;
+            float vy = (blob.centroid.y() - _y[previous]) / dt;
+            float vz = (blob.centroid.z() - _z[previous]) / dt;
+
+            _vx[track] += _smoothing * (vx - _vx[track]);
+            _vy[track] += _smoothing * (vy - _vy[track]);
+            _vz[track] += _smoothing * (vz - _vz[track]);
+        }
+    }
+
+    int slot = (_heads[track] + 1) & (HISTORY - 1);
+    int i = (track * HISTORY) + slot;
+
+    _heads[track] = slot;
+    _lengths[track] = qMin(_lengths[track] + 1, (int)HISTORY);
+
+    _x[i] = blob.centroid.x();
+    _y[i] = blob.centroid.y();
+    _z[i] = blob.centroid.z();
+    _width[i] = blob.bounds.x();
+    _depth[i] = blob.bounds.y();
+    _realWidth[i] = blob.realDimensions.x();
+    _realDepth[i] = blob.realDimensions.y();
+    _stamps[i] = blob.timestamp;
+}
+
+void TrackTable::expire(const ros::Time& cutoff){
+    int track = 0;
+
+    while(track < _count){
+        //Oldest samples sit at the tail of the ring
+        while(_lengths[track] > 0 && _stamps[ sample(track, _lengths[track] - 1) ] < cutoff){
+            _lengths[track]--;
+        }
+
+        if(_lengths[track] == 0){
+            removeTrack(track);     //Moves the last track here, look at this index again
+        }
+        else{
+            track++;
+        }
+    }
+}
+
+void TrackTable::clear(){
+    _count = 0;
+}
+
+void TrackTable::removeTrack(int track){
+    int last = _count - 1;
+
+    if(track != last){
+        _ids[track] = _ids[last];
+        _heads[track] = _heads[last];
+        _lengths[track] = _lengths[last];
+        _vx[track] = _vx[last];
+        _vy[track] = _vy[last];
+        _vz[track] = _vz[last];
+        _px[track] = _px[last];
+        _py[track] = _py[last];
+        _pz[track] = _pz[last];
+
+        int dst = track * HISTORY;
+        int src = last * HISTORY;
+
+        memcpy(_x.data() + dst, _x.constData() + src, HISTORY * sizeof(float));
+        memcpy(_y.data() + dst, _y.constData() + src, HISTORY * sizeof(float));
+        memcpy(_z.data() + dst, _z.constData() + src, HISTORY * sizeof(float));
+        memcpy(_width.data() + dst, _width.constData() + src, HISTORY * sizeof(float));
+        memcpy(_depth.data() + dst, _depth.constData() + src, HISTORY * sizeof(float));
+        memcpy(_realWidth.data() + dst, _realWidth.constData() + src, HISTORY * sizeof(float));
+        memcpy(_realDepth.data() + dst, _realDepth.constData() + src, HISTORY * sizeof(float));
+
+        for(int i=0; i<HISTORY; i++){
+            _stamps[dst + i] = _stamps[src + i];
+        }
+    }
+
+    _count = last;
+}
@@ -0,0 +1,144 @@
+#ifndef TRACKTABLE_H
+#define TRACKTABLE_H
+
+#include <ros/ros.h>
+#include <tf/tf.h>
+
+#include <QtCore>
+
+#define DEFAULT_TRACK_CAPACITY (128)
+#define DEFAULT_VELOCITY_SMOOTHING (0.3f)
+
+/**
+ * @brief   One blob sighting from the point cloud, centroid and bounds in pixels
+ */
+struct BlobInfo {
+    tf::Vector3 centroid;
+    tf::Vector3 bounds;
+    tf::Vector3 realDimensions;
+    ros::Time timestamp;        //Capture time of the point cloud
+    ros::Time received;         //Arrival in pixel_map_node
+};
+
+/**
+ * @brief   Fixed pool of blob tracks with the recent sightings of each, stored as
+ *          structure of arrays
+ *
+ *          Live tracks are packed at indices 0..count()-1, removing a track moves the last
+ *          one into its place so track indices are only stable until the next update. Every
+ *          track owns HISTORY consecutive sample slots used as a ring buffer, sample(track, 0)
+ *          is the newest sighting. Sample fields are read through the flat arrays with the
+ *          index sample() returns.
+ *
+ *          Each track also keeps an exponentially smoothed velocity, updated as sightings
+ *          arrive, and a head position extrapolated to the output time by predict().
+ *
+ *          Nothing is allocated after construction.
+ */
+class TrackTable
+{
+    public:
+        enum { HISTORY = 64 };
+
+        explicit TrackTable(int capacity=DEFAULT_TRACK_CAPACITY);
+
+        int capacity() const;
+        int count() const;
+
+        /**
+         * @brief   Track index of the track with id, -1 if there is none
+         */
+        int find(int id) const;
+
+        int id(int track) const;
+
+        /**
+         * @brief   Number of samples held by a track, 1..HISTORY
+         */
+        int length(int track) const;
+
+        /**
+         * @brief   Index into the sample arrays of the age-th newest sample of a track
+         */
+        int sample(int track, int age) const;
+
+        const float* x() const;
+        const float* y() const;
+        const float* z() const;
+        const float* width() const;         //Bounds in pixels
+        const float* depth() const;
+        const float* realWidth() const;     //Bounds in meters
+        const float* realDepth() const;
+        const ros::Time* stamps() const;
+
+        //Per track, in sample units per second
+        const float* velocityX() const;
+        const float* velocityY() const;
+        const float* velocityZ() const;
+
+        //Per track, the newest sample moved forward by predict()
+        const float* predictedX() const;
+        const float* predictedY() const;
+        const float* predictedZ() const;
+
+        /**
+         * @brief   Weight of the newest sighting in the velocity average, 0..1. Set from
+         *          the thread that inserts and predicts.
+         */
+        void setVelocitySmoothing(float alpha);
+
+        /**
+         * @brief   Extrapolate every track head to outputTime along its velocity
+         * @param horizonSec    Never extrapolate further than this, 0 uses the newest samples as is
+         * @param maxDistance   Clamp the length of the extrapolation, same units as the samples
+         */
+        void predict(const ros::Time& outputTime, float horizonSec, float maxDistance);
+
+        /**
+         * @brief   Start a new empty track
+         * @return  Track index, -1 if the pool is full
+         */
+        int insert(int id);
+
+        /**
+         * @brief   Add a sighting to a track, overwrites the oldest sample once the ring is full
+         */
+        void append(int track, const BlobInfo& blob);
+
+        /**
+         * @brief   Drop samples stamped before cutoff and tracks left without samples
+         */
+        void expire(const ros::Time& cutoff);
+
+        void clear();
+
+    private:
+        void removeTrack(int track);
+
+        int _capacity;
+        int _count;
+
+        //Per track
+        QVector<int> _ids;
+        QVector<int> _heads;        //Slot of the newest sample
+        QVector<int> _lengths;
+        QVector<float> _vx;
+        QVector<float> _vy;
+        QVector<float> _vz;
+        QVector<float> _px;
+        QVector<float> _py;
+        QVector<float> _pz;
+        float _smoothing;
+
+        //Per sample, HISTORY slots per track
+        QVector<float> _x;
+        QVector<float> _y;
+        QVector<float> _z;
+        QVector<float> _width;
+        QVector<float> _depth;
+        QVector<float> _realWidth;
+        QVector<float> _realDepth;
+        QVector<ros::Time> _stamps;
+};
+
+#endif // TRACKTABLE_H
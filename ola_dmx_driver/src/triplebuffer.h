@@ -0,0 +1,84 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <QtCore>
+
+/**
+ * @brief   Lock-free hand off of whole frames from one writer thread to one reader thread
+ *
+ *          The writer always owns a back buffer and the reader always owns a front buffer.
+ *          The third buffer sits in the middle. publish() swaps back and middle and
+ *          update() swaps middle and front when the middle holds an unread frame. Neither
+ *          side blocks, and the reader sees the latest complete frame. Frames the reader
+ *          never got to are skipped.
+ *
+ *          The back buffer handed out after publish() holds an older frame, writers must
+ *          redraw it completely.
+ */
+template <typename T>
+class TripleBuffer
+{
+    public:
+        TripleBuffer(){
+            _back = 0;
+            _middle = 1;
+            _front = 2;
+        }
+
+        /**
+         * @brief   Writer side, the buffer to draw the next frame into
+         */
+        T& back(){
+            return _buffers[_back];
+        }
+
+        /**
+         * @brief   Writer side, make the back buffer the latest frame
+         * @return  True if this replaced a frame the reader never took
+         */
+        bool publish(){
+            int previous = _middle.fetchAndStoreAcqRel(_back | FRESH_BIT);
+            _back = previous & INDEX_MASK;
+
+            return (previous & FRESH_BIT) != 0;
+        }
+
+        /**
+         * @brief   Reader side, take the latest published frame if there is a new one
+         * @return  True if front() changed
+         */
+        bool update(){
+            if((_middle.loadAcquire() & FRESH_BIT) == 0){
+                return false;
+            }
+
+            int previous = _middle.fetchAndStoreAcqRel(_front);
+            _front = previous & INDEX_MASK;
+
+            return true;
+        }
+
+        /**
+         * @brief   Reader side, the latest frame as of the last update()
+         */
+        const T& front() const {
+            return _buffers[_front];
+        }
+
+        /**
+         * @brief   Direct access for setup while neither side is running
+         */
+        T& buffer(int index){
+            return _buffers[index];
+        }
+
+    private:
+        enum { INDEX_MASK = 0x3, FRESH_BIT = 0x4 };
+
+        T _buffers[3];
+        int _back;              //Writer only
+        int _front;             //Reader only
+        QAtomicInt _middle;     //Index of the middle buffer plus FRESH_BIT when unread
+};
+
+#endif // TRIPLEBUFFER_H
@@ -0,0 +1,33 @@
+#ifndef VOXELCODEC_H
+#define VOXELCODEC_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "point_downsample/VoxelCloud.h"
+
+namespace point_downsample {
+
+/**
+ * @brief   Quantize a cloud onto a voxel grid of edge leafSize and pack it into msg.
+ *
+ *          Every point is stored as three 16-bit voxel offsets relative to the grid
+ *          origin (the minimum voxel of the cloud). RAW keeps point order at 6 bytes
+ *          per point. DELTA sorts the voxel keys and stores varint encoded deltas with
+ *          run lengths for consecutive voxels, which is typically 1-2 bytes per point
+ *          for voxel aligned clouds. Non-finite points are dropped.
+ * @return  False if the cloud spans more than 65535 voxels on any axis or the encoding
+ *          is neither RAW nor DELTA
+ */
+bool encodeVoxelCloud(const pcl::PointCloud<pcl::PointXYZ>& cloud, float leafSize, uint8_t encoding, VoxelCloud& msg);
+
+/**
+ * @brief   Unpack a VoxelCloud into voxel center points
+ * @return  False if the message is truncated, holds more points than point_count or
+ *          uses an unknown encoding
+ */
+bool decodeVoxelCloud(const VoxelCloud& msg, pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+}
+
+#endif // VOXELCODEC_H
@@ -0,0 +1,261 @@
+#include "cloudcapture.h"
+
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ros/ros.h>
+#include <ros/serialization.h>
+
+
+static bool writeAll(int fd, const void* data, size_t length){
+    const uint8_t* bytes = (const uint8_t*) data;
+
+    while(length > 0){
+        ssize_t written = ::write(fd, bytes, length);
+
+        if(written < 0){
+            if(errno == EINTR){
+                continue;
+            }
+
+            return false;
+        }
+
+        bytes += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+static const uint8_t* mapFile(const std::string& path, size_t& size){
+    size = 0;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        return NULL;
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0){
+        ::close(fd);
+        return NULL;
+    }
+
+    void* map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if(map == MAP_FAILED){
+        return NULL;
+    }
+
+    size = info.st_size;
+    return (const uint8_t*) map;
+}
+
+
+CaptureWriter::CaptureWriter(){
+    _dataFd = -1;
+    _indexFd = -1;
+    _dataSize = 0;
+    _frames = 0;
+}
+
+CaptureWriter::~CaptureWriter(){
+    close();
+}
+
+bool CaptureWriter::open(const std::string& path){
+    close();
+
+    _dataFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    _indexFd = ::open((path + ".idx").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+    if(_dataFd < 0 || _indexFd < 0){
+        ROS_ERROR("CaptureWriter::open() - Failed to open %s", path.c_str());
+        close();
+        return false;
+    }
+
+    struct stat dataInfo, indexInfo;
+    fstat(_dataFd, &dataInfo);
+    fstat(_indexFd, &indexInfo);
+
+    _dataSize = dataInfo.st_size;
+    _frames = indexInfo.st_size / sizeof(CaptureIndexEntry);
+
+    //Drop a partial trailing index entry left by an interrupted capture
+    if((uint64_t)indexInfo.st_size != _frames * sizeof(CaptureIndexEntry)){
+        if(ftruncate(_indexFd, _frames * sizeof(CaptureIndexEntry)) != 0){
+            ROS_WARN("CaptureWriter::open() - Failed to trim partial index entry");
+        }
+    }
+
+    if(_dataSize == 0){
+        if(!writeAll(_dataFd, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE)){
+            close();
+            return false;
+        }
+
+        _dataSize = CAPTURE_MAGIC_SIZE;
+    }
+
+    return true;
+}
+
+void CaptureWriter::close(){
+    if(_dataFd >= 0){
+        ::close(_dataFd);
+    }
+
+    if(_indexFd >= 0){
+        ::close(_indexFd);
+    }
+
+    _dataFd = -1;
+    _indexFd = -1;
+}
+
+bool CaptureWriter::isOpen() const {
+    return _dataFd >= 0;
+}
+
+uint64_t CaptureWriter::frameCount() const {
+    return _frames;
+}
+
+bool CaptureWriter::write(const sensor_msgs::PointCloud2& cloud, const ros::Time& receiveTime){
+    if(!isOpen()){
+        return false;
+    }
+
+    uint32_t length = ros::serialization::serializationLength(cloud);
+    _buffer.resize(length);
+
+    ros::serialization::OStream stream(&_buffer[0], length);
+    ros::serialization::serialize(stream, cloud);
+
+    CaptureIndexEntry entry;
+    entry.offset = _dataSize;
+    entry.length = length;
+    entry.stampNs = cloud.header.stamp.toNSec();
+    entry.receiveNs = receiveTime.toNSec();
+
+    if(!writeAll(_dataFd, &_buffer[0], length)){
+        ROS_ERROR("CaptureWriter::write() - Data write failed");
+        rollback();
+        return false;
+    }
+
+    if(!writeAll(_indexFd, &entry, sizeof(entry))){
+        ROS_ERROR("CaptureWriter::write() - Index write failed");
+        rollback();
+        return false;
+    }
+
+    _dataSize += length;
+    _frames++;
+    return true;
+}
+
+void CaptureWriter::rollback(){
+    //Later records must land at the offsets their index entries will claim
+    if(ftruncate(_dataFd, _dataSize) != 0 || ftruncate(_indexFd, _frames * sizeof(CaptureIndexEntry)) != 0){
+        ROS_ERROR("CaptureWriter::rollback() - Failed to trim the partial record, closing the capture");
+        close();
+    }
+}
+
+
+CaptureReader::CaptureReader(){
+    _data = NULL;
+    _dataSize = 0;
+    _index = NULL;
+    _indexSize = 0;
+    _frames = 0;
+}
+
+CaptureReader::~CaptureReader(){
+    close();
+}
+
+bool CaptureReader::open(const std::string& path){
+    close();
+
+    _data = mapFile(path, _dataSize);
+    if(_data == NULL || _dataSize < CAPTURE_MAGIC_SIZE || memcmp(_data, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0){
+        ROS_ERROR("CaptureReader::open() - %s is not a capture file", path.c_str());
+        close();
+        return false;
+    }
+
+    _index = (const CaptureIndexEntry*) mapFile(path + ".idx", _indexSize);
+    if(_index == NULL){
+        ROS_ERROR("CaptureReader::open() - Missing or empty index %s.idx", path.c_str());
+        close();
+        return false;
+    }
+
+    //Only count entries whose record made it to disk
+    _frames = _indexSize / sizeof(CaptureIndexEntry);
+    while(_frames > 0 && _index[_frames - 1].offset + _index[_frames - 1].length > _dataSize){
+        _frames--;
+    }
+
+    return true;
+}
+
+void CaptureReader::close(){
+    if(_data != NULL){
+        munmap((void*)_data, _dataSize);
+    }
+
+    if(_index != NULL){
+        munmap((void*)_index, _indexSize);
+    }
+
+    _data = NULL;
+    _dataSize = 0;
+    _index = NULL;
+    _indexSize = 0;
+    _frames = 0;
+}
+
+uint64_t CaptureReader::frameCount() const {
+    return _frames;
+}
+
+const CaptureIndexEntry& CaptureReader::entry(uint64_t index) const {
+    return _index[index];
+}
+
+bool CaptureReader::readFrame(uint64_t index, sensor_msgs::PointCloud2& cloud) const {
+    if(index >= _frames){
+        return false;
+    }
+
+    const CaptureIndexEntry& record = _index[index];
+
+    if(record.offset < CAPTURE_MAGIC_SIZE || record.offset > _dataSize || record.length > _dataSize - record.offset){
+        ROS_ERROR("CaptureReader::readFrame() - Index entry %llu is outside the data file", (unsigned long long) index);
+        return false;
+    }
+
+    //IStream never writes through the pointer, the mapping stays read-only
+    ros::serialization::IStream stream( (uint8_t*)(_data + record.offset), record.length );
+
+    try{
+        ros::serialization::deserialize(stream, cloud);
+    }
+    catch(ros::Exception& e){
+        ROS_ERROR("CaptureReader::readFrame() - Record %llu is corrupt: %s", (unsigned long long) index, e.what());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef CLOUDCAPTURE_H
+#define CLOUDCAPTURE_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <ros/time.h>
+#include <sensor_msgs/PointCloud2.h>
+
+/*
+ * Capture file layout
+ *
+ *  <file>      "WAASCAP1" followed by ros::serialization encoded sensor_msgs/PointCloud2
+ *              records, appended back to back
+ *  <file>.idx  One CaptureIndexEntry per record
+ *
+ * A record is written to the data file before its index entry, so a capture cut short
+ * by a crash or Ctrl-C is always readable up to the last complete index entry. A write
+ * that fails is trimmed off both files again.
+ */
+
+#define CAPTURE_MAGIC       "WAASCAP1"
+#define CAPTURE_MAGIC_SIZE  (8)
+
+struct CaptureIndexEntry {
+    uint64_t offset;        //Byte offset of the record in the data file
+    uint64_t length;        //Serialized length in bytes
+    int64_t stampNs;        //header.stamp of the cloud
+    int64_t receiveNs;      //Wall clock time the capture tool received the cloud
+};
+
+/**
+ * @brief   Append-only writer for point cloud captures
+ */
+class CaptureWriter
+{
+    public:
+        CaptureWriter();
+        ~CaptureWriter();
+
+        /**
+         * @brief   Open or create a capture, existing captures are appended to
+         */
+        bool open(const std::string& path);
+        void close();
+        bool isOpen() const;
+
+        bool write(const sensor_msgs::PointCloud2& cloud, const ros::Time& receiveTime);
+
+        uint64_t frameCount() const;
+
+    private:
+        /**
+         * @brief   Trim both files back to the last complete record after a failed write,
+         *          closes the capture if that fails too
+         */
+        void rollback();
+
+        int _dataFd;
+        int _indexFd;
+        uint64_t _dataSize;
+        uint64_t _frames;
+        std::vector<uint8_t> _buffer;
+};
+
+/**
+ * @brief   Memory mapped reader for captures written by CaptureWriter
+ */
+class CaptureReader
+{
+    public:
+        CaptureReader();
+        ~CaptureReader();
+
+        bool open(const std::string& path);
+        void close();
+
+        uint64_t frameCount() const;
+        const CaptureIndexEntry& entry(uint64_t index) const;
+
+        bool readFrame(uint64_t index, sensor_msgs::PointCloud2& cloud) const;
+
+    private:
+        const uint8_t* _data;
+        size_t _dataSize;
+        const CaptureIndexEntry* _index;
+        size_t _indexSize;
+        uint64_t _frames;
+};
+
+#endif // CLOUDCAPTURE_H
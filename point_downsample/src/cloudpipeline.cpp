@@ -0,0 +1,345 @@
+#include "cloudpipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <pcl_conversions/pcl_conversions.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/kdtree/kdtree.h>
+#include <pcl/octree/octree.h>
+#include <pcl/segmentation/extract_clusters.h>
+
+
+const CloudParamInfo CLOUD_PARAMS[] = {
+    { "waas/cloud/position/x",              0.0 },
+    { "waas/cloud/position/y",              0.0 },
+    { "waas/cloud/position/z",              0.0 },
+    { "waas/cloud/orientation/roll",        0.0 },
+    { "waas/cloud/orientation/pitch",       0.0 },
+    { "waas/cloud/orientation/yaw",         0.0 },
+    { "waas/downsample_leaf_size",          DEFAULT_downsample_leaf_size },
+    { "waas/downsample_threads",            DEFAULT_downsample_threads },
+    { "waas/octree_voxel_size",             DEFAULT_octree_voxel_size },
+    { "waas/background_reset_threshold",    DEFAULT_background_reset_threshold },
+    { "waas/cluster_join_distance",         DEFAULT_cluster_join_distance },
+    { "waas/cluster_min_size",              DEFAULT_cluster_min_size },
+    { "waas/cluster_max_size",              DEFAULT_cluster_max_size },
+    { "waas/packed_encoding",               DEFAULT_packed_encoding }
+};
+
+const unsigned int CLOUD_PARAM_COUNT = sizeof(CLOUD_PARAMS) / sizeof(CLOUD_PARAMS[0]);
+
+
+CloudProcessParams::CloudProcessParams(){
+    //Defaults from the table so tools without a parameter server behave like a fresh node
+    for(unsigned int i=0; i<CLOUD_PARAM_COUNT; i++){
+        setValue( CLOUD_PARAMS[i].name, CLOUD_PARAMS[i].defaultValue );
+    }
+
+    reset_request = false;
+    updateDerived();
+}
+
+void CloudProcessParams::updateDerived(){
+    kinect_position.setValue(position_x, position_y, position_z);
+
+    double deg2radCoef = M_PI / 180.0f;
+
+    kinect_orientation.setRPY( deg2radCoef * roll, deg2radCoef * pitch, deg2radCoef * yaw );
+}
+
+bool CloudProcessParams::setValue(const std::string& name, double value){
+    //Accept both absolute and relative names, "/waas/x" and "waas/x"
+    std::string key = name;
+    if(!key.empty() && key[0] == '/'){
+        key.erase(0, 1);
+    }
+
+    if(key == "waas/cloud/position/x"){ position_x = value; }
+    else if(key == "waas/cloud/position/y"){ position_y = value; }
+    else if(key == "waas/cloud/position/z"){ position_z = value; }
+    else if(key == "waas/cloud/orientation/roll"){ roll = value; }
+    else if(key == "waas/cloud/orientation/pitch"){ pitch = value; }
+    else if(key == "waas/cloud/orientation/yaw"){ yaw = value; }
+    else if(key == "waas/downsample_leaf_size"){ downsample_leaf_size = value; }
+    else if(key == "waas/downsample_threads"){ downsample_threads = (int) value; }
+    else if(key == "waas/octree_voxel_size"){ octree_voxel_size = value; }
+    else if(key == "waas/background_reset_threshold"){ background_reset_threshold = value; }
+    else if(key == "waas/cluster_join_distance"){ cluster_join_distance = value; }
+    else if(key == "waas/cluster_min_size"){ cluster_min_size = value; }
+    else if(key == "waas/cluster_max_size"){ cluster_max_size = value; }
+    else if(key == "waas/packed_encoding"){ packed_encoding = (int) value; }
+    else{
+        return false;
+    }
+
+    return true;
+}
+
+
+CloudPipeline::CloudPipeline(){
+    _backgroundCellSize = 0.0f;
+    _backgroundLeafSize = 0.0f;
+}
+
+PipelineStats& CloudPipeline::stats(){
+    return _stats;
+}
+
+void CloudPipeline::finishFrame(){
+    _stats.endFrame();
+}
+
+void CloudPipeline::process(const sensor_msgs::PointCloud2& input, const CloudProcessParams& params,
+                            bool doDownsample, bool doSegment, bool doCluster, CloudPipelineOutput& output){
+
+    _stats.beginFrame(input.header.stamp, input.header.seq, input.width * input.height);
+
+    doSegment = doSegment || doCluster;
+    doDownsample = doDownsample || doSegment;
+
+    output.downsampled = PCLPointCloudPtr(new PCLPointCloud());
+    output.foreground.reset();
+    output.background.reset();
+    output.clusters.clear();
+    output.centroids.clear();
+    output.markers = visualization_msgs::MarkerArrayPtr( new visualization_msgs::MarkerArray );
+
+    if(doDownsample){
+        _stats.start(PipelineStats::Ingest);
+        pcl::fromROSMsg(input, _inputCloud);
+        _stats.stop(PipelineStats::Ingest);
+
+        _stats.start(PipelineStats::Downsample);
+
+        float leafSize = params.downsample_leaf_size;
+
+        if(params.downsample_threads != 0){
+            _parallelDownsample.setLeafSize(leafSize);
+            _parallelDownsample.setThreadCount(params.downsample_threads);
+            _parallelDownsample.filter( _inputCloud, *output.downsampled );
+        }
+        else{
+            pcl::VoxelGrid<pcl::PointXYZ> downsample;
+            downsample.setInputCloud(_inputCloud.makeShared());
+            downsample.setLeafSize(leafSize, leafSize, leafSize);
+            downsample.filter( *output.downsampled );
+        }
+
+        _stats.stop(PipelineStats::Downsample);
+
+        if(_backgroundCloudPtr.get() == NULL){
+            _backgroundCloudPtr = output.downsampled;
+            _backgroundCells.clear();
+
+            if(params.downsample_threads != 0){
+                _backgroundKeys = _parallelDownsample.getKeys();
+                _backgroundLeafSize = leafSize;
+            }
+            else{
+                _backgroundKeys.clear();
+            }
+        }
+    }
+
+    if(doSegment){
+        _stats.start(PipelineStats::ChangeDetection);
+
+        std::vector<int> newPointIdxVector;
+
+        //Background and frame keys are only comparable on the same voxel grid
+        if(params.downsample_threads != 0 && !_backgroundKeys.empty() &&
+           _backgroundLeafSize == (float)params.downsample_leaf_size){
+            detectChangesByKey(params, newPointIdxVector);
+        }
+        else{
+            pcl::octree::OctreePointCloudChangeDetector<pcl::PointXYZ> octree ( params.octree_voxel_size );
+            octree.setInputCloud(_backgroundCloudPtr);
+            octree.addPointsFromInputCloud();
+
+            octree.switchBuffers();
+
+            octree.setInputCloud(output.downsampled);
+            octree.addPointsFromInputCloud();
+
+            // Get vector of point indices from octree voxels which did not exist in previous buffer
+            octree.getPointIndicesFromNewVoxels (newPointIdxVector);
+        }
+
+        output.foreground = PCLPointCloudPtr( new PCLPointCloud(*output.downsampled, newPointIdxVector) );
+
+        float foregroundPerecent = (float)output.foreground->points.size() / (float)_backgroundCloudPtr->points.size();
+
+        if(foregroundPerecent > params.background_reset_threshold){
+            _backgroundCloudPtr.reset();
+            _backgroundKeys.clear();
+            _backgroundCells.clear();
+            _stats.countBackgroundReset();
+            std::cout << "Resetting foreground percent=" << foregroundPerecent << std::endl;
+        }
+
+        output.background = _backgroundCloudPtr;
+
+        _stats.stop(PipelineStats::ChangeDetection);
+    }
+
+    if(doCluster && output.foreground->points.size() > 0){
+        _stats.start(PipelineStats::Clustering);
+
+        // Creating the KdTree object for the search method of the extraction
+        pcl::search::KdTree<pcl::PointXYZ>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZ>);
+        tree->setInputCloud ( output.foreground );
+
+        std::vector<pcl::PointIndices> cluster_indices;
+        pcl::EuclideanClusterExtraction<pcl::PointXYZ> ec;
+        ec.setClusterTolerance ( params.cluster_join_distance );
+        ec.setMinClusterSize ( params.cluster_min_size );
+        ec.setMaxClusterSize ( params.cluster_max_size );
+        ec.setSearchMethod (tree);
+        ec.setInputCloud ( output.foreground );
+        ec.extract (cluster_indices);
+
+        _stats.stop(PipelineStats::Clustering);
+        _stats.start(PipelineStats::Markers);
+
+        int index=0;
+
+        //Markers carry the capture time so consumers can measure end-to-end latency
+        ros::Time stamp = input.header.stamp;
+        const PCLPointCloud& foreground = *output.foreground;
+
+        //Loop over ever cluster
+        for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin (); it != cluster_indices.end (); ++it){
+
+            float maxValues[3] = {-9000, -9000, -9000};
+            float minValues[3] = {9000, 9000, 9000};
+            float centroid[3] = {0, 0, 0};
+
+            pcl::PointCloud<pcl::PointXYZ> localCluster(foreground, it->indices);
+            output.clusters += localCluster;
+
+            //Loop over every point
+            for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); pit++) {
+
+                for(int i=0; i<3; i++){
+                    if(foreground.points[*pit].data[i] > maxValues[i]){
+                        maxValues[i] = foreground.points[*pit].data[i];
+                    }
+
+                    if(foreground.points[*pit].data[i] < minValues[i]){
+                        minValues[i] = foreground.points[*pit].data[i];
+                    }
+
+                    centroid[i] += foreground.points[*pit].data[i];
+                }
+            }
+
+            for(int i=0; i<3; i++){
+                centroid[i] = centroid[i] / it->indices.size();
+            }
+
+            output.centroids.push_back( (point3d) centroid );
+
+            visualization_msgs::MarkerArrayPtr tempMarkers = generateMarkers(centroid, maxValues, minValues, index++, stamp);
+
+            output.markers->markers.insert(output.markers->markers.begin(), tempMarkers->markers.begin(), tempMarkers->markers.end());
+        }
+
+        _stats.stop(PipelineStats::Markers);
+    }
+}
+
+void CloudPipeline::detectChangesByKey(const CloudProcessParams& params, std::vector<int>& newPointIdxVector){
+    float cellSize = params.octree_voxel_size;
+
+    //The background is fixed until it is reset, its cells only change with the cell size
+    if(_backgroundCells.empty() || _backgroundCellSize != cellSize){
+        _backgroundCells.resize(_backgroundKeys.size());
+
+        for(size_t i=0; i<_backgroundKeys.size(); i++){
+            _backgroundCells[i] = _parallelDownsample.cellKey(_backgroundKeys[i], cellSize);
+        }
+
+        std::sort(_backgroundCells.begin(), _backgroundCells.end());
+        _backgroundCells.erase( std::unique(_backgroundCells.begin(), _backgroundCells.end()), _backgroundCells.end() );
+        _backgroundCellSize = cellSize;
+    }
+
+    //Keys are in output order, one per downsampled point
+    const std::vector<uint64_t>& keys = _parallelDownsample.getKeys();
+
+    for(size_t i=0; i<keys.size(); i++){
+        uint64_t cell = _parallelDownsample.cellKey(keys[i], cellSize);
+
+        if(!std::binary_search(_backgroundCells.begin(), _backgroundCells.end(), cell)){
+            newPointIdxVector.push_back(i);
+        }
+    }
+}
+
+
+visualization_msgs::MarkerArrayPtr generateMarkers(float centroid[3], float maxValue[3], float minValue[3], int id, ros::Time stamp){
+    visualization_msgs::Marker centroidMarker;
+    centroidMarker.header.frame_id = "/camera_depth_optical_frame";
+    centroidMarker.header.stamp = stamp;
+    centroidMarker.ns = "point_downsample";
+    centroidMarker.id = id;
+    centroidMarker.type = visualization_msgs::Marker::SPHERE;
+    centroidMarker.action = visualization_msgs::Marker::ADD;
+    centroidMarker.pose.position.x = centroid[0];
+    centroidMarker.pose.position.y = centroid[1];
+    centroidMarker.pose.position.z = centroid[2];
+    centroidMarker.pose.orientation.x = 0.0;
+    centroidMarker.pose.orientation.y = 0.0;
+    centroidMarker.pose.orientation.z = 0.0;
+    centroidMarker.pose.orientation.w = 1.0;
+    centroidMarker.scale.x = 0.3;
+    centroidMarker.scale.y = 0.3;
+    centroidMarker.scale.z = 0.3;
+    centroidMarker.color.a = 0.3;
+    centroidMarker.color.r = 1.0;
+    centroidMarker.color.g = 1.0;
+    centroidMarker.color.b = 0.0;
+
+    float center[3];
+    float range[3];
+
+    for(int i=0; i<3; i++){
+        range[i] = maxValue[i] - minValue[i];
+        center[i] = (range[i] / 2.0f) + minValue[i];
+
+        //cout << "range=" << range[i] << endl;
+    }
+
+    visualization_msgs::Marker boundsMarker;
+    boundsMarker.header.frame_id = "/camera_depth_optical_frame";
+    boundsMarker.header.stamp = stamp;
+    boundsMarker.ns = "point_downsample";
+    boundsMarker.id = id+100;
+    boundsMarker.type = visualization_msgs::Marker::CUBE;
+    boundsMarker.action = visualization_msgs::Marker::ADD;
+    boundsMarker.pose.position.x = center[0];
+    boundsMarker.pose.position.y = center[1];
+    boundsMarker.pose.position.z = center[2];
+    boundsMarker.pose.orientation.x = 0.0;
+    boundsMarker.pose.orientation.y = 0.0;
+    boundsMarker.pose.orientation.z = 0.0;
+    boundsMarker.pose.orientation.w = 1.0;
+    boundsMarker.scale.x = range[0];
+    boundsMarker.scale.y = range[1];
+    boundsMarker.scale.z = range[2];
+    boundsMarker.color.a = 0.2;
+    boundsMarker.color.r = 0.0;
+    boundsMarker.color.g = 0.0;
+    boundsMarker.color.b = 1.0;
+
+
+    visualization_msgs::MarkerArrayPtr markerArray( new visualization_msgs::MarkerArray );
+
+
+    markerArray->markers.push_back(centroidMarker);
+    markerArray->markers.push_back(boundsMarker);
+
+    return markerArray;
+}
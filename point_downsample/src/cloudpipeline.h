@@ -0,0 +1,149 @@
+#ifndef CLOUDPIPELINE_H
+#define CLOUDPIPELINE_H
+
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <visualization_msgs/MarkerArray.h>
+
+#include <tf/tf.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "point_downsample/VoxelCloud.h"
+
+#include "parallelvoxelgrid.h"
+#include "pipelinestats.h"
+
+#define DEFAULT_downsample_leaf_size        (0.05f)
+#define DEFAULT_octree_voxel_size           (0.2f)
+#define DEFAULT_background_reset_threshold  (0.5f)
+#define DEFAULT_cluster_join_distance       (0.15f)
+#define DEFAULT_cluster_min_size            (200)
+#define DEFAULT_cluster_max_size            (3000)
+#define DEFAULT_packed_encoding             (point_downsample::VoxelCloud::DELTA)
+#define DEFAULT_downsample_threads          (0)
+
+typedef pcl::PointCloud<pcl::PointXYZ> PCLPointCloud;
+typedef pcl::PointCloud<pcl::PointXYZ>::Ptr PCLPointCloudPtr;
+
+struct CloudProcessParams{
+    CloudProcessParams();
+
+    double position_x;
+    double position_y;
+    double position_z;
+    double roll;                //Degrees
+    double pitch;
+    double yaw;
+    double downsample_leaf_size;
+    int downsample_threads;     //0 uses pcl::VoxelGrid, otherwise ParallelVoxelGrid (-1 for all cores)
+    double octree_voxel_size;
+    double background_reset_threshold;
+    double cluster_join_distance;
+    double cluster_min_size;
+    double cluster_max_size;
+    int packed_encoding;
+    bool reset_request;
+
+    //Derived from the values above by updateDerived()
+    tf::Vector3 kinect_position;
+    tf::Quaternion kinect_orientation;
+
+    void updateDerived();
+
+    /**
+     * @brief   Set a parameter by its ROS name, with or without the leading '/'
+     * @return  False if the name is unknown
+     */
+    bool setValue(const std::string& name, double value);
+};
+
+typedef boost::shared_ptr<const CloudProcessParams> CloudProcessParamsConstPtr;
+
+struct CloudParamInfo {
+    const char* name;
+    double defaultValue;
+};
+
+extern const CloudParamInfo CLOUD_PARAMS[];
+extern const unsigned int CLOUD_PARAM_COUNT;
+
+
+struct point3d {
+    point3d(float values[3]){
+        data[0]=values[0];
+        data[1]=values[1];
+        data[2]=values[2];
+    }
+
+    union{
+        float data[4];
+        struct {
+          float x;
+          float y;
+          float z;
+        };
+    };
+};
+
+/**
+ * @brief   Everything produced from one input cloud, stages that did not run leave their
+ *          outputs empty
+ */
+struct CloudPipelineOutput {
+    PCLPointCloudPtr downsampled;
+    PCLPointCloudPtr foreground;
+    PCLPointCloudPtr background;
+    PCLPointCloud clusters;
+    std::vector<point3d> centroids;
+    visualization_msgs::MarkerArrayPtr markers;
+};
+
+/**
+ * @brief   Downsample, background change detection and clustering of a single point
+ *          cloud, independent of any ROS publishers so the same code runs inside
+ *          point_downsample_node and the offline replay tool.
+ */
+class CloudPipeline
+{
+    public:
+        CloudPipeline();
+
+        /**
+         * @brief   Run the requested stages, later stages imply the earlier ones. Call
+         *          finishFrame() once the outputs have been published.
+         */
+        void process(const sensor_msgs::PointCloud2& input, const CloudProcessParams& params,
+                     bool doDownsample, bool doSegment, bool doCluster, CloudPipelineOutput& output);
+
+        void finishFrame();
+
+        PipelineStats& stats();
+
+    private:
+        /**
+         * @brief   Change detection on the voxel keys of ParallelVoxelGrid, a point is
+         *          foreground if its octree_voxel_size cell holds no background voxel
+         */
+        void detectChangesByKey(const CloudProcessParams& params, std::vector<int>& newPointIdxVector);
+
+        PCLPointCloud _inputCloud;
+        ParallelVoxelGrid _parallelDownsample;
+        PCLPointCloudPtr _backgroundCloudPtr;
+
+        //Voxel keys of _backgroundCloudPtr, empty when it came from pcl::VoxelGrid
+        std::vector<uint64_t> _backgroundKeys;
+        //Sorted, unique cell keys of _backgroundKeys for _backgroundCellSize
+        std::vector<uint64_t> _backgroundCells;
+        float _backgroundCellSize;
+        float _backgroundLeafSize;
+        PipelineStats _stats;
+};
+
+visualization_msgs::MarkerArrayPtr generateMarkers(float centroid[3], float maxValue[3], float minValue[3], int id, ros::Time stamp);
+
+#endif // CLOUDPIPELINE_H
@@ -0,0 +1,21 @@
+#include "monotonicclock.h"
+
+#include <errno.h>
+#include <time.h>
+
+uint64_t monotonicNs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+void sleepUntilNs(uint64_t deadlineNs){
+    struct timespec ts;
+    ts.tv_sec = deadlineNs / 1000000000ULL;
+    ts.tv_nsec = deadlineNs % 1000000000ULL;
+
+    //The deadline is absolute so a restart does not drift, any other error gives up
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR){
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef MONOTONICCLOCK_H
+#define MONOTONICCLOCK_H
+
+#include <stdint.h>
+
+/**
+ * @brief   CLOCK_MONOTONIC reading in nanoseconds
+ */
+uint64_t monotonicNs();
+
+/**
+ * @brief   Sleep until an absolute monotonicNs() deadline, restarting only after signals
+ */
+void sleepUntilNs(uint64_t deadlineNs);
+
+#endif // MONOTONICCLOCK_H
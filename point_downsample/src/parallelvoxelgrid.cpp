@@ -0,0 +1,448 @@
+#include "parallelvoxelgrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/bind.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define VOXEL_AXIS_BITS     (21)
+#define VOXEL_AXIS_OFFSET   (1 << (VOXEL_AXIS_BITS - 1))    //Grid origin, allows negative coordinates
+#define INVALID_KEY         (1ULL << 63)                    //Sorts after every valid key
+#define RADIX_BITS          (8)
+#define RADIX_BUCKETS       (1 << RADIX_BITS)
+#define MIN_POINTS_PER_THREAD (16384)
+
+
+static inline uint64_t splitBy3(uint32_t value){
+    uint64_t x = value & 0x1fffff;
+
+    x = (x | (x << 32)) & 0x1f00000000ffffULL;
+    x = (x | (x << 16)) & 0x1f0000ff0000ffULL;
+    x = (x | (x << 8))  & 0x100f00f00f00f00fULL;
+    x = (x | (x << 4))  & 0x10c30c30c30c30c3ULL;
+    x = (x | (x << 2))  & 0x1249249249249249ULL;
+
+    return x;
+}
+
+static inline uint32_t compactBy3(uint64_t key){
+    uint64_t x = key & 0x1249249249249249ULL;
+
+    x = (x | (x >> 2))  & 0x10c30c30c30c30c3ULL;
+    x = (x | (x >> 4))  & 0x100f00f00f00f00fULL;
+    x = (x | (x >> 8))  & 0x1f0000ff0000ffULL;
+    x = (x | (x >> 16)) & 0x1f00000000ffffULL;
+    x = (x | (x >> 32)) & 0x1fffff;
+
+    return (uint32_t) x;
+}
+
+
+ParallelVoxelGrid::ParallelVoxelGrid(){
+    _leafSize = 0.05f;
+    _threadCount = 0;
+    _input = NULL;
+    _output = NULL;
+    _barrier = NULL;
+    _activeThreads = 1;
+    _current = 0;
+    _skipPass = false;
+    _poolSize = 1;
+    _generation = 0;
+    _pending = 0;
+    _poolActive = 1;
+    _stopping = false;
+}
+
+ParallelVoxelGrid::~ParallelVoxelGrid(){
+    stopPool();
+}
+
+void ParallelVoxelGrid::setLeafSize(float leafSize){
+    _leafSize = leafSize;
+}
+
+float ParallelVoxelGrid::getLeafSize() const {
+    return _leafSize;
+}
+
+void ParallelVoxelGrid::setThreadCount(int count){
+    _threadCount = count;
+}
+
+const std::vector<uint64_t>& ParallelVoxelGrid::getKeys() const {
+    return _outputKeys;
+}
+
+uint64_t ParallelVoxelGrid::mortonEncode(uint32_t x, uint32_t y, uint32_t z){
+    return splitBy3(x) | (splitBy3(y) << 1) | (splitBy3(z) << 2);
+}
+
+void ParallelVoxelGrid::mortonDecode(uint64_t key, uint32_t& x, uint32_t& y, uint32_t& z){
+    x = compactBy3(key);
+    y = compactBy3(key >> 1);
+    z = compactBy3(key >> 2);
+}
+
+pcl::PointXYZ ParallelVoxelGrid::keyToPoint(uint64_t key) const {
+    uint32_t v[3];
+    mortonDecode(key, v[0], v[1], v[2]);
+
+    pcl::PointXYZ pt;
+    pt.x = ((float)((int32_t)v[0] - VOXEL_AXIS_OFFSET) + 0.5f) * _leafSize;
+    pt.y = ((float)((int32_t)v[1] - VOXEL_AXIS_OFFSET) + 0.5f) * _leafSize;
+    pt.z = ((float)((int32_t)v[2] - VOXEL_AXIS_OFFSET) + 0.5f) * _leafSize;
+
+    return pt;
+}
+
+uint64_t ParallelVoxelGrid::cellKey(uint64_t key, float cellSize) const {
+    //Every voxel is already its own cell, this also keeps the result inside 21 bits
+    if(!(cellSize > _leafSize)){
+        return key;
+    }
+
+    pcl::PointXYZ center = keyToPoint(key);
+    uint32_t v[3];
+
+    for(int axis=0; axis<3; axis++){
+        v[axis] = (uint32_t)( (int32_t)std::floor(center.data[axis] / cellSize) + VOXEL_AXIS_OFFSET );
+    }
+
+    return mortonEncode(v[0], v[1], v[2]);
+}
+
+
+void ParallelVoxelGrid::filter(const pcl::PointCloud<pcl::PointXYZ>& input, pcl::PointCloud<pcl::PointXYZ>& output){
+    int count = input.points.size();
+
+    output.header = input.header;
+    output.points.clear();
+    output.height = 1;
+    output.is_dense = true;
+
+    //Every buffer below would be empty
+    if(count == 0){
+        output.width = 0;
+        _outputKeys.clear();
+        return;
+    }
+
+    int threads = _threadCount;
+    if(threads < 1){
+        threads = boost::thread::hardware_concurrency();
+    }
+
+    _activeThreads = std::max(1, std::min(threads, count / MIN_POINTS_PER_THREAD));
+    startPool(_activeThreads);
+
+    _input = &input;
+    _output = &output;
+    _current = 0;
+
+    for(int i=0; i<2; i++){
+        _keys[i].resize(count);
+        _indices[i].resize(count);
+    }
+
+    _histograms.resize(_activeThreads * RADIX_BUCKETS);
+    _segmentCounts.resize(_activeThreads);
+
+    boost::barrier barrier(_activeThreads);
+    _barrier = &barrier;
+
+    {
+        boost::mutex::scoped_lock lock(_poolLock);
+        _pending = _activeThreads - 1;
+        _poolActive = _activeThreads;
+        _generation++;
+    }
+
+    _poolWake.notify_all();
+
+    worker(0);
+
+    {
+        boost::mutex::scoped_lock lock(_poolLock);
+
+        while(_pending > 0){
+            _poolDone.wait(lock);
+        }
+    }
+
+    _barrier = NULL;
+    _input = NULL;
+    _output = NULL;
+
+    output.width = output.points.size();
+}
+
+
+void ParallelVoxelGrid::startPool(int threads){
+    boost::mutex::scoped_lock lock(_poolLock);
+
+    //New threads start from the generation current now, the next filter() bump always wakes them
+    for(; _poolSize < threads; _poolSize++){
+        _pool.create_thread( boost::bind(&ParallelVoxelGrid::poolThread, this, _poolSize, _generation) );
+    }
+}
+
+void ParallelVoxelGrid::stopPool(){
+    {
+        boost::mutex::scoped_lock lock(_poolLock);
+        _stopping = true;
+    }
+
+    _poolWake.notify_all();
+    _pool.join_all();
+}
+
+void ParallelVoxelGrid::poolThread(int id, unsigned int startGeneration){
+    boost::mutex::scoped_lock lock(_poolLock);
+    unsigned int seen = startGeneration;
+
+    while(true){
+        while(!_stopping && _generation == seen){
+            _poolWake.wait(lock);
+        }
+
+        if(_stopping){
+            return;
+        }
+
+        seen = _generation;
+
+        //Small clouds use fewer threads than the pool holds
+        if(id >= _poolActive){
+            continue;
+        }
+
+        lock.unlock();
+        worker(id);
+        lock.lock();
+
+        if(--_pending == 0){
+            _poolDone.notify_one();
+        }
+    }
+}
+
+
+void ParallelVoxelGrid::worker(int id){
+    int count = _input->points.size();
+    int chunk = (count + _activeThreads - 1) / _activeThreads;
+    int begin = std::min(count, id * chunk);
+    int end = std::min(count, begin + chunk);
+
+    computeKeys(begin, end);
+    _barrier->wait();
+
+    sortPasses(id, begin, end);
+    reduceSegments(id, begin, end);
+}
+
+
+void ParallelVoxelGrid::computeKeys(int begin, int end){
+    const float invLeaf = 1.0f / _leafSize;
+    const float limit = (float)(VOXEL_AXIS_OFFSET - 1);
+
+    uint64_t* keys = &_keys[0][0];
+    uint32_t* indices = &_indices[0][0];
+
+#ifdef __SSE2__
+    const __m128 invLeafV = _mm_set1_ps(invLeaf);
+    const __m128 limitV = _mm_set1_ps(limit);
+    const __m128 absMask = _mm_castsi128_ps( _mm_set1_epi32(0x7fffffff) );
+    const __m128i offsetV = _mm_set1_epi32(VOXEL_AXIS_OFFSET);
+
+    for(int i=begin; i<end; i++){
+        //PointXYZ is padded to 16 bytes so x, y and z load as one vector
+        __m128 scaled = _mm_mul_ps( _mm_loadu_ps(_input->points[i].data), invLeafV );
+
+        //NaN and out of range lanes fail the comparison
+        __m128 valid = _mm_cmplt_ps( _mm_and_ps(scaled, absMask), limitV );
+
+        //floor() as truncate then subtract one where truncation rounded up
+        __m128i voxel = _mm_cvttps_epi32(scaled);
+        __m128 rounded = _mm_cvtepi32_ps(voxel);
+        voxel = _mm_add_epi32( voxel, _mm_castps_si128(_mm_cmpgt_ps(rounded, scaled)) );
+        voxel = _mm_add_epi32( voxel, offsetV );
+
+        int32_t v[4];
+        _mm_storeu_si128( (__m128i*)v, voxel );
+
+        if((_mm_movemask_ps(valid) & 0x7) == 0x7){
+            keys[i] = mortonEncode(v[0], v[1], v[2]);
+        }
+        else{
+            keys[i] = INVALID_KEY;
+        }
+
+        indices[i] = i;
+    }
+#else
+    for(int i=begin; i<end; i++){
+        const pcl::PointXYZ& pt = _input->points[i];
+        int32_t v[3];
+        bool valid = true;
+
+        for(int axis=0; axis<3; axis++){
+            float scaled = pt.data[axis] * invLeaf;
+
+            if(!(std::fabs(scaled) < limit)){
+                valid = false;
+                break;
+            }
+
+            v[axis] = (int32_t) std::floor(scaled) + VOXEL_AXIS_OFFSET;
+        }
+
+        keys[i] = valid ? mortonEncode(v[0], v[1], v[2]) : INVALID_KEY;
+        indices[i] = i;
+    }
+#endif
+}
+
+
+void ParallelVoxelGrid::sortPasses(int id, int begin, int end){
+    int count = _input->points.size();
+    int current = 0;
+
+    for(int shift=0; shift < 64; shift += RADIX_BITS){
+        const uint64_t* srcKeys = &_keys[current][0];
+        const uint32_t* srcIndices = &_indices[current][0];
+        uint64_t* dstKeys = &_keys[current ^ 1][0];
+        uint32_t* dstIndices = &_indices[current ^ 1][0];
+
+        uint32_t* histogram = &_histograms[id * RADIX_BUCKETS];
+        std::fill(histogram, histogram + RADIX_BUCKETS, 0);
+
+        for(int i=begin; i<end; i++){
+            histogram[ (srcKeys[i] >> shift) & (RADIX_BUCKETS - 1) ]++;
+        }
+
+        _barrier->wait();
+
+        if(id == 0){
+            //Turn the per thread counts into scatter offsets, digit major then thread
+            //order keeps the sort stable. A digit shared by every key is skipped.
+            _skipPass = false;
+            uint32_t offset = 0;
+
+            for(int digit=0; digit < RADIX_BUCKETS; digit++){
+                uint32_t digitTotal = 0;
+
+                for(int t=0; t<_activeThreads; t++){
+                    uint32_t& bucket = _histograms[t * RADIX_BUCKETS + digit];
+                    uint32_t n = bucket;
+
+                    bucket = offset;
+                    offset += n;
+                    digitTotal += n;
+                }
+
+                if(digitTotal == (uint32_t)count){
+                    _skipPass = true;
+                }
+            }
+        }
+
+        _barrier->wait();
+
+        if(_skipPass){
+            continue;
+        }
+
+        for(int i=begin; i<end; i++){
+            uint32_t& position = histogram[ (srcKeys[i] >> shift) & (RADIX_BUCKETS - 1) ];
+
+            dstKeys[position] = srcKeys[i];
+            dstIndices[position] = srcIndices[i];
+            position++;
+        }
+
+        current ^= 1;
+        _barrier->wait();
+    }
+
+    if(id == 0){
+        _current = current;
+    }
+}
+
+
+void ParallelVoxelGrid::reduceSegments(int id, int begin, int end){
+    int count = _input->points.size();
+
+    //Every worker ends sortPasses() with the same buffer index
+    _barrier->wait();
+
+    const uint64_t* keys = &_keys[_current][0];
+    const uint32_t* indices = &_indices[_current][0];
+
+    //Count voxels starting inside this chunk
+    uint32_t segments = 0;
+    for(int i=begin; i<end; i++){
+        if(keys[i] != INVALID_KEY && (i == 0 || keys[i] != keys[i-1])){
+            segments++;
+        }
+    }
+
+    _segmentCounts[id] = segments;
+    _barrier->wait();
+
+    if(id == 0){
+        uint32_t total = 0;
+        for(int t=0; t<_activeThreads; t++){
+            total += _segmentCounts[t];
+        }
+
+        _output->points.resize(total);
+        _outputKeys.resize(total);
+    }
+
+    _barrier->wait();
+
+    uint32_t outIndex = 0;
+    for(int t=0; t<id; t++){
+        outIndex += _segmentCounts[t];
+    }
+
+    //Reduce each voxel that starts in this chunk, a voxel may extend past the chunk end
+    int i = begin;
+    while(i < end){
+        uint64_t key = keys[i];
+
+        if(key == INVALID_KEY){
+            break;
+        }
+
+        if(i > 0 && key == keys[i-1]){
+            i++;
+            continue;
+        }
+
+        float sum[3] = {0.0f, 0.0f, 0.0f};
+        int n = 0;
+
+        for(; i < count && keys[i] == key; i++, n++){
+            const pcl::PointXYZ& pt = _input->points[ indices[i] ];
+
+            sum[0] += pt.x;
+            sum[1] += pt.y;
+            sum[2] += pt.z;
+        }
+
+        pcl::PointXYZ& centroid = _output->points[outIndex];
+        centroid.x = sum[0] / n;
+        centroid.y = sum[1] / n;
+        centroid.z = sum[2] / n;
+
+        _outputKeys[outIndex] = key;
+        outIndex++;
+    }
+}
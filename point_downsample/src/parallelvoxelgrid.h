@@ -0,0 +1,112 @@
+#ifndef PARALLELVOXELGRID_H
+#define PARALLELVOXELGRID_H
+
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+/**
+ * @brief   Multi-threaded replacement for pcl::VoxelGrid<pcl::PointXYZ>
+ *
+ *          Points are quantized onto an absolute grid of edge leafSize and given a 63-bit
+ *          Morton key (21 bits per axis). Keys are sorted with a parallel LSD radix sort
+ *          and each run of equal keys is reduced to its centroid. The grid is anchored at
+ *          a fixed origin rather than at the cloud bounds, so a voxel has the same centre
+ *          in every frame.
+ *
+ *          Worker threads are started on the first filter() and kept for later calls,
+ *          they sleep between frames.
+ */
+class ParallelVoxelGrid
+{
+    public:
+        ParallelVoxelGrid();
+        ~ParallelVoxelGrid();
+
+        void setLeafSize(float leafSize);
+        float getLeafSize() const;
+
+        /**
+         * @brief   Number of worker threads, values less than 1 use the hardware concurrency
+         */
+        void setThreadCount(int count);
+
+        void filter(const pcl::PointCloud<pcl::PointXYZ>& input, pcl::PointCloud<pcl::PointXYZ>& output);
+
+        /**
+         * @brief   Morton keys of the points produced by the last call to filter(), in output
+         *          order (ascending)
+         */
+        const std::vector<uint64_t>& getKeys() const;
+
+        /**
+         * @brief   Center of the voxel with the given key
+         */
+        pcl::PointXYZ keyToPoint(uint64_t key) const;
+
+        /**
+         * @brief   Key of the cell of edge cellSize, on the same fixed origin, that holds the
+         *          center of the voxel with the given key. Cells smaller than a voxel return
+         *          the key unchanged.
+         */
+        uint64_t cellKey(uint64_t key, float cellSize) const;
+
+        static uint64_t mortonEncode(uint32_t x, uint32_t y, uint32_t z);
+        static void mortonDecode(uint64_t key, uint32_t& x, uint32_t& y, uint32_t& z);
+
+    private:
+        /**
+         * @brief   Grow the pool to threads - 1 workers, filter() runs as worker 0
+         */
+        void startPool(int threads);
+        void stopPool();
+        /**
+         * @param startGeneration   _generation when the thread was created, read under
+         *                          _poolLock so a frame started before the thread runs is
+         *                          not missed
+         */
+        void poolThread(int id, unsigned int startGeneration);
+
+        void worker(int id);
+        void computeKeys(int begin, int end);
+        void sortPasses(int id, int begin, int end);
+        void reduceSegments(int id, int begin, int end);
+
+        float _leafSize;
+        int _threadCount;
+
+        //Per filter() call state shared between workers
+        const pcl::PointCloud<pcl::PointXYZ>* _input;
+        pcl::PointCloud<pcl::PointXYZ>* _output;
+        boost::barrier* _barrier;
+        int _activeThreads;
+        std::vector<uint64_t> _keys[2];
+        std::vector<uint32_t> _indices[2];
+        std::vector<uint32_t> _histograms;      //_activeThreads x 256
+        std::vector<uint32_t> _segmentCounts;   //_activeThreads
+        std::vector<uint64_t> _outputKeys;      //Key of each output point, kept after filter()
+        int _current;
+        bool _skipPass;
+
+        //Pool threads wait for _generation to change, run worker() if their id is below
+        //_poolActive and decrement _pending when done
+        boost::thread_group _pool;
+        int _poolSize;
+        boost::mutex _poolLock;
+        boost::condition_variable _poolWake;
+        boost::condition_variable _poolDone;
+        unsigned int _generation;
+        int _pending;
+        int _poolActive;                        //_activeThreads of _generation
+        bool _stopping;
+};
+
+#endif // PARALLELVOXELGRID_H
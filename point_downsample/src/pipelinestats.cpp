@@ -0,0 +1,193 @@
+#include "pipelinestats.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <diagnostic_msgs/KeyValue.h>
+
+#include "monotonicclock.h"
+
+
+RollingHistogram::RollingHistogram(int capacity){
+    _samples.resize(capacity);
+    _next = 0;
+    _count = 0;
+}
+
+void RollingHistogram::insert(double value){
+    _samples[_next] = value;
+    _next = (_next + 1) % _samples.size();
+    _count = std::min(_count + 1, (int)_samples.size());
+}
+
+void RollingHistogram::clear(){
+    _next = 0;
+    _count = 0;
+}
+
+int RollingHistogram::count() const {
+    return _count;
+}
+
+void RollingHistogram::getStats(double& p50, double& p99, double& max) const {
+    p50 = p99 = max = 0.0;
+
+    if(_count == 0){
+        return;
+    }
+
+    std::vector<double> sorted(_samples.begin(), _samples.begin() + _count);
+    std::sort(sorted.begin(), sorted.end());
+
+    p50 = sorted[ (_count - 1) / 2 ];
+    p99 = sorted[ ((_count - 1) * 99) / 100 ];
+    max = sorted.back();
+}
+
+
+PipelineStats::PipelineStats(){
+    _frameStartNs = 0;
+    _haveSeq = false;
+    _lastSeq = 0;
+    _frames = 0;
+    _dropped = 0;
+    _empty = 0;
+    _backgroundResets = 0;
+    _windowStartNs = monotonicNs();
+    _windowFrames = 0;
+    _windowPoints = 0;
+
+    for(int i=0; i<StageCount; i++){
+        _stageStartNs[i] = 0;
+        _stageAccumNs[i] = 0;
+        _stageRan[i] = false;
+    }
+}
+
+const char* PipelineStats::stageName(Stage stage){
+    switch(stage){
+        case Ingest:            return "ingest";
+        case Downsample:        return "downsample";
+        case ChangeDetection:   return "change_detection";
+        case Clustering:        return "clustering";
+        case Markers:           return "markers";
+        case Publish:           return "publish";
+        default:                return "unknown";
+    }
+}
+
+void PipelineStats::beginFrame(const ros::Time& sensorStamp, uint32_t seq, int inputPoints){
+    _frameStartNs = monotonicNs();
+    _sensorStamp = sensorStamp;
+
+    //The subscriber queue only holds one cloud, gaps in the sequence are dropped frames
+    if(_haveSeq && seq > _lastSeq + 1){
+        _dropped += seq - _lastSeq - 1;
+    }
+
+    _haveSeq = true;
+    _lastSeq = seq;
+
+    _windowPoints += inputPoints;
+
+    for(int i=0; i<StageCount; i++){
+        _stageAccumNs[i] = 0;
+        _stageRan[i] = false;
+    }
+}
+
+void PipelineStats::start(Stage stage){
+    _stageStartNs[stage] = monotonicNs();
+}
+
+void PipelineStats::stop(Stage stage){
+    _stageAccumNs[stage] += monotonicNs() - _stageStartNs[stage];
+    _stageRan[stage] = true;
+}
+
+void PipelineStats::endFrame(){
+    uint64_t endNs = monotonicNs();
+
+    for(int i=0; i<StageCount; i++){
+        if(_stageRan[i]){
+            _stageMs[i].insert( _stageAccumNs[i] / 1.0e6 );
+        }
+    }
+
+    _totalMs.insert( (endNs - _frameStartNs) / 1.0e6 );
+
+    if(!_sensorStamp.isZero()){
+        _sensorAgeMs.insert( (ros::Time::now() - _sensorStamp).toSec() * 1000.0 );
+    }
+
+    _frames++;
+    _windowFrames++;
+}
+
+void PipelineStats::countEmpty(){
+    _empty++;
+}
+
+void PipelineStats::countBackgroundReset(){
+    _backgroundResets++;
+}
+
+
+static void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, double value){
+    std::ostringstream stream;
+    stream << value;
+
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = stream.str();
+
+    status.values.push_back(kv);
+}
+
+static void addHistogram(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, const RollingHistogram& histogram){
+    double p50, p99, max;
+    histogram.getStats(p50, p99, max);
+
+    addValue(status, key + " p50 ms", p50);
+    addValue(status, key + " p99 ms", p99);
+    addValue(status, key + " max ms", max);
+}
+
+diagnostic_msgs::DiagnosticStatus PipelineStats::toDiagnostics(const std::string& name){
+    diagnostic_msgs::DiagnosticStatus status;
+
+    status.name = name;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = "OK";
+
+    uint64_t nowNs = monotonicNs();
+    double windowSec = (nowNs - _windowStartNs) / 1.0e9;
+
+    if(windowSec > 0.0){
+        addValue(status, "fps", _windowFrames / windowSec);
+        addValue(status, "input points/s", _windowPoints / windowSec);
+    }
+
+    addValue(status, "frames", _frames);
+    addValue(status, "dropped", _dropped);
+    addValue(status, "empty", _empty);
+    addValue(status, "background resets", _backgroundResets);
+
+    for(int i=0; i<StageCount; i++){
+        addHistogram(status, stageName((Stage)i), _stageMs[i]);
+    }
+
+    addHistogram(status, "total", _totalMs);
+    addHistogram(status, "sensor age", _sensorAgeMs);
+
+    if(_windowFrames == 0){
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = "No point clouds";
+    }
+
+    _windowStartNs = nowNs;
+    _windowFrames = 0;
+    _windowPoints = 0;
+
+    return status;
+}
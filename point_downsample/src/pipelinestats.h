@@ -0,0 +1,86 @@
+#ifndef PIPELINESTATS_H
+#define PIPELINESTATS_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+
+/**
+ * @brief   Fixed size window over the most recent samples
+ */
+class RollingHistogram
+{
+    public:
+        RollingHistogram(int capacity=512);
+
+        void insert(double value);
+        void clear();
+        int count() const;
+
+        /**
+         * @brief   Percentiles over the current window, all zero when empty
+         */
+        void getStats(double& p50, double& p99, double& max) const;
+
+    private:
+        std::vector<double> _samples;
+        int _next;
+        int _count;
+};
+
+/**
+ * @brief   Per-stage latency, drop and throughput counters for the point cloud pipeline.
+ *          Stages may be started and stopped several times per frame, the time is
+ *          accumulated and recorded once in endFrame().
+ */
+class PipelineStats
+{
+    public:
+        enum Stage { Ingest=0, Downsample, ChangeDetection, Clustering, Markers, Publish, StageCount };
+
+        PipelineStats();
+
+        void beginFrame(const ros::Time& sensorStamp, uint32_t seq, int inputPoints);
+        void start(Stage stage);
+        void stop(Stage stage);
+        void endFrame();
+
+        void countEmpty();
+        void countBackgroundReset();
+
+        /**
+         * @brief   Summarize everything since the previous call and reset the rate counters
+         */
+        diagnostic_msgs::DiagnosticStatus toDiagnostics(const std::string& name);
+
+        static const char* stageName(Stage stage);
+
+    private:
+        RollingHistogram _stageMs[StageCount];
+        RollingHistogram _totalMs;
+        RollingHistogram _sensorAgeMs;
+
+        uint64_t _frameStartNs;
+        uint64_t _stageStartNs[StageCount];
+        uint64_t _stageAccumNs[StageCount];
+        bool _stageRan[StageCount];
+        ros::Time _sensorStamp;
+
+        bool _haveSeq;
+        uint32_t _lastSeq;
+
+        uint64_t _frames;
+        uint64_t _dropped;
+        uint64_t _empty;
+        uint64_t _backgroundResets;
+
+        uint64_t _windowStartNs;
+        uint64_t _windowFrames;
+        uint64_t _windowPoints;
+};
+
+#endif // PIPELINESTATS_H
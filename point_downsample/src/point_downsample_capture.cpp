@@ -0,0 +1,56 @@
+#include <ros/ros.h>
+#include <ros/console.h>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include "cloudcapture.h"
+
+/*
+ * Records the raw sensor cloud to a capture file for point_downsample_replay
+ *
+ *  rosrun point_downsample point_downsample_capture [file] [_topic:=/camera/depth/points]
+ */
+
+CaptureWriter _writer;
+
+void pointCloudCallback(const sensor_msgs::PointCloud2ConstPtr& input){
+    if(!_writer.write(*input, ros::Time::now())){
+        ROS_ERROR_THROTTLE(5, "pointCloudCallback() - Failed to write frame");
+        return;
+    }
+
+    if(_writer.frameCount() % 100 == 0){
+        ROS_INFO("Captured %lu frames", (unsigned long)_writer.frameCount());
+    }
+}
+
+int main(int argc, char** argv){
+    ros::init(argc, argv, "point_downsample_capture");
+    ros::NodeHandle nh("~");
+
+    std::string topic;
+    std::string file;
+
+    nh.param<std::string>("topic", topic, "/camera/depth/points");
+    nh.param<std::string>("file", file, "point_downsample.cap");
+
+    if(argc > 1){
+        file = argv[1];
+    }
+
+    if(!_writer.open(file)){
+        return -1;
+    }
+
+    ROS_INFO("Capturing %s to %s (%lu frames already present)", topic.c_str(), file.c_str(), (unsigned long)_writer.frameCount());
+
+    //Deep queue, dropping frames here would leave gaps in the replay
+    ros::Subscriber sub = nh.subscribe(topic, 30, pointCloudCallback);
+
+    ros::spin();
+
+    ROS_INFO("Captured %lu frames", (unsigned long)_writer.frameCount());
+    _writer.close();
+
+    return 0;
+}
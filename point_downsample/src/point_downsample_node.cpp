@@ -1,5 +1,6 @@
 #include <ros/ros.h>
 #include <ros/console.h>
+#include <ros/callback_queue.h>
 
 #include <std_msgs/Int32.h>
 #include <std_msgs/Float64.h>
@@ -9,6 +10,7 @@
 #include <geometry_msgs/QuaternionStamped.h>
 #include <visualization_msgs/Marker.h>
 #include <visualization_msgs/MarkerArray.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 
 #include <tf/transform_broadcaster.h>
 #include <tf/transform_listener.h>
@@ -60,6 +62,10 @@
 
 #include "point_downsample/RefreshParams.h"
 #include "point_downsample/ResetBackground.h"
+#include "point_downsample/VoxelCloud.h"
+#include "point_downsample/voxelcodec.h"
+
+#include "cloudpipeline.h"
 
 
 ros::NodeHandlePtr _nhPtr;
@@ -69,6 +75,13 @@ ros::Publisher _backgroundPub;
 ros::Publisher _foregroundPub;
 ros::Publisher _clustersPub;
 ros::Publisher _visualizerPub;
+ros::Publisher _diagnosticsPub;
+
+//Voxel packed variants for distributed deployments, see voxelcodec.h
+ros::Publisher _pointsPackedPub;
+ros::Publisher _backgroundPackedPub;
+ros::Publisher _foregroundPackedPub;
+ros::Publisher _clustersPackedPub;
 
 ros::Subscriber _pointCloudSub;
 
@@ -80,37 +93,32 @@ tf::TransformListener* _tfListener = NULL;
 
 
 
-#define DEFAULT_downsample_leaf_size        (0.05f)
-#define DEFAULT_octree_voxel_size           (0.2f)
-#define DEFAULT_background_reset_threshold  (0.5f)
-#define DEFAULT_cluster_join_distance       (0.15f)
-#define DEFAULT_cluster_min_size            (200)
-#define DEFAULT_cluster_max_size            (3000)
-
-struct CloudProcessParams{
-    double downsample_leaf_size;
-    double octree_voxel_size;
-    double background_reset_threshold;
-    double cluster_join_distance;
-    double cluster_min_size;
-    double cluster_max_size;
-    bool reset_request;
-};
+/*
+ * Current parameter snapshot. Writers build a complete copy and swap it in with
+ * boost::atomic_store(), readers take one boost::atomic_load() per frame so a frame
+ * never sees a half applied update and never waits on the service thread.
+ */
+CloudProcessParamsConstPtr _cloudParamsPtr;
 
-tf::Vector3 _kinectPosition;
-tf::Quaternion _kinectOrientation;
-CloudProcessParams _cloudParams;
+//Services are handled on their own queue so parameter updates never stall point cloud processing
+ros::CallbackQueue _serviceQueue;
+CloudPipeline _pipeline;
 
 using namespace point_downsample;
 
 /*Function Prototypes*/
 void publishTransform(const ros::TimerEvent& event);
+void publishDiagnostics(const ros::TimerEvent& event);
 double loadRosParam(std::string param, double value=0.0f);
 void reloadParameters();
 
 //Subscriber callbacks
 void pointCloudCallback (const sensor_msgs::PointCloud2ConstPtr& input);
 
+//Helper functions
+void publishPacked(ros::Publisher& pub, const pcl::PointCloud<pcl::PointXYZ>& cloud, const std_msgs::Header& header, const CloudProcessParams& params);
+CloudProcessParamsConstPtr currentParams();
+
 //Service callbackes
 bool refreshParams(RefreshParams::Request &request, RefreshParams::Response &response);
 
@@ -119,25 +127,6 @@ bool refreshParams(RefreshParams::Request &request, RefreshParams::Response &res
 //Helper functions
 //void updateTransform();
 
-visualization_msgs::MarkerArrayPtr generateMarkers(float centroid[3], float maxValue[3], float minValue[3], int id, ros::Time stamp);
-
-struct point3d {
-    point3d(float values[3]){
-        data[0]=values[0];
-        data[1]=values[1];
-        data[2]=values[2];
-    }
-
-    union{
-        float data[4];
-        struct {
-          float x;
-          float y;
-          float z;
-        };
-    };
-};
-
 
 
 int main(int argc, char** argv){
@@ -165,193 +154,157 @@ int main(int argc, char** argv){
     _clustersPub = _nhPtr->advertise<sensor_msgs::PointCloud2> ("point_downsample/clusters", 1);
     _foregroundPub = _nhPtr->advertise<sensor_msgs::PointCloud2> ("point_downsample/foreground", 1);
 
+    _pointsPackedPub = _nhPtr->advertise<VoxelCloud> ("point_downsample/points/packed", 1);
+    _backgroundPackedPub = _nhPtr->advertise<VoxelCloud> ("point_downsample/background/packed", 1);
+    _clustersPackedPub = _nhPtr->advertise<VoxelCloud> ("point_downsample/clusters/packed", 1);
+    _foregroundPackedPub = _nhPtr->advertise<VoxelCloud> ("point_downsample/foreground/packed", 1);
+
     //Controls
     _visualizerPub = _nhPtr->advertise<visualization_msgs::MarkerArray>( "point_downsample/markers", 0 );
+    _diagnosticsPub = _nhPtr->advertise<diagnostic_msgs::DiagnosticArray>( "point_downsample/diagnostics", 1 );
     /* TODO: There should be a bounds interactive marker for defining a ROI plus service set/getters */
 
 
     //Services
-    _refreshParamServ = _nhPtr->advertiseService("point_downsample/refresh_params", refreshParams);
+    ros::AdvertiseServiceOptions refreshOptions = ros::AdvertiseServiceOptions::create<RefreshParams>(
+                                                        "point_downsample/refresh_params",
+                                                        refreshParams,
+                                                        ros::VoidConstPtr(),
+                                                        &_serviceQueue);
+    _refreshParamServ = _nhPtr->advertiseService(refreshOptions);
+
+    ros::AsyncSpinner serviceSpinner(1, &_serviceQueue);
+    serviceSpinner.start();
 
 
     ros::Timer timer = _nhPtr->createTimer(ros::Duration(0.05), publishTransform);
+    ros::Timer diagnosticsTimer = _nhPtr->createTimer(ros::Duration(1.0), publishDiagnostics);
 
     //Lift off
     ros::spin();
 }
 
 void publishTransform(const ros::TimerEvent& event){
+    CloudProcessParamsConstPtr params = currentParams();
     tf::Transform transform;
 
-    transform.setOrigin( _kinectPosition );
-    transform.setRotation( _kinectOrientation );
+    transform.setOrigin( params->kinect_position );
+    transform.setRotation( params->kinect_orientation );
     _tfBroadcaster->sendTransform(tf::StampedTransform(transform, ros::Time::now(), "base_link", "camera_link"));
 }
 
-using sensor_msgs::PointCloud;
-using sensor_msgs::PointCloud2;
+void publishDiagnostics(const ros::TimerEvent& event){
+    diagnostic_msgs::DiagnosticArrayPtr diagnostics(new diagnostic_msgs::DiagnosticArray);
 
-typedef pcl::PointCloud<pcl::PointXYZ> PCLPointCloud;
-typedef pcl::PointCloud<pcl::PointXYZ>::Ptr PCLPointCloudPtr;
+    diagnostics->header.stamp = ros::Time::now();
+    diagnostics->status.push_back( _pipeline.stats().toDiagnostics("point_downsample: pipeline") );
 
-PCLPointCloud inputCloud;
-//PCLPointCloud downsampledCloud;
-//PCLPointCloud* downsampledCloudPtr(new PCLPointCloud());
+    _diagnosticsPub.publish(diagnostics);
+}
 
-PCLPointCloudPtr backgroundCloudPtr;
-PCLPointCloudPtr foregroundCloudPtr;
+using sensor_msgs::PointCloud;
+using sensor_msgs::PointCloud2;
+
+CloudPipelineOutput cloudOutput;
 sensor_msgs::PointCloud2 downsampledSensor;
 sensor_msgs::PointCloud2 backgroundSensor;
 sensor_msgs::PointCloud2 foregroundSensor;
 
 void pointCloudCallback (const sensor_msgs::PointCloud2ConstPtr& input) {
+    PipelineStats& stats = _pipeline.stats();
+
     if(input->data.size() <= 0){
         std::cout << "Input cloud size " << input->data.size() << std::endl;
+        stats.countEmpty();
         return;
     }
 
-    bool doCluster = (_clustersPub.getNumSubscribers() > 0) || (_visualizerPub.getNumSubscribers() > 0);
-    bool doSegment = (_backgroundPub.getNumSubscribers() > 0) || (_foregroundPub.getNumSubscribers() > 0) || doCluster;
-    bool doDownsample = (_pointsPub.getNumSubscribers() > 0) || doCluster || doSegment;
+    CloudProcessParamsConstPtr params = currentParams();
 
-    PCLPointCloudPtr downsampledCloudPtr(new PCLPointCloud());
+    bool doCluster = (_clustersPub.getNumSubscribers() > 0) || (_clustersPackedPub.getNumSubscribers() > 0) || (_visualizerPub.getNumSubscribers() > 0);
+    bool doSegment = (_backgroundPub.getNumSubscribers() > 0) || (_foregroundPub.getNumSubscribers() > 0) ||
+                     (_backgroundPackedPub.getNumSubscribers() > 0) || (_foregroundPackedPub.getNumSubscribers() > 0) || doCluster;
+    bool doDownsample = (_pointsPub.getNumSubscribers() > 0) || (_pointsPackedPub.getNumSubscribers() > 0) || doCluster || doSegment;
 
-    if(doDownsample){
-        pcl::fromROSMsg(*input, inputCloud);
-
-        //pcl::PointCloudConstPtr downSampledInput(new pcl::PointCloud);
-        float leafSize = _cloudParams.downsample_leaf_size;
-        pcl::VoxelGrid<pcl::PointXYZ> downsample;
-        downsample.setInputCloud(inputCloud.makeShared());
-        downsample.setLeafSize(leafSize, leafSize, leafSize);
-        downsample.filter(  *downsampledCloudPtr );
+    _pipeline.process(*input, *params, doDownsample, doSegment, doCluster, cloudOutput);
 
-        if(backgroundCloudPtr.get() == NULL){
-            backgroundCloudPtr = downsampledCloudPtr;
-        }
+    stats.start(PipelineStats::Publish);
 
-        //Publish downsample points
+    //Publish downsample points
+    if(doDownsample){
         if(_pointsPub.getNumSubscribers() > 0){
-            pcl::toROSMsg(*downsampledCloudPtr, downsampledSensor);
+            pcl::toROSMsg(*cloudOutput.downsampled, downsampledSensor);
             _pointsPub.publish(downsampledSensor);
         }
+
+        publishPacked(_pointsPackedPub, *cloudOutput.downsampled, input->header, *params);
     }
 
-    std::vector<int> newPointIdxVector;
+    //Publish foreground, the background is empty for the frame after a reset
     if(doSegment){
-        pcl::octree::OctreePointCloudChangeDetector<pcl::PointXYZ> octree ( _cloudParams.octree_voxel_size );
-        octree.setInputCloud(backgroundCloudPtr);
-        octree.addPointsFromInputCloud();
-
-        octree.switchBuffers();
-
-        octree.setInputCloud(downsampledCloudPtr);
-        octree.addPointsFromInputCloud();
-
-        // Get vector of point indices from octree voxels which did not exist in previous buffer
-        octree.getPointIndicesFromNewVoxels (newPointIdxVector);
-
-        foregroundCloudPtr = PCLPointCloudPtr( new PCLPointCloud(*downsampledCloudPtr, newPointIdxVector) );
-
-        float foregroundPerecent = (float)foregroundCloudPtr->points.size() / (float)backgroundCloudPtr->points.size();
-
-        if(foregroundPerecent > _cloudParams.background_reset_threshold){
-            backgroundCloudPtr.reset();
-            std::cout << "Resetting foreground percent=" << foregroundPerecent << std::endl;
-        }
-
-        //Publish foreground
         if(_foregroundPub.getNumSubscribers() > 0){
-            pcl::toROSMsg(*foregroundCloudPtr, foregroundSensor);
+            pcl::toROSMsg(*cloudOutput.foreground, foregroundSensor);
             _foregroundPub.publish(foregroundSensor);
         }
 
-        if(_backgroundPub.getNumSubscribers() > 0){
-            pcl::toROSMsg(*backgroundCloudPtr, backgroundSensor);
-            _backgroundPub.publish(backgroundSensor);
-        }
-    }
-
-
-    std::vector<point3d> centroids;
-    if(doCluster){
-        if(foregroundCloudPtr->points.size() > 0){
-            // Creating the KdTree object for the search method of the extraction
-            pcl::search::KdTree<pcl::PointXYZ>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZ>);
-            tree->setInputCloud ( foregroundCloudPtr );
-
+        publishPacked(_foregroundPackedPub, *cloudOutput.foreground, input->header, *params);
 
-            std::vector<pcl::PointIndices> cluster_indices;
-            pcl::EuclideanClusterExtraction<pcl::PointXYZ> ec;
-            ec.setClusterTolerance ( _cloudParams.cluster_join_distance );
-            ec.setMinClusterSize ( _cloudParams.cluster_min_size );
-            ec.setMaxClusterSize ( _cloudParams.cluster_max_size );
-            ec.setSearchMethod (tree);
-            ec.setInputCloud ( foregroundCloudPtr );
-            ec.extract (cluster_indices);
-
-            int index=0;
-
-            ros::Time stamp = ros::Time::now();
-            pcl::PointCloud<pcl::PointXYZ> clusterCloud;
-
-            visualization_msgs::MarkerArrayPtr markers( new visualization_msgs::MarkerArray );
-
-            //Loop over ever cluster
-            for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin (); it != cluster_indices.end (); ++it){
-
-                float maxValues[3] = {-9000, -9000, -9000};
-                float minValues[3] = {9000, 9000, 9000};
-                float centroid[3] = {0, 0, 0};
+        if(cloudOutput.background.get() != NULL){
+            if(_backgroundPub.getNumSubscribers() > 0){
+                pcl::toROSMsg(*cloudOutput.background, backgroundSensor);
+                _backgroundPub.publish(backgroundSensor);
+            }
 
-                pcl::PointCloud<pcl::PointXYZ> localCluster(*foregroundCloudPtr, it->indices);
-                clusterCloud += localCluster;
+            publishPacked(_backgroundPackedPub, *cloudOutput.background, input->header, *params);
+        }
+    }
 
-                //Loop over every point
-                for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); pit++) {
+    if(doCluster && cloudOutput.foreground->points.size() > 0){
+        //Publish visualization markers
+        if(_visualizerPub.getNumSubscribers() > 0 && cloudOutput.markers->markers.size() > 0){
+            _visualizerPub.publish(cloudOutput.markers);
+        }
 
-                    for(int i=0; i<3; i++){
-                        if(foregroundCloudPtr->points[*pit].data[i] > maxValues[i]){
-                            maxValues[i] = foregroundCloudPtr->points[*pit].data[i];
-                        }
+        //Publish clusters
+        if(_clustersPub.getNumSubscribers() > 0){
+            sensor_msgs::PointCloud2 clusterSensor;
+            pcl::toROSMsg(cloudOutput.clusters, clusterSensor);
 
-                        if(foregroundCloudPtr->points[*pit].data[i] < minValues[i]){
-                            minValues[i] = foregroundCloudPtr->points[*pit].data[i];
-                        }
+            clusterSensor.header.frame_id = input->header.frame_id;
 
-                        centroid[i] += foregroundCloudPtr->points[*pit].data[i];
-                    }
-                }
+            _clustersPub.publish(clusterSensor);
+        }
 
-                for(int i=0; i<3; i++){
-                    centroid[i] = centroid[i] / it->indices.size();
-                }
+        publishPacked(_clustersPackedPub, cloudOutput.clusters, input->header, *params);
+    }
 
-                centroids.push_back( (point3d) centroid );
+    stats.stop(PipelineStats::Publish);
 
-                visualization_msgs::MarkerArrayPtr tempMarkers = generateMarkers(centroid, maxValues, minValues, index++, stamp);
+    _pipeline.finishFrame();
 
-                markers->markers.insert(markers->markers.begin(), tempMarkers->markers.begin(), tempMarkers->markers.end());
-            }
+    return;
+}
 
-            //Publish visualization markers
-            if(_visualizerPub.getNumSubscribers() > 0 && markers->markers.size() > 0){
-                _visualizerPub.publish(markers);
-            }
+void publishPacked(ros::Publisher& pub, const pcl::PointCloud<pcl::PointXYZ>& cloud, const std_msgs::Header& header, const CloudProcessParams& params){
+    if(pub.getNumSubscribers() == 0){
+        return;
+    }
 
-            //Publish clusters
-            if(_clustersPub.getNumSubscribers() > 0){
-                sensor_msgs::PointCloud2 clusterSensor;
-                pcl::toROSMsg(clusterCloud, clusterSensor);
+    if(params.packed_encoding != VoxelCloud::RAW && params.packed_encoding != VoxelCloud::DELTA){
+        ROS_WARN_THROTTLE(5, "publishPacked() - Unsupported voxel encoding %d, skipping", (int)params.packed_encoding);
+        return;
+    }
 
-                clusterSensor.header.frame_id = input->header.frame_id;
+    VoxelCloudPtr packed(new VoxelCloud);
 
-                _clustersPub.publish(clusterSensor);
-            }
-        }
+    //Foreground and cluster clouds are subsets of the downsampled cloud so the leaf size is shared
+    if(!encodeVoxelCloud(cloud, params.downsample_leaf_size, params.packed_encoding, *packed)){
+        ROS_WARN_THROTTLE(5, "publishPacked() - Cloud does not fit the 16-bit voxel grid, skipping");
+        return;
     }
 
-    return;
+    packed->header = header;
+    pub.publish(packed);
 }
 
 double loadRosParam(std::string param, double value){
@@ -366,7 +319,31 @@ double loadRosParam(std::string param, double value){
 }
 
 bool refreshParams(RefreshParams::Request &request, RefreshParams::Response &response){
-    reloadParameters();
+    if(request.params != RefreshParams::Request::DIFF_PARAMS){
+        reloadParameters();
+        response.success = true;
+        return true;
+    }
+
+    if(request.names.size() != request.values.size()){
+        ROS_WARN("refreshParams() - %lu names but %lu values", request.names.size(), request.values.size());
+        response.success = false;
+        return true;
+    }
+
+    //Apply the changed values to a copy of the current snapshot, no master round trips
+    boost::shared_ptr<CloudProcessParams> params( new CloudProcessParams(*currentParams()) );
+
+    response.success = true;
+    for(unsigned int i=0; i<request.names.size(); i++){
+        if(!params->setValue(request.names[i], request.values[i])){
+            ROS_WARN("refreshParams() - Unknown parameter %s", request.names[i].c_str());
+            response.success = false;
+        }
+    }
+
+    params->updateDerived();
+    boost::atomic_store(&_cloudParamsPtr, CloudProcessParamsConstPtr(params));
 
     return true;
 }
@@ -374,95 +351,21 @@ bool refreshParams(RefreshParams::Request &request, RefreshParams::Response &res
 void reloadParameters(){
     std::cout << "Reloading parameters ... ";
 
-    //Update position
-    _kinectPosition.setX( loadRosParam("waas/cloud/position/x") );
-    _kinectPosition.setY( loadRosParam("waas/cloud/position/y") );
-    _kinectPosition.setZ( loadRosParam("waas/cloud/position/z") );
-
-    double deg2radCoef = M_PI / 180.0f;
+    boost::shared_ptr<CloudProcessParams> params( new CloudProcessParams() );
+    params->reset_request = false;
 
-    //Update orientation
-    _kinectOrientation.setRPY(
-                                deg2radCoef * loadRosParam("waas/cloud/orientation/roll"),
-                                deg2radCoef * loadRosParam("waas/cloud/orientation/pitch"),
-                                deg2radCoef * loadRosParam("waas/cloud/orientation/yaw")
-                              );
+    for(unsigned int i=0; i<CLOUD_PARAM_COUNT; i++){
+        params->setValue( CLOUD_PARAMS[i].name, loadRosParam(CLOUD_PARAMS[i].name, CLOUD_PARAMS[i].defaultValue) );
+    }
 
-    //Update point cloud processing parameters
-    _cloudParams.downsample_leaf_size = loadRosParam("waas/downsample_leaf_size", DEFAULT_downsample_leaf_size);
-    _cloudParams.octree_voxel_size = loadRosParam("waas/octree_voxel_size", DEFAULT_octree_voxel_size);
-    _cloudParams.background_reset_threshold = loadRosParam("waas/background_reset_threshold", DEFAULT_background_reset_threshold);
-    _cloudParams.cluster_join_distance = loadRosParam("waas/cluster_join_distance", DEFAULT_cluster_join_distance);
-    _cloudParams.cluster_min_size = loadRosParam("waas/cluster_min_size", DEFAULT_cluster_min_size);
-    _cloudParams.cluster_max_size = loadRosParam("waas/cluster_max_size", DEFAULT_cluster_max_size);
+    params->updateDerived();
+    boost::atomic_store(&_cloudParamsPtr, CloudProcessParamsConstPtr(params));
 
     std::cout << "done!" << std::endl;
 }
 
-
-visualization_msgs::MarkerArrayPtr generateMarkers(float centroid[3], float maxValue[3], float minValue[3], int id, ros::Time stamp){
-    visualization_msgs::Marker centroidMarker;
-    centroidMarker.header.frame_id = "/camera_depth_optical_frame";
-    //centroidMarker.header.stamp = ros::Time::now();;
-    centroidMarker.ns = "point_downsample";
-    centroidMarker.id = id;
-    centroidMarker.type = visualization_msgs::Marker::SPHERE;
-    centroidMarker.action = visualization_msgs::Marker::ADD;
-    centroidMarker.pose.position.x = centroid[0];
-    centroidMarker.pose.position.y = centroid[1];
-    centroidMarker.pose.position.z = centroid[2];
-    centroidMarker.pose.orientation.x = 0.0;
-    centroidMarker.pose.orientation.y = 0.0;
-    centroidMarker.pose.orientation.z = 0.0;
-    centroidMarker.pose.orientation.w = 1.0;
-    centroidMarker.scale.x = 0.3;
-    centroidMarker.scale.y = 0.3;
-    centroidMarker.scale.z = 0.3;
-    centroidMarker.color.a = 0.3;
-    centroidMarker.color.r = 1.0;
-    centroidMarker.color.g = 1.0;
-    centroidMarker.color.b = 0.0;
-
-    float center[3];
-    float range[3];
-
-    for(int i=0; i<3; i++){
-        range[i] = maxValue[i] - minValue[i];
-        center[i] = (range[i] / 2.0f) + minValue[i];
-
-        //cout << "range=" << range[i] << endl;
-    }
-
-    visualization_msgs::Marker boundsMarker;
-    boundsMarker.header.frame_id = "/camera_depth_optical_frame";
-    //boundsMarker.header.stamp = ros::Time::now();;
-    boundsMarker.ns = "point_downsample";
-    boundsMarker.id = id+100;
-    boundsMarker.type = visualization_msgs::Marker::CUBE;
-    boundsMarker.action = visualization_msgs::Marker::ADD;
-    boundsMarker.pose.position.x = center[0];
-    boundsMarker.pose.position.y = center[1];
-    boundsMarker.pose.position.z = center[2];
-    boundsMarker.pose.orientation.x = 0.0;
-    boundsMarker.pose.orientation.y = 0.0;
-    boundsMarker.pose.orientation.z = 0.0;
-    boundsMarker.pose.orientation.w = 1.0;
-    boundsMarker.scale.x = range[0];
-    boundsMarker.scale.y = range[1];
-    boundsMarker.scale.z = range[2];
-    boundsMarker.color.a = 0.2;
-    boundsMarker.color.r = 0.0;
-    boundsMarker.color.g = 0.0;
-    boundsMarker.color.b = 1.0;
-
-
-    visualization_msgs::MarkerArrayPtr markerArray( new visualization_msgs::MarkerArray );
-
-
-    markerArray->markers.push_back(centroidMarker);
-    markerArray->markers.push_back(boundsMarker);
-
-    return markerArray;
+CloudProcessParamsConstPtr currentParams(){
+    return boost::atomic_load(&_cloudParamsPtr);
 }
 
 
@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <ros/ros.h>
+
+#include "cloudcapture.h"
+#include "cloudpipeline.h"
+#include "monotonicclock.h"
+
+/*
+ * Feeds a capture through CloudPipeline, the same code pointCloudCallback() runs, without a
+ * sensor or roscore. Every stage runs for every frame as if all topics were subscribed.
+ *
+ *  point_downsample_replay <file> [--realtime] [--loop N] [--param waas/name=value ...]
+ */
+
+static void usage(){
+    fprintf(stderr, "Usage: point_downsample_replay <file> [--realtime] [--loop N] [--param waas/name=value ...]\n");
+}
+
+static void printStats(PipelineStats& stats){
+    diagnostic_msgs::DiagnosticStatus status = stats.toDiagnostics("point_downsample_replay");
+
+    for(unsigned int i=0; i<status.values.size(); i++){
+        //Sensor age compares recorded stamps against now, meaningless offline
+        if(status.values[i].key.find("sensor age") == 0){
+            continue;
+        }
+
+        printf("  %-28s %s\n", status.values[i].key.c_str(), status.values[i].value.c_str());
+    }
+}
+
+int main(int argc, char** argv){
+    std::string file;
+    bool realtime = false;
+    int loops = 1;
+    CloudProcessParams params;
+
+    for(int i=1; i<argc; i++){
+        if(strcmp(argv[i], "--realtime") == 0){
+            realtime = true;
+        }
+        else if(strcmp(argv[i], "--loop") == 0 && i + 1 < argc){
+            loops = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--param") == 0 && i + 1 < argc){
+            std::string assignment = argv[++i];
+            size_t split = assignment.find('=');
+
+            if(split == std::string::npos || !params.setValue(assignment.substr(0, split), atof(assignment.c_str() + split + 1))){
+                fprintf(stderr, "Unknown parameter %s\n", assignment.c_str());
+                return -1;
+            }
+        }
+        else if(argv[i][0] != '-' && file.empty()){
+            file = argv[i];
+        }
+        else{
+            usage();
+            return -1;
+        }
+    }
+
+    if(file.empty() || loops < 1){
+        usage();
+        return -1;
+    }
+
+    params.updateDerived();
+
+    //Wall clock only, no master needed
+    ros::Time::init();
+
+    CaptureReader reader;
+    if(!reader.open(file)){
+        return -1;
+    }
+
+    if(reader.frameCount() == 0){
+        fprintf(stderr, "%s has no frames\n", file.c_str());
+        return -1;
+    }
+
+    printf("Replaying %lu frames from %s, %s, %d loop(s)\n", (unsigned long)reader.frameCount(), file.c_str(),
+           realtime ? "real time" : "as fast as possible", loops);
+
+    CloudPipeline pipeline;
+    CloudPipelineOutput output;
+    sensor_msgs::PointCloud2 cloud;
+
+    uint64_t frames = 0;
+    uint64_t clusters = 0;
+    uint64_t unreadable = 0;
+    uint64_t startNs = monotonicNs();
+
+    for(int loop=0; loop<loops; loop++){
+        uint64_t loopStartNs = monotonicNs();
+        int64_t firstReceiveNs = reader.entry(0).receiveNs;
+
+        for(uint64_t i=0; i<reader.frameCount(); i++){
+            if(realtime){
+                sleepUntilNs( loopStartNs + (reader.entry(i).receiveNs - firstReceiveNs) );
+            }
+
+            //readFrame() already logged why, leaving a gap in the sequence counts it as dropped
+            if(!reader.readFrame(i, cloud)){
+                unreadable++;
+                continue;
+            }
+
+            //Keep sequence numbers increasing across loops so drop counting stays meaningful
+            cloud.header.seq = frames + unreadable;
+
+            if(cloud.data.size() <= 0){
+                pipeline.stats().countEmpty();
+                continue;
+            }
+
+            pipeline.process(cloud, params, true, true, true, output);
+            pipeline.finishFrame();
+
+            clusters += output.centroids.size();
+            frames++;
+        }
+    }
+
+    double elapsedSec = (monotonicNs() - startNs) / 1.0e9;
+
+    printf("Processed %lu frames in %.3f s, %.1f fps, %.2f clusters/frame\n", (unsigned long)frames, elapsedSec,
+           frames / elapsedSec, frames > 0 ? (double)clusters / frames : 0.0);
+
+    if(unreadable > 0){
+        printf("Dropped %lu unreadable frames\n", (unsigned long)unreadable);
+    }
+
+    printStats(pipeline.stats());
+
+    return 0;
+}
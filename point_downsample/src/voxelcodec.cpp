@@ -0,0 +1,239 @@
+#include "point_downsample/voxelcodec.h"
+
+#include <pcl_conversions/pcl_conversions.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace point_downsample {
+
+#define VOXEL_AXIS_MAX  (65535)
+
+static inline uint64_t packKey(uint32_t x, uint32_t y, uint32_t z){
+    return ((uint64_t)x << 32) | ((uint64_t)y << 16) | (uint64_t)z;
+}
+
+static inline void writeVarint(std::vector<uint8_t>& out, uint64_t value){
+    while(value >= 0x80){
+        out.push_back( (uint8_t)(value | 0x80) );
+        value >>= 7;
+    }
+    out.push_back( (uint8_t)value );
+}
+
+static inline bool readVarint(const std::vector<uint8_t>& in, size_t& pos, uint64_t& value){
+    value = 0;
+
+    for(int shift=0; shift < 64; shift += 7){
+        if(pos >= in.size()){
+            return false;
+        }
+
+        uint8_t byte = in[pos++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if((byte & 0x80) == 0){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static inline void writeU16(std::vector<uint8_t>& out, uint32_t value){
+    out.push_back( (uint8_t)(value & 0xff) );
+    out.push_back( (uint8_t)(value >> 8) );
+}
+
+
+bool encodeVoxelCloud(const pcl::PointCloud<pcl::PointXYZ>& cloud, float leafSize, uint8_t encoding, VoxelCloud& msg){
+    if(leafSize <= 0.0f){
+        return false;
+    }
+
+    float invLeaf = 1.0f / leafSize;
+
+    //Quantize and find the grid bounds
+    std::vector<int32_t> voxels;
+    voxels.reserve(cloud.points.size() * 3);
+
+    int32_t minVoxel[3] = { std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max() };
+    int32_t maxVoxel[3] = { std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min() };
+
+    for(size_t i=0; i<cloud.points.size(); i++){
+        const pcl::PointXYZ& pt = cloud.points[i];
+
+        if(!pcl_isfinite(pt.x) || !pcl_isfinite(pt.y) || !pcl_isfinite(pt.z)){
+            continue;
+        }
+
+        for(int axis=0; axis<3; axis++){
+            int32_t v = (int32_t) std::floor(pt.data[axis] * invLeaf);
+
+            minVoxel[axis] = std::min(minVoxel[axis], v);
+            maxVoxel[axis] = std::max(maxVoxel[axis], v);
+            voxels.push_back(v);
+        }
+    }
+
+    size_t count = voxels.size() / 3;
+
+    msg.encoding = encoding;
+    msg.leaf_size = leafSize;
+    msg.point_count = count;
+    msg.data.clear();
+
+    if(count == 0){
+        msg.origin[0] = msg.origin[1] = msg.origin[2] = 0;
+        return true;
+    }
+
+    for(int axis=0; axis<3; axis++){
+        if((int64_t)maxVoxel[axis] - (int64_t)minVoxel[axis] > VOXEL_AXIS_MAX){
+            return false;
+        }
+
+        msg.origin[axis] = minVoxel[axis];
+    }
+
+    if(encoding == VoxelCloud::RAW){
+        msg.data.reserve(count * 6);
+
+        for(size_t i=0; i<voxels.size(); i++){
+            writeU16(msg.data, (uint32_t)(voxels[i] - minVoxel[i % 3]));
+        }
+
+        return true;
+    }
+
+    if(encoding != VoxelCloud::DELTA){
+        return false;
+    }
+
+    std::vector<uint64_t> keys(count);
+
+    for(size_t i=0; i<count; i++){
+        keys[i] = packKey(  voxels[i*3]   - minVoxel[0],
+                            voxels[i*3+1] - minVoxel[1],
+                            voxels[i*3+2] - minVoxel[2] );
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    //Each token is varint(delta << 1 | hasRun) optionally followed by varint(run),
+    //where run counts the following keys that each advance by exactly one voxel
+    msg.data.reserve(count * 2);
+
+    uint64_t previous = 0;
+    size_t i = 0;
+
+    while(i < count){
+        uint64_t delta = keys[i] - previous;
+
+        size_t run = 0;
+        while(i + run + 1 < count && keys[i + run + 1] == keys[i + run] + 1){
+            run++;
+        }
+
+        writeVarint(msg.data, (delta << 1) | (run > 0 ? 1 : 0));
+
+        if(run > 0){
+            writeVarint(msg.data, run);
+        }
+
+        previous = keys[i + run];
+        i += run + 1;
+    }
+
+    return true;
+}
+
+
+bool decodeVoxelCloud(const VoxelCloud& msg, pcl::PointCloud<pcl::PointXYZ>& cloud){
+    cloud.points.clear();
+    cloud.header = pcl_conversions::toPCL(msg.header);
+
+    float leaf = msg.leaf_size;
+    float base[3];
+
+    for(int axis=0; axis<3; axis++){
+        base[axis] = ((float)msg.origin[axis] + 0.5f) * leaf;
+    }
+
+    if(msg.encoding == VoxelCloud::RAW){
+        if(msg.data.size() < (size_t)msg.point_count * 6){
+            return false;
+        }
+
+        //An empty cloud has no payload to point into
+        if(msg.point_count == 0){
+            cloud.width = 0;
+            cloud.height = 1;
+            cloud.is_dense = true;
+            return true;
+        }
+
+        cloud.points.reserve(msg.point_count);
+
+        const uint8_t* data = &msg.data[0];
+
+        for(uint32_t i=0; i<msg.point_count; i++, data += 6){
+            pcl::PointXYZ pt;
+            pt.x = base[0] + (float)(data[0] | (data[1] << 8)) * leaf;
+            pt.y = base[1] + (float)(data[2] | (data[3] << 8)) * leaf;
+            pt.z = base[2] + (float)(data[4] | (data[5] << 8)) * leaf;
+
+            cloud.points.push_back(pt);
+        }
+    }
+    else if(msg.encoding == VoxelCloud::DELTA){
+        size_t pos = 0;
+        uint64_t key = 0;
+
+        //point_count is not trusted, every token takes at least one byte
+        cloud.points.reserve( std::min((size_t)msg.point_count, msg.data.size()) );
+
+        while(cloud.points.size() < msg.point_count){
+            uint64_t token = 0;
+            uint64_t run = 0;
+
+            if(!readVarint(msg.data, pos, token)){
+                return false;
+            }
+
+            if((token & 1) && !readVarint(msg.data, pos, run)){
+                return false;
+            }
+
+            //A run past point_count is malformed, never allocate for it
+            if(run >= msg.point_count - cloud.points.size()){
+                return false;
+            }
+
+            key += token >> 1;
+
+            for(uint64_t r=0; r <= run; r++, key++){
+                pcl::PointXYZ pt;
+                pt.x = base[0] + (float)((key >> 32) & 0xffff) * leaf;
+                pt.y = base[1] + (float)((key >> 16) & 0xffff) * leaf;
+                pt.z = base[2] + (float)(key & 0xffff) * leaf;
+
+                cloud.points.push_back(pt);
+            }
+
+            key--;
+        }
+    }
+    else{
+        return false;
+    }
+
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    cloud.is_dense = true;
+
+    return cloud.points.size() == msg.point_count;
+}
+
+}
@@ -10,7 +10,16 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->setupUi(this);
 
     _nextRun = NULL;
-    _ola = new OlaManager(this);
+    //--output <spec> picks the DMX output, see createOutputSink()
+    OutputSink* sink = NULL;
+    QStringList args = QCoreApplication::arguments();
+    int outputArg = args.indexOf("--output");
+
+    if(outputArg >= 0 && outputArg + 1 < args.size()){
+        sink = createOutputSink(args[outputArg + 1]);
+    }
+
+    _ola = new OlaManager(sink, this);
     _pixelMap = new PixelMapper(_ola, this);
 
     _pixelMap->_outputLabel = ui->imageLabel;
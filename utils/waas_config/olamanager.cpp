@@ -1,23 +1,9 @@
 #include "olamanager.h"
 
-#include <ola/DmxBuffer.h>
-#include <ola/Logging.h>
-#include <ola/StreamingClient.h>
-
-OlaManager::OlaManager(QObject *parent) :
+OlaManager::OlaManager(OutputSink* sink, QObject *parent) :
     QObject(parent)
 {
-
-    // turn on OLA logging
-    ola::InitLogging(ola::OLA_LOG_WARN, ola::OLA_LOG_STDERR);
-
-    _client = new ola::StreamingClient();
-
-    // Setup the client, this connects to the server
-    if (_client->Setup()) {
-        qDebug() << "ERROR: OLA Setup failed" << endl;
-        return;
-    }
+    _sink = (sink != NULL) ? sink : new OlaSink();
 
     for(int i=1; i<11; i++){
         ola::DmxBuffer* buffer = new ola::DmxBuffer();
@@ -27,6 +13,10 @@ OlaManager::OlaManager(QObject *parent) :
     }
 }
 
+OlaManager::~OlaManager(){
+    delete _sink;
+}
+
 
 void OlaManager::sendBuffers(){
     QList<int> universes = _buffers.keys();
@@ -35,9 +25,17 @@ void OlaManager::sendBuffers(){
 
         int universe = universes[i];
 
-        _client->SendDmx(universe, *_buffers[universe]);
+        //Buffers may be shorter than a universe, sinks always take all 512 channels
+        uint8_t channels[OUTPUT_SINK_SIZE];
+        unsigned int length = OUTPUT_SINK_SIZE;
 
+        memset(channels, 0, sizeof(channels));
+        _buffers[universe]->Get(channels, &length);
+
+        _sink->send(universe, channels);
     }
+
+    _sink->flush();
 }
 
 void OlaManager::blackout(){
@@ -6,16 +6,20 @@
 #include <QObject>
 
 #include <ola/DmxBuffer.h>
-#include <ola/Logging.h>
-#include <ola/StreamingClient.h>
 
 #include "utils.h"
+#include "outputsink.h"
 
 class OlaManager : public QObject
 {
     Q_OBJECT
     public:
-        explicit OlaManager(QObject *parent = 0);
+        /**
+         * @param sink  Where universes are sent, owned by the manager. NULL sends through
+         *              a local olad.
+         */
+        explicit OlaManager(OutputSink* sink = NULL, QObject *parent = 0);
+        ~OlaManager();
 
         void updateBuffers(QMap<int,ola::DmxBuffer> data);
         void updateBuffer(int universe, ola::DmxBuffer& data);
@@ -37,7 +41,7 @@ class OlaManager : public QObject
         
 
     private:
-        ola::StreamingClient* _client;
+        OutputSink* _sink;
         QMap<int,ola::DmxBuffer*> _buffers;
 };
 
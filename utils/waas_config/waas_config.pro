@@ -14,17 +14,27 @@ TEMPLATE = app
 LIBS += -Llib -lprotobuf -L /usr/local/lib -lola  -lolacommon
 INCLUDEPATH += /usr/local/include
 
+# DMX outputs are shared with pixel_map_node
+INCLUDEPATH += ../../ola_dmx_driver/src
+LIBS += -lrt
+
 SOURCES += main.cpp\
         mainwindow.cpp \
     ledrun.cpp \
     utils.cpp \
     olamanager.cpp \
-    pixelmapper.cpp
+    pixelmapper.cpp \
+    ../../ola_dmx_driver/src/outputsink.cpp \
+    ../../ola_dmx_driver/src/monotonicclock.cpp \
+    ../../ola_dmx_driver/src/e131sender.cpp
 
 HEADERS  += mainwindow.h \
     ledrun.h \
     utils.h \
     olamanager.h \
-    pixelmapper.h
+    pixelmapper.h \
+    ../../ola_dmx_driver/src/outputsink.h \
+    ../../ola_dmx_driver/src/monotonicclock.h \
+    ../../ola_dmx_driver/src/e131sender.h
 
 FORMS    += mainwindow.ui
@@ -43,6 +43,8 @@ MainWindow::MainWindow(QWidget *parent) :
 
     connect(_srvThread, SIGNAL(finished()), _srvThread, SLOT(deleteLater()));
     connect(this, SIGNAL(triggerParamRefresh()), _srvCaller, SLOT(paramRefreshSlot()));
+    connect(this, SIGNAL(triggerGlobesRefresh()), _srvCaller, SLOT(globesRefreshSlot()));
+    connect(this, SIGNAL(cloudParamChanged(QString,double)), _srvCaller, SLOT(cloudParamChangedSlot(QString,double)));
     _srvThread->start(QThread::LowPriority);
 }
 
@@ -80,6 +82,12 @@ void MainWindow::loadRosParams() {
     ui->globeSpacingYSpin->setValue( loadRosParam("/waas/globes/spacing/y") );
 }
 
+void MainWindow::setCloudParam(QString param, double value) {
+    //Keep the master current for restarts, the node itself only receives the change
+    _nhPtr->setParam(param.toStdString(), value);
+    emit cloudParamChanged(param, value);
+}
+
 double MainWindow::loadRosParam(QString param, double value){
     if(_nhPtr->hasParam( param.toStdString() )){
          _nhPtr->getParam( param.toStdString(), value );
@@ -94,103 +102,91 @@ double MainWindow::loadRosParam(QString param, double value){
 
 
 void MainWindow::rollChangedSlot(double value) {
-    _nhPtr->setParam("/waas/cloud/orientation/roll", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/cloud/orientation/roll", value);
 }
 
 void MainWindow::pitchChangedSlot(double value) {
-    _nhPtr->setParam("/waas/cloud/orientation/pitch", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/cloud/orientation/pitch", value);
 }
 
 void MainWindow::yawChangedSlot(double value) {
-    _nhPtr->setParam("/waas/cloud/orientation/yaw", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/cloud/orientation/yaw", value);
 }
 
 void MainWindow::xPosChangedSlot(double value) {
-    _nhPtr->setParam("/waas/cloud/position/x", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/cloud/position/x", value);
 }
 
 void MainWindow::yPosChangedSlot(double value) {
-    _nhPtr->setParam("/waas/cloud/position/y", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/cloud/position/y", value);
 }
 
 void MainWindow::zPosChangedSlot(double value) {
-    _nhPtr->setParam("/waas/cloud/position/z", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/cloud/position/z", value);
 }
 
 void MainWindow::downsampleLeafSizeChangedSlot(double value){
-    _nhPtr->setParam("/waas/downsample_leaf_size", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/downsample_leaf_size", value);
 }
 
 void MainWindow::octreeVoxelSizeChangedSlot(double value) {
-    _nhPtr->setParam("/waas/octree_voxel_size", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/octree_voxel_size", value);
 }
 
 void MainWindow::backgroundResetThresholdChangedSlot(double value) {
-    _nhPtr->setParam("/waas/background_reset_threshold", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/background_reset_threshold", value);
 }
 
 void MainWindow::clusterJoinDistanceChangedSlot(double value) {
-    _nhPtr->setParam("/waas/cluster_join_distance", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/cluster_join_distance", value);
 }
 
 void MainWindow::clusterMinSizeChangedSlot(double value) {
-    _nhPtr->setParam("/waas/cluster_min_size", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/cluster_min_size", value);
 }
 
 void MainWindow::clusterMaxSizeChangedSlot(double value) {
-    _nhPtr->setParam("/waas/cluster_max_size", value);
-    emit triggerParamRefresh();
+    setCloudParam("/waas/cluster_max_size", value);
 }
 
 
 void MainWindow::globesScaleChangedSlot(double value) {
     _nhPtr->setParam("/waas/globes/scale", value);
-    emit triggerParamRefresh();
+    emit triggerGlobesRefresh();
 }
 
 void MainWindow::globesPositionXChangedSlot(double value) {
     _nhPtr->setParam("/waas/globes/position/x", value);
-    emit triggerParamRefresh();
+    emit triggerGlobesRefresh();
 }
 
 void MainWindow::globesPositionYChangedSlot(double value) {
     _nhPtr->setParam("/waas/globes/position/y", value);
-    emit triggerParamRefresh();
+    emit triggerGlobesRefresh();
 }
 
 void MainWindow::globesOrientationRollChangedSlot(double value) {
     _nhPtr->setParam("/waas/globes/orientation/roll", value);
-    emit triggerParamRefresh();
+    emit triggerGlobesRefresh();
 }
 
 void MainWindow::globesOrientationPitchChangedSlot(double value) {
     _nhPtr->setParam("/waas/globes/orientation/pitch", value);
-    emit triggerParamRefresh();
+    emit triggerGlobesRefresh();
 }
 
 void MainWindow::globesOrientationYawChangedSlot(double value) {
     _nhPtr->setParam("/waas/globes/orientation/yaw", value);
-    emit triggerParamRefresh();
+    emit triggerGlobesRefresh();
 }
 
 
 void MainWindow::globesSpacingXChangedSlot(double value) {
     _nhPtr->setParam("/waas/globes/spacing/x", value);
-    emit triggerParamRefresh();
+    emit triggerGlobesRefresh();
 }
 
 void MainWindow::globesSpacingYChangedSlot(double value) {
     _nhPtr->setParam("/waas/globes/spacing/y", value);
-    emit triggerParamRefresh();
+    emit triggerGlobesRefresh();
 }
@@ -32,6 +32,7 @@ class MainWindow : public QMainWindow
 
     protected:
         double loadRosParam(QString param, double value=0.0f);
+        void setCloudParam(QString param, double value);
 
     public slots:
         void loadRosParams();
@@ -63,6 +64,8 @@ class MainWindow : public QMainWindow
 
     signals:
         void triggerParamRefresh();
+        void triggerGlobesRefresh();
+        void cloudParamChanged(QString param, double value);
 
     private:
         Ui::MainWindow *ui;
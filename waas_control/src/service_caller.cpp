@@ -6,6 +6,7 @@ ServiceCaller::ServiceCaller(ros::NodeHandlePtr nodePtr, QObject* parent)
     :QObject(parent)
 {
     _nhPtr = nodePtr;
+    _flushScheduled = false;
 }
 
 ServiceCaller::~ServiceCaller() {
@@ -16,6 +17,7 @@ void ServiceCaller::paramRefreshSlot() {
     ros::ServiceClient client = _nhPtr->serviceClient<point_downsample::RefreshParams::Request>("/point_downsample/refresh_params");
 
     point_downsample::RefreshParams srv;
+    srv.request.params = point_downsample::RefreshParams::Request::ALL_PARAMS;
 
     if(client.call(srv)){
         qDebug() << "Point_downsample Refresh success";
@@ -24,9 +26,14 @@ void ServiceCaller::paramRefreshSlot() {
         qDebug() << "Point_downsample Refresh failure";
     }
 
+    globesRefreshSlot();
+}
+
+void ServiceCaller::globesRefreshSlot() {
     ros::ServiceClient olaClient = _nhPtr->serviceClient<ola_dmx_driver::RefreshParams::Request>("/pixel_map_node/refresh_params");
 
     ola_dmx_driver::RefreshParams olaSrv;
+    olaSrv.request.params = ola_dmx_driver::RefreshParams::Request::ALL_PARAMS;
 
     if(olaClient.call(olaSrv)){
         qDebug() << "ola_dmx_driver Refresh success";
@@ -35,3 +42,38 @@ void ServiceCaller::paramRefreshSlot() {
         qDebug() << "ola_dmx_driver Refresh failure";
     }
 }
+
+void ServiceCaller::cloudParamChangedSlot(QString param, double value) {
+    _pendingCloudParams.insert(param, value);
+
+    //Queued behind any changes already waiting in this thread's event queue
+    if(!_flushScheduled){
+        _flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flushCloudParams", Qt::QueuedConnection);
+    }
+}
+
+void ServiceCaller::flushCloudParams() {
+    _flushScheduled = false;
+
+    if(_pendingCloudParams.isEmpty()){
+        return;
+    }
+
+    point_downsample::RefreshParams srv;
+    srv.request.params = point_downsample::RefreshParams::Request::DIFF_PARAMS;
+
+    QMap<QString, double>::const_iterator paramIter = _pendingCloudParams.constBegin();
+    for(; paramIter != _pendingCloudParams.constEnd(); paramIter++){
+        srv.request.names.push_back( paramIter.key().toStdString() );
+        srv.request.values.push_back( paramIter.value() );
+    }
+
+    _pendingCloudParams.clear();
+
+    ros::ServiceClient client = _nhPtr->serviceClient<point_downsample::RefreshParams::Request>("/point_downsample/refresh_params");
+
+    if(!client.call(srv) || !srv.response.success){
+        qDebug() << "Point_downsample parameter update failure";
+    }
+}
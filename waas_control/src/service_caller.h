@@ -17,9 +17,21 @@ class ServiceCaller : public QObject
 
     public slots:
         void paramRefreshSlot();
+        void globesRefreshSlot();
+
+        /**
+         * @brief   Queue a point_downsample parameter change. Changes arriving in a burst,
+         *          e.g. while dragging a slider, are sent as a single DIFF_PARAMS request.
+         */
+        void cloudParamChangedSlot(QString param, double value);
+
+    protected slots:
+        void flushCloudParams();
 
     private:
         ros::NodeHandlePtr _nhPtr;
+        QMap<QString, double> _pendingCloudParams;
+        bool _flushScheduled;
 };
 
 #endif  //SERVICE_CALLER_H